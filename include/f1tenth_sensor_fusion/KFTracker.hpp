@@ -18,57 +18,166 @@
 #ifndef F1TENTH_SENSOR_FUSION__KFTRACKER_HPP
 #define F1TENTH_SENSOR_FUSION__KFTRACKER_HPP
 
-#include <opencv2/video/tracking.hpp>
-#include <boost/thread/mutex.hpp>
+#include <f1tenth_sensor_fusion/assignment.hpp>
+#include <f1tenth_sensor_fusion/track_filters.hpp>
 #include <boost/container/vector.hpp>
 #include <pcl/point_types.h>
+#include <cstdint>
 #include <memory>
 
 namespace f1tenth_sensor_fusion
 {
-    typedef boost::container::vector<pcl::PointXYZ> PointVector;
 
-#define prune_interval 50
+    /// Outcome of KFTracker::track().
+    enum class FrameStatus
+    {
+        TRACKED,     ///< the frame updated the tracked objects
+        INITIALIZED, ///< every cluster of the frame started a new object: first frame, or the previous one was too far in time
+        OUT_OF_ORDER ///< the frame is older than the last tracked one and was dropped
+    };
+
+    /**
+     * Reference to a tracked object, looked up with KFTracker::index(). The slot is held by the object for its
+     * lifetime and reused by later objects, which have another generation, so a handle outliving its object is
+     * recognized.
+     */
+    struct TrackHandle
+    {
+        uint32_t slot = 0;
+        uint32_t generation = 0;
+    };
 
+    /// Estimate of a tracked object, see KFTracker::tracks().
+    struct TrackState
+    {
+        uint32_t id;           ///< unique for the lifetime of the tracker
+        TrackHandle handle;
+        PlanarVector position; ///< [m]
+        PlanarVector velocity; ///< [m/s]
+        StateVariance variance;
+        uint32_t age;    ///< frames since the object was created
+        uint32_t missed; ///< consecutive frames without a matched cluster
+    };
+
+    /**
+     * Tracker of the cluster centres of a frame, each object with a filter of its own.
+     *
+     * Not thread safe: a single thread at a time may call its methods. The tracker nodelets configure it before they
+     * subscribe, then only call it from the ordered stage, which tracks one frame at a time.
+     */
     class KFTracker
     {
     public:
-        boost::container::vector<int> track(const PointVector &cCentres);
-        void initialize(const PointVector &cCentres);
+        KFTracker();
 
-    private:
-        boost::mutex mutex_;
-        boost::container::vector<std::unique_ptr<cv::KalmanFilter>> k_filters_;
-        size_t kf_prune_ctr_ = 0;
+        /**
+         * Match the clusters of a frame to the tracked objects and update their filters. The filters are advanced by
+         * the time elapsed since the last frame, so dropped or bunched frames don't make the predictions drift.
+         *
+         * @param[in] cCentres centres of the clusters of the frame
+         * @param[in] stamp acquisition time of the frame [s], 0 if it is unknown: the step is frame_period then
+         * @param[out] objID index of the cluster matched to each tracked object, -1 if it has none. Cleared when the
+         * objects are initialized, untouched when the frame is dropped. Reusing the same vector between frames spares
+         * its allocation
+         * @return whether the frame was tracked, started new objects or was dropped
+         */
+        FrameStatus track(const PointVector &cCentres, double stamp, boost::container::vector<int> &objID);
+        void initialize(const PointVector &cCentres, double stamp);
+
+        /// Drop every tracked object, e.g. when the input was interrupted and the filters are outdated.
+        void reset();
+
+        /**
+         * Estimated positions of the tracked objects after the last frame.
+         *
+         * @param[out] positions one per tracked object, previous contents are overwritten
+         */
+        void positions(PointVector &positions) const;
+
+        /**
+         * Estimates of the tracked objects after the last frame, in the order of positions() and of objID of track(),
+         * which is that of increasing IDs.
+         *
+         * @param[out] tracks one per tracked object, previous contents are overwritten
+         */
+        void tracks(boost::container::vector<TrackState> &tracks) const;
 
-        inline float euclidian_dst(const pcl::PointXYZ &p, const pcl::PointXYZ &q)
+        /**
+         * Position of a tracked object in tracks() and in objID of track(), in O(1).
+         *
+         * @param handle handle of the object, from tracks()
+         * @return -1 if the object was dropped since
+         */
+        int index(const TrackHandle &handle) const
         {
-            return sqrt((p.x - q.x) * (p.x - q.x) + (p.y - q.y) * (p.y - q.y + (p.z - q.z) * (p.z - q.z)));
+            if (handle.slot >= slot_index_.size() || slot_generation_[handle.slot] != handle.generation)
+                return -1;
+            return slot_index_[handle.slot];
         }
 
-        inline void _set_kfilter_state_pre(std::unique_ptr<cv::KalmanFilter> &filter, const pcl::PointXYZ &pt)
+        /**
+         * Select the engine used to associate the KF predictions with the detected clusters.
+         *
+         * @param method the assignment method
+         * @param max_distance matching gate [m], clusters further away from a prediction are never matched to it.
+         * Non-positive values disable gating.
+         */
+        void set_assignment(AssignmentMethod method, float max_distance);
+
+        /**
+         * Select the motion model of the filters. Every tracked object is dropped, so it should be set before tracking.
+         *
+         * @param config the model and its noises
+         */
+        void set_motion_model(const MotionModelConfig &config);
+
+        /**
+         * Set how long a track survives without a matched cluster.
+         *
+         * @param frames consecutive frames an object may miss, it is dropped on the next one
+         */
+        void set_max_missed(int frames);
+
+    private:
+        MotionModelConfig motion_;
+        std::unique_ptr<TrackFilters> k_filters_;
+        boost::container::vector<size_t> filter_slots_; ///< bank slot of each tracked object's filter
+        struct TrackInfo
+        {
+            uint32_t id, age, missed;
+        };
+        boost::container::vector<TrackInfo> track_info_; ///< in the order of filter_slots_
+        uint32_t next_id_ = 0;
+        // Slot table indexed by the filter slots, which an object keeps for its lifetime: the position of the object
+        // in filter_slots_, -1 if the slot is free, and the generation of the slot, bumped every time it is released
+        boost::container::vector<int> slot_index_;
+        boost::container::vector<uint32_t> slot_generation_;
+        uint32_t max_missed_ = 20;
+        bool initialized_ = false;
+        double last_stamp_ = 0.0;
+        std::unique_ptr<AssignmentSolver> solver_;
+        float max_match_distance_ = 0.f;
+
+        inline static PlanarVector _measurement(const pcl::PointXYZ &pt)
         {
-            filter->statePre.at<float>(0) = pt.x;
-            filter->statePre.at<float>(1) = pt.y;
-            filter->statePre.at<float>(2) = 0;
-            filter->statePre.at<float>(3) = 0;
+            return PlanarVector(pt.x, pt.y);
         }
 
-        void _init_KFilters(size_t n);
-        PointVector generate_predictions();
-        boost::container::vector<int> match_objID(const PointVector &pred, const PointVector &cCentres, bool *cluster_used);
-        void create_kfilters_for_new_clusters(boost::container::vector<int> &objID, const PointVector &centres, const bool *cluster_used);
+        // buffers of track(), kept between frames
+        PointVector predictions_;
+        boost::container::vector<bool> cluster_used_;
+
+        /// Allocate a filter from the bank, initialized at the given cluster centre.
+        void _init_KFilter(const pcl::PointXYZ &pt);
+        void generate_predictions(float dt);
+        void match_objID(const PointVector &cCentres, boost::container::vector<int> &objID);
+        void create_kfilters_for_new_clusters(boost::container::vector<int> &objID, const PointVector &centres,
+                                              const boost::container::vector<bool> &cluster_used);
         void prune_unused_kfilters(boost::container::vector<int> &objID);
         void correct_kfilter_matrices(const PointVector &cCentres, const boost::container::vector<int> &objID);
-
-        /**
-         * Return the indices of the smallest element of a 2D matrix. Each row represents a KF predition, each column a detected cluster centroid, their 
-         * intersections the distance between the two.
-         * 
-         * @param mat the distance matrix
-         * @return the indicies of the minimum element. <-1, -1> if no minimum was found (i.e. all elements equal)
-         */
-        std::pair<int, int> find_min_IDX(const float *mat, const size_t row, const size_t col);
+        /// Count the frames of the tracked objects, returns whether any missed more than max_missed_ frames.
+        bool update_track_info(const boost::container::vector<int> &objID);
+        void release_slot(size_t slot);
     };
 }
 
@@ -0,0 +1,42 @@
+/* Copyright 2021 Kovács Gergely Attila
+*
+*   Licensed under the Apache License,
+*   Version 2.0(the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License.
+*
+*/
+
+#ifndef F1TENTH_SENSOR_FUSION__ALLOC_COUNTER_HPP
+#define F1TENTH_SENSOR_FUSION__ALLOC_COUNTER_HPP
+
+#include <cstddef>
+
+#ifdef F1TENTH_SENSOR_FUSION_COUNT_ALLOCATIONS
+
+namespace f1tenth_sensor_fusion
+{
+    /**
+     * Number of heap allocations made by the calling thread so far, counted by the replacement of the global operator
+     * new in the alloc_counter library.
+     */
+    size_t thread_allocations();
+
+    /**
+     * Whether the counting operator new is the one in use. It is not if the library was loaded after the C++ runtime
+     * resolved operator new, as for nodelets loaded by a manager started without LD_PRELOAD=liballoc_counter.so.
+     */
+    bool allocations_counted();
+}
+
+#endif
+
+#endif // F1TENTH_SENSOR_FUSION__ALLOC_COUNTER_HPP
@@ -0,0 +1,118 @@
+/* Copyright 2021 Kovács Gergely Attila
+*
+*   Licensed under the Apache License,
+*   Version 2.0(the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License.
+*
+*/
+
+#ifndef F1TENTH_SENSOR_FUSION__ASSIGNMENT_HPP
+#define F1TENTH_SENSOR_FUSION__ASSIGNMENT_HPP
+
+#include <boost/container/vector.hpp>
+#include <pcl/point_types.h>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace f1tenth_sensor_fusion
+{
+    typedef boost::container::vector<pcl::PointXYZ> PointVector;
+
+    enum class AssignmentMethod
+    {
+        HUNGARIAN,    ///< optimal (minimal total distance) assignment
+        GATED_NEAREST ///< repeatedly match the closest remaining pair, candidates looked up in a spatial grid
+    };
+
+    /**
+     * Parse the name of an assignment method as given in the parameter files.
+     *
+     * @param[in] name either "hungarian" or "gated_nearest"
+     * @param[out] method the parsed method, left untouched on failure
+     * @return false if the name is not recognized
+     */
+    bool parse_assignment_method(const std::string &name, AssignmentMethod &method);
+
+    /// Distance used for association. Tracking happens in the x-y plane, so the z coordinate is ignored.
+    inline float planar_dst(const pcl::PointXYZ &p, const pcl::PointXYZ &q)
+    {
+        return std::sqrt((p.x - q.x) * (p.x - q.x) + (p.y - q.y) * (p.y - q.y));
+    }
+
+    /// Interface of the engines matching predicted object positions to detected cluster centres.
+    class AssignmentSolver
+    {
+    public:
+        virtual ~AssignmentSolver() {}
+
+        /**
+         * Match every prediction to at most one detection and vice versa.
+         *
+         * @param[in] pred predicted positions (e.g. the output of the Kalman filters)
+         * @param[in] centres detected cluster centroids
+         * @param[in] gate maximal distance of a valid pair, non-positive values disable gating
+         * @param[out] assignment index of the matched centre for every prediction, -1 if it is unmatched
+         */
+        virtual void solve(const PointVector &pred, const PointVector &centres, float gate,
+                           boost::container::vector<int> &assignment) = 0;
+    };
+
+    /// Optimal assignment using the Hungarian method (shortest augmenting paths, O(n^2 m)).
+    class HungarianSolver : public AssignmentSolver
+    {
+    public:
+        void solve(const PointVector &pred, const PointVector &centres, float gate,
+                   boost::container::vector<int> &assignment) override;
+
+    private:
+        // buffers are kept between calls to avoid reallocating them every frame
+        std::vector<double> cost_, u_, v_, minv_;
+        std::vector<int> p_, way_;
+        std::vector<char> used_;
+    };
+
+    /// Greedy global-nearest matching restricted to pairs within the gate.
+    class GatedNearestSolver : public AssignmentSolver
+    {
+    public:
+        void solve(const PointVector &pred, const PointVector &centres, float gate,
+                   boost::container::vector<int> &assignment) override;
+
+    private:
+        struct Candidate
+        {
+            float dst;
+            int pred, centre;
+            bool operator<(const Candidate &other) const { return dst < other.dst; }
+        };
+
+        void collect_all(const PointVector &pred, const PointVector &centres);
+        void collect_gated(const PointVector &pred, const PointVector &centres, float gate);
+
+        inline static uint64_t cell_key(int cx, int cy)
+        {
+            return (static_cast<uint64_t>(static_cast<uint32_t>(cx)) << 32) | static_cast<uint32_t>(cy);
+        }
+
+        std::vector<std::pair<uint64_t, int>> grid_; ///< (cell key, centre index), sorted by key
+        std::vector<Candidate> candidates_;
+        std::vector<char> centre_used_;
+    };
+
+    std::unique_ptr<AssignmentSolver> make_assignment_solver(AssignmentMethod method);
+}
+
+#endif // F1TENTH_SENSOR_FUSION__ASSIGNMENT_HPP
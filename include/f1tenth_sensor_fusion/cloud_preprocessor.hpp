@@ -0,0 +1,108 @@
+/* Copyright 2021 Kovács Gergely Attila
+*
+*   Licensed under the Apache License,
+*   Version 2.0(the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License.
+*
+*/
+
+#ifndef F1TENTH_SENSOR_FUSION__CLOUD_PREPROCESSOR_HPP
+#define F1TENTH_SENSOR_FUSION__CLOUD_PREPROCESSOR_HPP
+
+#include <f1tenth_sensor_fusion/ground_filter.hpp>
+#include <f1tenth_sensor_fusion/roi_filter.hpp>
+#include <f1tenth_sensor_fusion/voxel_filter.hpp>
+#include <sensor_msgs/PointCloud2.h>
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+namespace f1tenth_sensor_fusion
+{
+    struct PreprocessorConfig
+    {
+        RoiConfig roi;
+        float leaf_size = 0.01f; ///< [m]
+        VoxelMode voxel_mode = VoxelMode::CENTROID;
+        bool segmentation = false; ///< remove the ground plane
+        GroundFilterConfig ground;
+    };
+
+    enum class PreprocessStatus
+    {
+        OK,
+        NO_XYZ_FIELDS, ///< the message has no FLOAT32 x, y, z fields, the cloud is left untouched
+        NO_GROUND      ///< no ground plane was found, the cloud is only downsampled
+    };
+
+    /**
+     * The filtering core of PointCloudFilter without any ROS communication: region of interest extraction, voxel grid
+     * downsampling and the optional removal of the ground plane, in this order. The stages are templated on the point
+     * type, so the fields of richer points go through them with the coordinates.
+     *
+     * The stages keep their buffers and the tracked ground plane between frames, so a preprocessor handles one frame at
+     * a time. The stages are also available one by one, for callers timing them separately.
+     */
+    class CloudPreprocessor
+    {
+    public:
+        explicit CloudPreprocessor(const PreprocessorConfig &config = PreprocessorConfig());
+
+        void set_config(const PreprocessorConfig &config);
+        const PreprocessorConfig &config() const { return config_; }
+
+        /// Change the leaf size of the downsampling, unlike set_config() the tracked ground plane is kept.
+        void set_leaf_size(float leaf_size);
+
+        /**
+         * Run every stage on a message. Instantiated for PointXYZ, PointXYZI and PointXYZRGB, like the stages.
+         *
+         * @param[in] msg the input cloud
+         * @param[out] cloud the filtered points, its buffer is reused
+         */
+        template <class PointT>
+        PreprocessStatus process(const sensor_msgs::PointCloud2 &msg, pcl::PointCloud<PointT> &cloud);
+
+        /// Read the points of the region of interest, returns false if the message has no FLOAT32 x, y, z fields.
+        template <class PointT>
+        bool extract(const sensor_msgs::PointCloud2 &msg, pcl::PointCloud<PointT> &cloud) const
+        {
+            return roi_.extract(msg, cloud);
+        }
+
+        template <class PointT>
+        void downsample(pcl::PointCloud<PointT> &cloud)
+        {
+            downsampler_.filter(cloud);
+        }
+
+        /// Remove the ground plane if segmentation is enabled, returns false if it is enabled but no plane was found.
+        template <class PointT>
+        bool remove_ground(pcl::PointCloud<PointT> &cloud)
+        {
+            return !config_.segmentation || ground_filter_.remove(cloud);
+        }
+
+        /// RANSAC iterations of the last removal of the ground plane, see GroundPlaneFilter::iterations().
+        int ground_iterations() const { return ground_filter_.iterations(); }
+
+        /// Run exactly this many RANSAC iterations in the next removal of the ground, see GroundPlaneFilter::force_iterations().
+        void force_ground_iterations(int iterations) { ground_filter_.force_iterations(iterations); }
+
+    private:
+        PreprocessorConfig config_;
+        RoiFilter roi_;
+        VoxelDownsampler downsampler_;
+        GroundPlaneFilter ground_filter_;
+    };
+}
+
+#endif // F1TENTH_SENSOR_FUSION__CLOUD_PREPROCESSOR_HPP
@@ -0,0 +1,59 @@
+/* Copyright 2021 Kovács Gergely Attila
+*
+*   Licensed under the Apache License,
+*   Version 2.0(the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License.
+*
+*/
+
+#ifndef F1TENTH_SENSOR_FUSION__CLOUD_TRANSFORM_HPP
+#define F1TENTH_SENSOR_FUSION__CLOUD_TRANSFORM_HPP
+
+#include <geometry_msgs/Transform.h>
+#include <pcl/point_cloud.h>
+#include <pcl/common/transforms.h>
+#include <Eigen/Geometry>
+#include <string>
+
+namespace f1tenth_sensor_fusion
+{
+    /**
+     * Convert a ROS transform to an Eigen affine transformation usable by PCL.
+     *
+     * @param t the transform (as returned by tf2_ros::Buffer::lookupTransform)
+     * @return the same transformation as an Eigen::Affine3f
+     */
+    inline Eigen::Affine3f transform_to_eigen(const geometry_msgs::Transform &t)
+    {
+        Eigen::Affine3f affine = Eigen::Affine3f::Identity();
+        affine.translation() << t.translation.x, t.translation.y, t.translation.z;
+        affine.linear() = Eigen::Quaternionf(t.rotation.w, t.rotation.x, t.rotation.y, t.rotation.z).toRotationMatrix();
+        return affine;
+    }
+
+    /**
+     * Transform every point of a cloud in place, avoiding the copy made by tf2's PointCloud2 transform.
+     *
+     * @param cloud the cloud to be transformed
+     * @param t the transform to apply
+     * @param target_frame frame the cloud will be in after the transformation
+     */
+    template <typename PointT>
+    inline void transform_cloud_in_place(pcl::PointCloud<PointT> &cloud, const geometry_msgs::Transform &t,
+                                         const std::string &target_frame)
+    {
+        pcl::transformPointCloud(cloud, cloud, transform_to_eigen(t));
+        cloud.header.frame_id = target_frame;
+    }
+}
+
+#endif // F1TENTH_SENSOR_FUSION__CLOUD_TRANSFORM_HPP
@@ -19,77 +19,304 @@
 #define F1TENTH_SENSOR_FUSION__CLUSTER_TRACKER_H
 
 #include <f1tenth_sensor_fusion/tracker_config.hpp>
+#include <f1tenth_sensor_fusion/alloc_counter.hpp>
 #include <f1tenth_sensor_fusion/KFTracker.hpp>
+#include <f1tenth_sensor_fusion/clustering.hpp>
+#include <f1tenth_sensor_fusion/frame_log.hpp>
+#include <f1tenth_sensor_fusion/input_queue.hpp>
+#include <f1tenth_sensor_fusion/latency_controller.hpp>
+#include <f1tenth_sensor_fusion/point_types.hpp>
+#include <f1tenth_sensor_fusion/stage_timers.hpp>
+#include <f1tenth_sensor_fusion/ObjectMessage.h>
+#include <f1tenth_sensor_fusion/TrackArray.h>
 #include <ros/ros.h>
-#include <boost/thread/mutex.hpp>
 #include <sensor_msgs/PointCloud2.h>
 #include <visualization_msgs/MarkerArray.h>
 #include <message_filters/subscriber.h>
-#include <pcl/segmentation/extract_clusters.h>
-#include <opencv2/video/tracking.hpp>
+#include <boost/thread/mutex.hpp>
+#include <pcl_ros/point_cloud.h>
+#include <tf2_ros/buffer.h>
+#include <tf2_ros/transform_listener.h>
+#include <Eigen/Geometry>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
 
 namespace f1tenth_sensor_fusion
 {
-    /// The ClusterTracker class to clusterize a point cloud (converted from a lidar scan) and track said clusters.
+    /**
+     * The ClusterTracker class to clusterize a point cloud (converted from a lidar scan) and track said clusters.
+     *
+     * The clustering and tracking only use the coordinates of the points, the other fields of PointT (intensity,
+     * colour) are kept in the published clusters. Instantiated for PointXYZ, PointXYZI and PointXYZRGB.
+     */
+    template <class PointT>
     class ClusterTracker
     {
+    public:
+        virtual ~ClusterTracker() {}
+
     protected:
         virtual void initialize(int concurrency);
         virtual int _load_params();
+
+        /// Subscribe to the input of the tracker, a point cloud on the subscription topic by default.
+        virtual void _subscribe();
+
+        /// Stop the subscription made by _subscribe().
+        virtual void _unsubscribe();
+
+        /// Create the TF buffer and listener shared by every lookup of the tracker, if they do not exist yet.
+        void _init_tf();
+
+        /**
+         * Leave the processing of the frames to a worker pool: the input callbacks only queue the frames and call
+         * notify, and the pool calls process_next_frame() for every notification. Set before initialize().
+         */
+        void _set_notify(const std::function<void()> &notify) { notify_ = notify; }
+
+        /**
+         * Cluster the next frame of the input queue, then track and publish the clustered frames in order.
+         *
+         * @return false if no frame was waiting, or every workspace holds a frame: the threads holding them take the
+         * waiting frames when they are done
+         */
+        bool process_next_frame();
+
+        /// Size of the roscpp queue of the input subscription, matching the queue policy.
+        size_t _subscriber_queue_size() const { return input_queue_.subscriber_queue_size(); }
+
+        /**
+         * Process incoming point cloud data: perform clusterization and calculation of cluster centroids, publish output data using ROS 
+         * publishers after performing the object detection.
+         *
+         * The cloud goes through the input queue first, which drops frames according to the queue policy. Clustering
+         * runs on the calling thread, so several frames may be clustered at once. Tracking and publishing then happen
+         * in arrival order on a single thread at a time, see drain_frames().
+         * 
+         * @param input_cloud the incoming point cloud in the subscription frame, shared with the publisher when running in the same
+         * nodelet manager
+         */
+        void cloudCallback(const typename pcl::PointCloud<PointT>::ConstPtr &input_cloud);
+
         TrackerConfig _config;
         ros::NodeHandle handle_;
         ros::NodeHandle private_handle_;
+        boost::shared_ptr<tf2_ros::Buffer> tf2_;
+        size_t input_queue_size_;
 
     private:
+        /// Everything a frame needs between clustering and publishing. Buffers are reused by later frames.
+        struct FrameWorkspace
+        {
+            std::unique_ptr<ClusteringBackend> clustering;
+            std::vector<pcl::PointIndices> cluster_indices;
+            boost::container::vector<pcl::PointXYZ> cluster_centres;
+            typename pcl::PointCloud<PointT>::ConstPtr cloud;
+            pcl::PointCloud<pcl::PointXYZ>::ConstPtr xyz;   ///< coordinates of the cloud, the cloud itself for PointXYZ
+            pcl::PointCloud<pcl::PointXYZ>::Ptr xyz_buffer; ///< holds the coordinates of the other point types
+            pcl::PointCloud<pcl::PointXYZ>::Ptr subsampled; ///< the points clustered when the cloud exceeds the point budget
+            size_t point_budget = 0;     ///< points the frame was clustered with at most, 0 for no limit
+            double clustering_time = 0.; ///< [s] clustering and centroids of the frame
+            size_t allocations = 0; ///< heap allocations of the clustering, counted with COUNT_ALLOCATIONS
+        };
+
+        /// Slot of the ring ordering the clustered frames, holding the frame with the sequence number ready - 1.
+        struct FrameSlot
+        {
+            std::atomic<uint64_t> ready{0};
+            size_t workspace = 0;
+        };
+
+        /// Cluster frames from the input queue as long as there are frames waiting and free workspaces.
+        void process_input();
+
+        std::function<void()> notify_; ///< set if the frames are processed by a pool, see _set_notify()
+
+        /// Take a free workspace, returns false if every workspace holds a frame.
+        bool try_acquire_workspace(size_t &workspace);
+
+        /**
+         * Track and publish the clustered frames in order, until the next frame is not clustered yet. Only one thread
+         * drains at a time, the others return immediately and leave their frame to it.
+         */
+        void drain_frames();
+
+        /// The ordered stage of cloudCallback: track the clusters of a frame and publish the results.
+        void track_and_publish(FrameWorkspace &frame);
+
+        /**
+         * Publish every tracked cluster in one cloud, the label of a point is the ID of its object.
+         *
+         * @param input_cloud coordinates of the cloud the clusters were extracted from
+         * @param clusters indices of the points of each cluster in the input cloud
+         * @param transform transformation to the target frame, nullptr if the clusters are published in the subscription frame
+         */
+        void publish_labeled_clusters(const pcl::PointCloud<pcl::PointXYZ> &input_cloud, const std::vector<pcl::PointIndices> &clusters,
+                                      const Eigen::Affine3f *transform);
+
         /**
-         * Publish a PointCloud to a ROS topic.
+         * Publish a cluster of the input cloud to a ROS topic.
          * 
          * @param pub the ROS publisher to said topic
-         * @param cluster the cluster of points to be published
+         * @param input_cloud the cloud the cluster was extracted from
+         * @param indices indices of the cluster's points in the input cloud
+         * @param transform transformation to the target frame, nullptr if the cluster is published in the subscription frame
          */
-        void publish_cloud(ros::Publisher &pub, pcl::PointCloud<pcl::PointXYZ>::Ptr &cluster);
+        void publish_cloud(ros::Publisher &pub, const pcl::PointCloud<PointT> &input_cloud, const pcl::PointIndices &indices,
+                           const Eigen::Affine3f *transform);
 
-        void publish_objects(const boost::container::vector<pcl::PointXYZ> &cCentres, const boost::container::vector<int> &objIDs);
+        /**
+         * Publish the tracked objects under the IDs of their tracks, -1 for the objects without a cluster in this frame.
+         * The message is published as a shared pointer, so subscribers in the same manager (e.g. the fusion nodelet)
+         * receive it without a copy.
+         *
+         * @param cCentres centres of the clusters
+         * @param objIDs index of the cluster matched to every tracked object, -1 if there is none
+         * @param frame frame of the centres
+         * @param stamp acquisition time of the input cloud, used by subscribers to align the detections of several sensors
+         */
+        void publish_objects(const boost::container::vector<pcl::PointXYZ> &cCentres, const boost::container::vector<int> &objIDs,
+                             const std::string &frame, const ros::Time &stamp);
+
+        /**
+         * Publish the estimates of the tracked objects: their filter state, its variance, age and missed frames. With
+         * track_deltas, only the tracks that moved, changed speed or were missed since they were last sent are listed
+         * along with the IDs dropped since the last message, and every track_keyframe_interval frames all of them.
+         *
+         * @param cCentres centres of the clusters in the subscription frame, giving the height of the matched tracks
+         * @param objIDs index of the cluster matched to every tracked object, -1 if there is none
+         * @param transform transformation to the target frame, nullptr if the tracks are published in the subscription frame
+         * @param frame frame of the tracks
+         * @param stamp acquisition time of the input cloud
+         */
+        void publish_tracks(const boost::container::vector<pcl::PointXYZ> &cCentres, const boost::container::vector<int> &objIDs,
+                            const Eigen::Affine3f *transform, const std::string &frame, const ros::Time &stamp);
 
         /**
          * Create ROS Markers to later publish for enabling the visualization of detected objects.
          * 
          * @param[in] pts predicted cluster centroid points (using KFilter)
-         * @param[in] IDs object IDs detected by filters
+         * @param[in] IDs index of the cluster matched to every tracked object, -1 if there is none. The markers take
+         * the IDs of the objects
+         * @param[in] frame the frame the points are expressed in
          * @param[out] markers markers adjusted to fit points
          */
-        void fit_markers(const boost::container::vector<pcl::PointXYZ> &pts,
-                         const boost::container::vector<int> &IDs, visualization_msgs::MarkerArray &markers);
+        void fit_markers(const boost::container::vector<pcl::PointXYZ> &pts, const boost::container::vector<int> &IDs,
+                         const std::string &frame, visualization_msgs::MarkerArray &markers);
+
+        /**
+         * Look up the transformation from the subscription frame to the target frame in the cached TF buffer.
+         *
+         * @param[out] transform the transformation, valid only if true is returned
+         * @return false if the transform is not available
+         */
+        bool lookup_target_transform(Eigen::Affine3f &transform);
 
-        void transform_centre(pcl::PointXYZ &centre);
+        void transform_centres(boost::container::vector<pcl::PointXYZ> &centres, const Eigen::Affine3f &transform);
 
-        void sync_cluster_publishers_size(size_t num_clusters);
+        /// Advertise the topics of the individual clusters, only done at start so that frames never wait for the master.
+        void advertise_cluster_publishers(const ros::SubscriberStatusCallback &connect_cb, const ros::SubscriberStatusCallback &disconnect_cb);
 
         /**
-         * Process incoming point cloud data: perform clusterization and calculation of cluster centroids, publish output data using ROS 
-         * publishers after performing the object detection.
-         * 
-         * @param cloud_msg the incoming point cloud message
+         * Subscribe to the input when the first output gets a subscriber. The tracks are dropped then, as frames were
+         * missed since the last subscription.
          */
-        void cloudCallback(const sensor_msgs::PointCloud2ConstPtr &cloud_msg);
+        void connectCb();
 
-        void extract_cluster_data(const pcl::PointCloud<pcl::PointXYZ>::Ptr input_cloud,
-                                  boost::container::vector<pcl::PointCloud<pcl::PointXYZ>::Ptr> &cluster_vec,
-                                  boost::container::vector<pcl::PointXYZ> &cluster_centres);
+        /// Unsubscribe from the input when the last subscriber of the outputs left.
+        void disconnectCb();
 
-        pcl::EuclideanClusterExtraction<pcl::PointXYZ> cluster_extr_;
-        boost::mutex mutex_;
+        bool has_subscribers() const;
+
+        /**
+         * Clusterize the cloud of a frame and calculate the centroid of each cluster.
+         *
+         * @param frame the frame holding the cloud, receives the indices and centroids of the clusters
+         */
+        void extract_cluster_data(FrameWorkspace &frame);
+
+        /// The parameters the frames are processed with, as written to the frame log.
+        std::string log_config() const;
+
+        /**
+         * Feed the processing time of a frame to the latency controller and apply the point budget it sets to the
+         * frames clustered next.
+         *
+         * @param frame the tracked frame
+         * @param start time the ordered stage of the frame started at
+         * @param stamp stamp of the frame
+         */
+        void adapt_point_budget(const FrameWorkspace &frame, const std::chrono::steady_clock::time_point &start, const ros::Time &stamp);
+
+        /// Stages timed on ~stats, "frame" is the whole ordered stage and "latency" runs from the stamp to the objects
+        enum Stage
+        {
+            STAGE_CLUSTERING,
+            STAGE_CENTROIDS,
+            STAGE_TRACKING,
+            STAGE_TF,
+            STAGE_MARKERS,
+            STAGE_PUBLISH,
+            STAGE_FRAME,
+            STAGE_LATENCY
+        };
+
+        InputQueue<pcl::PointCloud<PointT>> input_queue_;
+        StageTimers timers_{{"clustering", "centroids", "tracking", "tf", "markers", "publish", "frame", "latency"}};
+        std::vector<FrameWorkspace> workspaces_;
+        std::unique_ptr<std::atomic<bool>[]> workspace_busy_;
+        std::unique_ptr<FrameSlot[]> ring_;
+        size_t ring_mask_ = 0;
+        std::atomic<uint64_t> next_frame_{0}; ///< sequence number of the next frame to track, as assigned by input_queue_
+        std::atomic<bool> draining_{false};
+        std::atomic<bool> reset_pending_{false}; ///< drop the tracks before the next frame, set on resubscription
+        boost::mutex connect_mutex_;
+        bool subscribed_ = false;
+
+        // Buffers of the ordered stage, reused by every frame so that tracking does not allocate in the steady state
+        boost::container::vector<int> obj_ids_;
+        boost::container::vector<pcl::PointXYZ> target_centres_;
+
+        // Positions of the tracked objects seeding the clustering of the next frames, with the seeded clustering only
+        bool seeded_clustering_ = false;
+        boost::mutex seeds_mutex_;
+        PointVector seeds_;
+        visualization_msgs::MarkerArray markers_;
+        ObjectMessage::Ptr objects_msg_;
+
+        // Tracks last sent by publish_tracks(), ordered by ID, to find the changed ones
+        struct SentTrack
+        {
+            uint32_t id;
+            PlanarVector position, velocity;
+            bool missed;
+        };
+        boost::container::vector<TrackState> tracks_; ///< the tracked objects of the current frame, in the order of obj_ids_
+        boost::container::vector<SentTrack> sent_, sent_next_;
+        int frames_since_keyframe_ = 0;
+        bool keyframe_pending_ = true; ///< the next message lists every track, set on reset and while unsubscribed
+        TrackArray::Ptr tracks_msg_;
+        FrameLogWriter log_; ///< written by the ordered stage only
+        size_t logged_budget_ = 0; ///< point budget of the last frame in the log
+
+        // The point budget of the clustering, set by the ordered stage and read by the frames starting their clustering
+        LatencyController controller_;
+        std::atomic<size_t> point_budget_{0};
 
         KFTracker _KFTracker;
-        boost::container::vector<ros::Publisher *> cluster_pubs_;
+        std::vector<ros::Publisher> cluster_pubs_;
+        ros::Publisher clusters_pub_;
+        pcl::PointCloud<pcl::PointXYZL>::Ptr clusters_msg_;
         ros::Publisher obj_pub_;
+        ros::Publisher tracks_pub_;
         ros::Publisher marker_pub_;
-        message_filters::Subscriber<sensor_msgs::PointCloud2> sub_;
+        ros::Subscriber sub_;
+        boost::shared_ptr<tf2_ros::TransformListener> tf2_listener_;
 
-        size_t input_queue_size_;
-        size_t publisher_prune_ctr_ = 0;
+        int centroid_threads_ = 1;
         bool transform_;
-        bool first_frame_ = true;
     };
 }
 
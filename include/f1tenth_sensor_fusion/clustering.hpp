@@ -0,0 +1,195 @@
+/* Copyright 2021 Kovács Gergely Attila
+*
+*   Licensed under the Apache License,
+*   Version 2.0(the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License.
+*
+*/
+
+#ifndef F1TENTH_SENSOR_FUSION__CLUSTERING_HPP
+#define F1TENTH_SENSOR_FUSION__CLUSTERING_HPP
+
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+#include <pcl/PointIndices.h>
+#include <pcl/search/kdtree.h>
+#include <pcl/segmentation/extract_clusters.h>
+#include <boost/container/vector.hpp>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace f1tenth_sensor_fusion
+{
+    enum class ClusteringMethod
+    {
+        EUCLIDEAN, ///< KD-tree based Euclidean cluster extraction of PCL, works on any cloud
+        SCANLINE,  ///< range-jump segmentation of consecutive beams, needs the points in scan order
+        SEEDED     ///< Euclidean clusters grown around the tracked objects, the rest of the cloud is clusterized less often
+    };
+
+    /**
+     * Parse the name of a clustering method as given in the parameter files.
+     *
+     * @param[in] name one of "euclidean", "scanline" or "seeded"
+     * @param[out] method the parsed method, left untouched on failure
+     * @return false if the name is not recognized
+     */
+    bool parse_clustering_method(const std::string &name, ClusteringMethod &method);
+
+    /// Interface of the clustering backends of ClusterTracker.
+    class ClusteringBackend
+    {
+    public:
+        virtual ~ClusteringBackend() {}
+
+        /**
+         * Find the clusters of a cloud. Clusters smaller than the minimal or larger than the maximal size are dropped,
+         * the rest is ordered by decreasing size.
+         *
+         * @param[in] cloud the cloud to clusterize
+         * @param[out] clusters indices of the points of each cluster, previous contents are overwritten
+         */
+        virtual void extract(const pcl::PointCloud<pcl::PointXYZ>::ConstPtr &cloud, std::vector<pcl::PointIndices> &clusters) = 0;
+
+        /**
+         * Set the positions of the tracked objects, used by the next extractions. Only the backends growing clusters
+         * around them use them, the others ignore them.
+         *
+         * @param[in] seeds positions of the tracked objects in the frame of the clouds
+         */
+        virtual void set_seeds(const boost::container::vector<pcl::PointXYZ> &seeds) {}
+
+        /// Change the size boundaries of the clusters kept by the next extractions.
+        virtual void set_size_limits(int min_size, int max_size) = 0;
+    };
+
+    class EuclideanClustering : public ClusteringBackend
+    {
+    public:
+        EuclideanClustering(double tolerance, int min_size, int max_size);
+        void extract(const pcl::PointCloud<pcl::PointXYZ>::ConstPtr &cloud, std::vector<pcl::PointIndices> &clusters) override;
+        void set_size_limits(int min_size, int max_size) override;
+
+    private:
+        pcl::EuclideanClusterExtraction<pcl::PointXYZ> cluster_extr_;
+        pcl::search::KdTree<pcl::PointXYZ>::Ptr search_tree_;
+    };
+
+    /**
+     * Clustering of 2D scans in O(N): the points of a scan are ordered by angle, so a cluster ends where the distance
+     * between neighbouring beams exceeds the tolerance. Invalid (non-finite) points are skipped. Segments at the two
+     * ends of the scan are joined if they meet, as in 360 degree scans. Segments are collected in buffers kept between
+     * scans and only the accepted clusters are copied to the output, whose elements keep their buffers as well, so the
+     * steady state does not allocate.
+     */
+    class ScanlineClustering : public ClusteringBackend
+    {
+    public:
+        ScanlineClustering(double tolerance, int min_size, int max_size);
+        void extract(const pcl::PointCloud<pcl::PointXYZ>::ConstPtr &cloud, std::vector<pcl::PointIndices> &clusters) override;
+        void set_size_limits(int min_size, int max_size) override;
+
+    private:
+        float sq_tolerance_;
+        size_t min_size_, max_size_;
+        std::vector<int> points_;                     ///< indices of the valid points in scan order
+        std::vector<size_t> starts_;                  ///< start of every segment in points_, and the end of the last
+        std::vector<std::pair<size_t, size_t>> kept_; ///< (size, segment) of the accepted segments
+        std::vector<std::vector<int>> spare_;         ///< buffers of output elements not needed by the last scan
+    };
+
+    /**
+     * Euclidean clustering warm-started by the tracked objects. The points are hashed into a planar grid of cells as
+     * large as the tolerance, then a cluster is grown by flood fill from the point nearest to every seed within the
+     * gate. Such a cluster is the same one EuclideanClustering finds around that point. The points not reached from a
+     * seed are only clusterized every full_interval frames, and when there are no seeds, so new objects are picked up
+     * with a delay of up to full_interval frames. Every buffer is kept between frames.
+     */
+    class SeededClustering : public ClusteringBackend
+    {
+    public:
+        SeededClustering(double tolerance, int min_size, int max_size, double seed_gate, int full_interval);
+        void extract(const pcl::PointCloud<pcl::PointXYZ>::ConstPtr &cloud, std::vector<pcl::PointIndices> &clusters) override;
+        void set_seeds(const boost::container::vector<pcl::PointXYZ> &seeds) override;
+        void set_size_limits(int min_size, int max_size) override;
+
+    private:
+        void build_grid(const pcl::PointCloud<pcl::PointXYZ> &cloud);
+        int find_cell(int cx, int cy) const; ///< entry of a cell in the hash table, -1 if it has no points
+        int nearest_unvisited(const pcl::PointCloud<pcl::PointXYZ> &cloud, const pcl::PointXYZ &seed) const;
+        void grow(const pcl::PointCloud<pcl::PointXYZ> &cloud, int start);
+        void unlink(const pcl::PointCloud<pcl::PointXYZ> &cloud, int i);
+
+        inline int cell_coord(float v) const { return static_cast<int>(std::floor(v * inv_tolerance_)); }
+        inline static uint64_t cell_key(int cx, int cy)
+        {
+            return (static_cast<uint64_t>(static_cast<uint32_t>(cx)) << 32) | static_cast<uint32_t>(cy);
+        }
+
+        float inv_tolerance_, sq_tolerance_, gate_;
+        size_t min_size_, max_size_;
+        int full_interval_, frames_since_full_ = 0;
+        boost::container::vector<pcl::PointXYZ> seeds_;
+        // Open addressing hash table of the cells, each holding a list of the points not yet in a cluster
+        std::vector<uint64_t> cell_keys_;
+        std::vector<char> cell_used_;
+        std::vector<int> cell_heads_; ///< first point of every cell, -1 if it is empty
+        std::vector<int> next_;       ///< next point in the cell of every point, -1 at the end
+        std::vector<char> visited_;
+        std::vector<int> points_;                     ///< points of the grown clusters, one after the other
+        std::vector<size_t> starts_;                  ///< start of every cluster in points_
+        std::vector<std::pair<size_t, size_t>> kept_; ///< (size, cluster) of the accepted clusters
+        std::vector<std::vector<int>> spare_;         ///< buffers of output elements not needed by the last frame
+    };
+
+    /**
+     * Create a clustering backend.
+     *
+     * @param seed_gate [m] distance of the seeds from the point a cluster is grown from, SEEDED only
+     * @param full_interval frames between two clusterings of the whole cloud, SEEDED only
+     */
+    std::unique_ptr<ClusteringBackend> make_clustering_backend(ClusteringMethod method, double tolerance, int min_size, int max_size,
+                                                               double seed_gate = 0.5, int full_interval = 10);
+
+    /**
+     * Clusterize at most max_points points of a cloud, to bound the clustering time of dense clouds. Larger clouds
+     * are subsampled with a uniform stride, the size boundaries of the clusters are divided by the stride, and the
+     * indices of the clusters are those of the subsampled points in the whole cloud.
+     *
+     * @param[in] backend the backend extracting the clusters, its size boundaries are set on every call
+     * @param[in] cloud the cloud to clusterize
+     * @param[in] max_points the point budget, 0 for no limit
+     * @param[in] min_size,max_size size boundaries of the clusters in the whole cloud
+     * @param[in,out] buffer the subsampled cloud, allocated on first use and reused
+     * @param[out] clusters indices of the points of each cluster in the cloud
+     * @return the stride of the subsampling, 1 if the whole cloud was clusterized
+     */
+    size_t extract_within_budget(ClusteringBackend &backend, const pcl::PointCloud<pcl::PointXYZ>::ConstPtr &cloud, size_t max_points,
+                                 int min_size, int max_size, pcl::PointCloud<pcl::PointXYZ>::Ptr &buffer,
+                                 std::vector<pcl::PointIndices> &clusters);
+
+    /**
+     * Calculate the centroid of every cluster of a cloud.
+     *
+     * @param[in] cloud the clusterized cloud
+     * @param[in] clusters indices of the points of each cluster
+     * @param[out] centres the centroid of each cluster, in the order of the clusters
+     * @param[in] num_threads number of OpenMP threads splitting the clusters between them
+     */
+    void compute_centroids(const pcl::PointCloud<pcl::PointXYZ> &cloud, const std::vector<pcl::PointIndices> &clusters,
+                           boost::container::vector<pcl::PointXYZ> &centres, int num_threads = 1);
+}
+
+#endif // F1TENTH_SENSOR_FUSION__CLUSTERING_HPP
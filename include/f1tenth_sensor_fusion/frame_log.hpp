@@ -0,0 +1,180 @@
+/* Copyright 2021 Kovács Gergely Attila
+*
+*   Licensed under the Apache License,
+*   Version 2.0(the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License.
+*
+*/
+
+#ifndef F1TENTH_SENSOR_FUSION__FRAME_LOG_HPP
+#define F1TENTH_SENSOR_FUSION__FRAME_LOG_HPP
+
+#include <sensor_msgs/PointCloud2.h>
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+#include <boost/container/vector.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+
+namespace f1tenth_sensor_fusion
+{
+    /// Kinds of the records of a frame log.
+    enum class LogRecord : uint32_t
+    {
+        FILTER_CONFIG = 1,  ///< parameters of the filter as "name value" lines
+        FILTER_INPUT = 2,   ///< a PointCloud2 message as received by the filter
+        FILTER_OUTPUT = 3,  ///< coordinates of the filtered cloud, the status is a PreprocessStatus
+        TRACKER_CONFIG = 4, ///< parameters of the tracker as "name value" lines
+        TRACKER_INPUT = 5,  ///< coordinates of the cloud clusterized by the tracker
+        TRACKER_OUTPUT = 6, ///< the tracked objects as published, the status is a FrameStatus
+        TRACKER_RESET = 7,  ///< the tracker dropped its objects, on resubscription
+        FILTER_TUNING = 8,  ///< parameters of the filter changed by its latency controller, as "name value" lines
+        TRACKER_TUNING = 9, ///< parameters of the tracker changed by its latency controller, as "name value" lines
+        FILTER_GROUND = 10  ///< RANSAC iterations run on a frame as the count, before its FILTER_OUTPUT with segmentation
+    };
+
+    /// Header of every record, followed by size bytes of payload and padded to 8 bytes.
+    struct LogRecordHeader
+    {
+        uint32_t type;   ///< a LogRecord
+        uint32_t status; ///< outcome of the stage the record is the output of, 0 otherwise
+        uint64_t stamp;  ///< [us] stamp of the frame, as in pcl::PCLHeader
+        uint32_t seq;    ///< sequence number of the frame
+        uint32_t count;  ///< number of points or objects in the payload
+        uint32_t size;   ///< bytes of payload
+        uint32_t reserved;
+    };
+
+    /// An object of a TRACKER_OUTPUT record, the fields of ObjectData.
+    struct LogObject
+    {
+        int32_t id; ///< index of the cluster matched to the object, -1 if none
+        float x, y, z;
+    };
+
+    /**
+     * Append-only binary log of the inputs and outputs of the processing cores, written through a memory mapping of
+     * the file. Appending a record is a copy into the mapping, the file is grown by doubling its mapping when it is
+     * full and truncated to its contents when closed. Records are not synchronized, the nodelets write from their
+     * ordered stage only. See FrameLogReader and frame_replay.
+     */
+    class FrameLogWriter
+    {
+    public:
+        FrameLogWriter() {}
+        FrameLogWriter(const FrameLogWriter &) = delete;
+        FrameLogWriter &operator=(const FrameLogWriter &) = delete;
+        ~FrameLogWriter() { close(); }
+
+        /// Create (or overwrite) the log file, returns false if it could not be created and mapped.
+        bool open(const std::string &path);
+        void close();
+        bool is_open() const { return data_ != nullptr; }
+
+        /// @param config "name value" lines of the parameters the recorded frames were processed with
+        void write_config(LogRecord type, const std::string &config);
+
+        void write_message(const sensor_msgs::PointCloud2 &msg, uint64_t stamp);
+
+        /// Write the coordinates of a cloud, whatever the point type.
+        template <class PointT>
+        void write_points(LogRecord type, const pcl::PointCloud<PointT> &cloud, uint32_t status = 0)
+        {
+            const size_t size = 3 * sizeof(float) * cloud.size();
+            float *out = reinterpret_cast<float *>(begin(type, status, cloud.header.stamp, cloud.header.seq, cloud.size(), size));
+            if (!out)
+                return;
+            for (const PointT &p : cloud)
+            {
+                *out++ = p.x;
+                *out++ = p.y;
+                *out++ = p.z;
+            }
+        }
+
+        /**
+         * Write the tracked objects of a frame, as in ObjectMessage.
+         *
+         * @param centres centres of the clusters of the frame
+         * @param ids index of the cluster matched to every tracked object, -1 if there is none
+         */
+        void write_objects(const boost::container::vector<pcl::PointXYZ> &centres, const boost::container::vector<int> &ids, uint64_t stamp,
+                           uint32_t seq, uint32_t status);
+
+        void write_reset(uint64_t stamp, uint32_t seq) { begin(LogRecord::TRACKER_RESET, 0, stamp, seq, 0, 0); }
+
+        /// Write the number of RANSAC iterations the removal of the ground plane took on a frame.
+        void write_ground(uint64_t stamp, uint32_t seq, int iterations)
+        {
+            begin(LogRecord::FILTER_GROUND, 0, stamp, seq, static_cast<size_t>(iterations), 0);
+        }
+
+    private:
+        /// Append the header of a record, returns where its payload goes or nullptr if the log could not grow.
+        uint8_t *begin(LogRecord type, uint32_t status, uint64_t stamp, uint32_t seq, size_t count, size_t size);
+        bool grow(size_t capacity);
+
+        int fd_ = -1;
+        uint8_t *data_ = nullptr;
+        size_t capacity_ = 0; ///< bytes mapped
+        size_t size_ = 0;     ///< bytes written
+    };
+
+    /// A record of a log, its payload points into the mapping of the reader.
+    struct LogEntry
+    {
+        LogRecordHeader header;
+        const uint8_t *payload = nullptr;
+
+        LogRecord type() const { return static_cast<LogRecord>(header.type); }
+        const float *points() const { return reinterpret_cast<const float *>(payload); } ///< x, y, z of header.count points
+        const LogObject *objects() const { return reinterpret_cast<const LogObject *>(payload); }
+    };
+
+    /// Sequential reader of the logs of FrameLogWriter, mapping the whole file.
+    class FrameLogReader
+    {
+    public:
+        FrameLogReader() {}
+        FrameLogReader(const FrameLogReader &) = delete;
+        FrameLogReader &operator=(const FrameLogReader &) = delete;
+        ~FrameLogReader() { close(); }
+
+        /// Map a log, returns false if it can not be read or is not a frame log.
+        bool open(const std::string &path);
+        void close();
+
+        /// Read the next record, returns false at the end of the log or at a truncated record.
+        bool next(LogEntry &entry);
+
+        /// Start reading from the first record again.
+        void rewind();
+
+    private:
+        int fd_ = -1;
+        const uint8_t *data_ = nullptr;
+        size_t size_ = 0, offset_ = 0;
+    };
+
+    /// Parse the "name value" lines of a config record.
+    std::map<std::string, std::string> parse_log_config(const LogEntry &entry);
+
+    /// Rebuild the message of a FILTER_INPUT record, its data is copied into the buffer of the message.
+    bool read_message(const LogEntry &entry, sensor_msgs::PointCloud2 &msg);
+
+    /// Copy the points of a FILTER_OUTPUT or TRACKER_INPUT record into a cloud, with the stamp and sequence number.
+    void read_points(const LogEntry &entry, pcl::PointCloud<pcl::PointXYZ> &cloud);
+}
+
+#endif // F1TENTH_SENSOR_FUSION__FRAME_LOG_HPP
@@ -0,0 +1,119 @@
+/* Copyright 2021 Kovács Gergely Attila
+*
+*   Licensed under the Apache License,
+*   Version 2.0(the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License. 
+*   
+*/
+
+#ifndef F1TENTH_SENSOR_FUSION__FUSION_NODELET_H
+#define F1TENTH_SENSOR_FUSION__FUSION_NODELET_H
+
+#include <f1tenth_sensor_fusion/assignment.hpp>
+#include <f1tenth_sensor_fusion/ObjectMessage.h>
+#include <f1tenth_sensor_fusion/stage_timers.hpp>
+#include <ros/ros.h>
+#include <nodelet/nodelet.h>
+#include <boost/thread/mutex.hpp>
+#include <message_filters/subscriber.h>
+#include <message_filters/synchronizer.h>
+#include <message_filters/sync_policies/approximate_time.h>
+#include <tf2_ros/buffer.h>
+#include <tf2_ros/transform_listener.h>
+#include <memory>
+#include <string>
+
+namespace f1tenth_sensor_fusion
+{
+    typedef message_filters::sync_policies::ApproximateTime<ObjectMessage, ObjectMessage> DetectionSyncPolicy;
+
+    /**
+     * Nodelet fusing the detections of the LiDAR and the camera tracker. The two streams are aligned by the
+     * acquisition time of their clouds, and the objects of the two sensors are matched by the assignment engine of
+     * KFTracker. Matched pairs are merged into one object, unmatched objects of either sensor are passed through.
+     * While one of the streams is stale, the detections of the other one are published alone, so the output does not
+     * stop with a sensor.
+     */
+    class FusionNodelet : public nodelet::Nodelet
+    {
+    public:
+        FusionNodelet();
+
+    private:
+        /// Stages timed on ~stats, "latency" runs from the stamp of the LiDAR cloud to publishing
+        enum Stage
+        {
+            STAGE_TF,
+            STAGE_MATCHING,
+            STAGE_MERGE,
+            STAGE_PUBLISH,
+            STAGE_LATENCY
+        };
+
+        virtual void onInit();
+
+        void detectionsCallback(const ObjectMessage::ConstPtr &lidar, const ObjectMessage::ConstPtr &camera);
+        void lidarCallback(const ObjectMessage::ConstPtr &lidar);
+        void cameraCallback(const ObjectMessage::ConstPtr &camera);
+
+        /// Whether nothing was received on a stream for stale_timeout, the streams are never stale if it is 0.
+        bool stale(const ros::Time &last_received, const ros::Time &now) const;
+
+        /**
+         * Merge the detections of the two sensors and publish them.
+         *
+         * @param lidar detections of the LiDAR, nullptr if it is stale
+         * @param camera detections of the camera, nullptr if it is stale
+         */
+        void fuse(const ObjectMessage *lidar, const ObjectMessage *camera);
+
+        /**
+         * Collect the centres of the objects currently seen by a sensor.
+         *
+         * @param[in] msg detections of the sensor
+         * @param[out] centres centres of the objects with a matched cluster
+         * @param[out] ids IDs of the objects, the track IDs given by the tracker of the sensor
+         */
+        void collect_objects(const ObjectMessage &msg, PointVector &centres, boost::container::vector<int> &ids) const;
+
+        /// Transform the camera centres into the frame of the LiDAR detections, returns false if it is unavailable.
+        bool transform_camera_centres(const std::string &camera_frame, const std::string &lidar_frame);
+
+        ros::NodeHandle nh_;
+        ros::NodeHandle private_nh_;
+        boost::mutex mutex_;
+
+        message_filters::Subscriber<ObjectMessage> lidar_sub_;
+        message_filters::Subscriber<ObjectMessage> camera_sub_;
+        std::unique_ptr<message_filters::Synchronizer<DetectionSyncPolicy>> sync_;
+        ros::Publisher pub_;
+
+        boost::shared_ptr<tf2_ros::Buffer> tf2_;
+        boost::shared_ptr<tf2_ros::TransformListener> tf2_listener_;
+
+        StageTimers timers_{{"tf", "matching", "merge", "publish", "latency"}};
+        std::unique_ptr<AssignmentSolver> solver_;
+        PointVector lidar_centres_, camera_centres_;
+        boost::container::vector<int> lidar_ids_, camera_ids_, assignment_;
+        boost::container::vector<bool> camera_used_;
+        ros::Time lidar_received_, camera_received_; ///< arrival of the last detections of each stream
+        std::string lidar_frame_;                    ///< frame of the last LiDAR detections, that of the output
+
+        // ROS Parameters
+        float max_match_distance_;
+        float lidar_weight_;
+        int camera_id_offset_;
+        double stale_timeout_;
+    };
+}
+
+#endif // F1TENTH_SENSOR_FUSION__FUSION_NODELET_H
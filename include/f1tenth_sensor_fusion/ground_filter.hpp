@@ -0,0 +1,97 @@
+/* Copyright 2021 Kovács Gergely Attila
+*
+*   Licensed under the Apache License,
+*   Version 2.0(the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License.
+*
+*/
+
+#ifndef F1TENTH_SENSOR_FUSION__GROUND_FILTER_HPP
+#define F1TENTH_SENSOR_FUSION__GROUND_FILTER_HPP
+
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+#include <Eigen/Core>
+#include <random>
+#include <vector>
+
+namespace f1tenth_sensor_fusion
+{
+    struct GroundFilterConfig
+    {
+        float distance = 0.02f;     ///< [m] maximal distance of ground points from the plane
+        float min_inliers = 0.1f;   ///< ratio of the cloud a plane needs to support to be accepted
+        int max_iterations = 100;   ///< RANSAC hypotheses per frame
+        double time_budget = 0.005; ///< [s] time limit of RANSAC per frame
+        int sample_size = 1000;     ///< number of points each RANSAC hypothesis is scored on
+    };
+
+    /**
+     * Removal of the dominant plane of a cloud with a bounded cost per frame.
+     *
+     * The plane is tracked between frames: the plane of the previous frame selects the inliers, and a least squares
+     * fit on them gives the new plane, at the cost of two passes over the cloud. RANSAC is only run when there is no
+     * plane to track or the tracked one lost its support. It scores every hypothesis on a fixed size random subsample and
+     * stops at an iteration and a time limit. Inliers are removed by compacting the cloud in place.
+     */
+    class GroundPlaneFilter
+    {
+    public:
+        explicit GroundPlaneFilter(const GroundFilterConfig &config = GroundFilterConfig());
+
+        void set_config(const GroundFilterConfig &config) { config_ = config; }
+
+        /**
+         * Remove the points of the ground plane from a cloud. Instantiated for PointXYZ, PointXYZI and PointXYZRGB.
+         *
+         * @param cloud the cloud to filter in place, expected to be dense
+         * @return false if no plane with enough support was found, the cloud is left untouched then
+         */
+        template <class PointT>
+        bool remove(pcl::PointCloud<PointT> &cloud);
+
+        /// Forget the tracked plane, the next frame starts with RANSAC.
+        void reset() { tracked_ = false; }
+
+        bool tracked() const { return tracked_; }
+
+        /// RANSAC iterations run by the last call to remove(), 0 if the tracked plane was kept.
+        int iterations() const { return iterations_; }
+
+        /**
+         * Run exactly the given number of RANSAC iterations in the next call to remove() if it runs RANSAC, whatever
+         * the time budget. Used to replay a recorded frame the way it ran.
+         */
+        void force_iterations(int iterations) { forced_iterations_ = iterations; }
+
+        /// Coefficients (a, b, c, d) of the tracked plane ax + by + cz + d = 0, with a unit normal.
+        Eigen::Vector4f coefficients() const { return plane_; }
+
+    private:
+        /// Least squares refit of a plane on its inliers, returns false if the inliers are too few.
+        template <class PointT>
+        bool refit(const pcl::PointCloud<PointT> &cloud, Eigen::Vector4f &plane) const;
+
+        template <class PointT>
+        bool ransac(const pcl::PointCloud<PointT> &cloud, Eigen::Vector4f &plane);
+
+        GroundFilterConfig config_;
+        Eigen::Matrix<float, 4, 1, Eigen::DontAlign> plane_;
+        bool tracked_ = false;
+        int iterations_ = 0;
+        int forced_iterations_ = -1; ///< iterations of the next RANSAC, -1 to stop at the limits of the config
+        std::minstd_rand rng_;
+        std::vector<size_t> sample_;
+    };
+}
+
+#endif // F1TENTH_SENSOR_FUSION__GROUND_FILTER_HPP
@@ -0,0 +1,212 @@
+/* Copyright 2021 Kovács Gergely Attila
+*
+*   Licensed under the Apache License,
+*   Version 2.0(the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License.
+*
+*/
+
+#ifndef F1TENTH_SENSOR_FUSION__INPUT_QUEUE_HPP
+#define F1TENTH_SENSOR_FUSION__INPUT_QUEUE_HPP
+
+#include <f1tenth_sensor_fusion/QueueStats.h>
+#include <ros/ros.h>
+#include <ros/message_traits.h>
+#include <boost/circular_buffer.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <string>
+
+namespace f1tenth_sensor_fusion
+{
+    enum class QueuePolicy
+    {
+        LATEST,  ///< single slot, a new frame overwrites the waiting one
+        FIFO,    ///< bounded FIFO, the oldest frame is dropped when it is full
+        DEADLINE ///< bounded FIFO, frames older than the deadline are dropped when taken
+    };
+
+    /**
+     * Parse the name of a queue policy as given in the parameter files.
+     *
+     * @param[in] name one of "latest", "fifo" or "deadline"
+     * @param[out] policy the parsed policy, left untouched on failure
+     * @return false if the name is not recognized
+     */
+    inline bool parse_queue_policy(const std::string &name, QueuePolicy &policy)
+    {
+        if (name == "latest")
+            policy = QueuePolicy::LATEST;
+        else if (name == "fifo")
+            policy = QueuePolicy::FIFO;
+        else if (name == "deadline")
+            policy = QueuePolicy::DEADLINE;
+        else
+            return false;
+        return true;
+    }
+
+    /**
+     * Queue between the subscription of a nodelet and its processing, dropping frames according to a policy and
+     * counting what it drops.
+     *
+     * The queue only sees a backlog if the callbacks of the subscription can run while a frame is processed, i.e.
+     * with a concurrency level above one. Otherwise the frames wait in the queue of roscpp, which the nodelets size
+     * to the capacity of this queue (one slot for the latest frame policy), so the policy still holds, but frames
+     * dropped by roscpp are not counted.
+     *
+     * @tparam M message type, anything with a header stamp known to ros::message_traits
+     */
+    template <class M>
+    class InputQueue
+    {
+    public:
+        typedef boost::shared_ptr<const M> ConstPtr;
+
+        /**
+         * @param policy drop policy
+         * @param capacity maximal number of waiting frames, ignored by the latest frame policy
+         * @param deadline [s] maximal age of a frame when taken, used by the deadline policy
+         */
+        void configure(QueuePolicy policy, size_t capacity, double deadline)
+        {
+            boost::mutex::scoped_lock lock(mutex_);
+            policy_ = policy;
+            capacity_ = policy == QueuePolicy::LATEST ? 1 : std::max<size_t>(capacity, 1);
+            deadline_ = ros::Duration(deadline);
+            // the buffer is allocated once here, pushing and popping frames does not allocate
+            frames_.set_capacity(capacity_);
+        }
+
+        /// Size of the roscpp subscription queue matching the policy.
+        size_t subscriber_queue_size() const { return capacity_; }
+
+        void push(const ConstPtr &msg)
+        {
+            boost::mutex::scoped_lock lock(mutex_);
+            received_++;
+            if (frames_.size() >= capacity_)
+            {
+                frames_.pop_front();
+                dropped_overflow_++;
+            }
+            frames_.push_back(msg);
+        }
+
+        /**
+         * Take the oldest waiting frame, dropping the expired ones before it under the deadline policy.
+         *
+         * @param[out] msg the frame taken
+         * @return false if no frame is waiting
+         */
+        bool pop(ConstPtr &msg)
+        {
+            uint64_t seq;
+            return pop(msg, seq);
+        }
+
+        /**
+         * Take the oldest waiting frame together with its sequence number. The numbers are assigned under the lock of
+         * the queue, so threads popping concurrently get them in the order of their frames.
+         *
+         * @param[out] msg the frame taken
+         * @param[out] seq number of the frames taken before this one, left untouched if no frame is waiting
+         * @return false if no frame is waiting
+         */
+        bool pop(ConstPtr &msg, uint64_t &seq)
+        {
+            const ros::Time now = ros::Time::now();
+            boost::mutex::scoped_lock lock(mutex_);
+            while (!frames_.empty())
+            {
+                msg = frames_.front();
+                frames_.pop_front();
+                const ros::Duration age = now - ros::message_traits::timeStamp(*msg);
+                if (policy_ == QueuePolicy::DEADLINE && age > deadline_)
+                {
+                    dropped_deadline_++;
+                    continue;
+                }
+                seq = processed_++;
+                age_sum_ += age.toSec();
+                max_age_ = std::max(max_age_, age.toSec());
+                window_count_++;
+                return true;
+            }
+            msg.reset();
+            return false;
+        }
+
+        bool empty()
+        {
+            boost::mutex::scoped_lock lock(mutex_);
+            return frames_.empty();
+        }
+
+        /// Drop every waiting frame without counting them, e.g. when the input is unsubscribed.
+        void clear()
+        {
+            boost::mutex::scoped_lock lock(mutex_);
+            frames_.clear();
+        }
+
+        /**
+         * Publish the counters of the queue periodically as QueueStats messages.
+         *
+         * @param nh node handle to advertise the topic with, usually the private one of the nodelet
+         * @param topic name of the topic
+         * @param period [s] time between two reports
+         */
+        void advertise_stats(ros::NodeHandle &nh, const std::string &topic, double period)
+        {
+            stats_pub_ = nh.advertise<QueueStats>(topic, 10);
+            stats_timer_ = nh.createWallTimer(ros::WallDuration(period), &InputQueue::publish_stats, this);
+        }
+
+    private:
+        void publish_stats(const ros::WallTimerEvent &)
+        {
+            QueueStats::Ptr stats(new QueueStats);
+            {
+                boost::mutex::scoped_lock lock(mutex_);
+                stats->received = received_;
+                stats->processed = processed_;
+                stats->dropped_overflow = dropped_overflow_;
+                stats->dropped_deadline = dropped_deadline_;
+                stats->depth = static_cast<uint32_t>(frames_.size());
+                stats->mean_age = window_count_ > 0 ? static_cast<float>(age_sum_ / window_count_) : 0.f;
+                stats->max_age = static_cast<float>(max_age_);
+                age_sum_ = max_age_ = 0.0;
+                window_count_ = 0;
+            }
+            stats->header.stamp = ros::Time::now();
+            stats_pub_.publish(stats);
+        }
+
+        boost::mutex mutex_;
+        boost::circular_buffer<ConstPtr> frames_{1};
+        QueuePolicy policy_ = QueuePolicy::FIFO;
+        size_t capacity_ = 1;
+        ros::Duration deadline_;
+
+        uint64_t received_ = 0, processed_ = 0, dropped_overflow_ = 0, dropped_deadline_ = 0;
+        double age_sum_ = 0.0, max_age_ = 0.0;
+        size_t window_count_ = 0;
+
+        ros::Publisher stats_pub_;
+        ros::WallTimer stats_timer_;
+    };
+}
+
+#endif // F1TENTH_SENSOR_FUSION__INPUT_QUEUE_HPP
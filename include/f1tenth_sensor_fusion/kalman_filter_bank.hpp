@@ -0,0 +1,354 @@
+/* Copyright 2021 Kovács Gergely Attila
+*
+*   Licensed under the Apache License,
+*   Version 2.0(the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License.
+*
+*/
+
+#ifndef F1TENTH_SENSOR_FUSION__KALMAN_FILTER_BANK_HPP
+#define F1TENTH_SENSOR_FUSION__KALMAN_FILTER_BANK_HPP
+
+#include <Eigen/Core>
+#include <Eigen/LU>
+#include <algorithm>
+#include <array>
+#include <functional>
+#include <vector>
+#include <cstddef>
+
+namespace f1tenth_sensor_fusion
+{
+    namespace detail
+    {
+        /// Invert the MxM innovation covariance of every slot. The generic version gathers each matrix into Eigen.
+        template <int M>
+        struct SoaInverse
+        {
+            static void apply(const std::array<std::vector<float>, M * M> &in, std::array<std::vector<float>, M * M> &out, size_t n)
+            {
+                Eigen::Matrix<float, M, M> m;
+                for (size_t s = 0; s < n; s++)
+                {
+                    for (int e = 0; e < M * M; e++)
+                        m(e / M, e % M) = in[e][s];
+                    const Eigen::Matrix<float, M, M> inv = m.inverse();
+                    for (int e = 0; e < M * M; e++)
+                        out[e][s] = inv(e / M, e % M);
+                }
+            }
+        };
+
+        /// Position measurements are 2D, their inverse has a closed form that vectorizes over the slots.
+        template <>
+        struct SoaInverse<2>
+        {
+            static void apply(const std::array<std::vector<float>, 4> &in, std::array<std::vector<float>, 4> &out, size_t n)
+            {
+                const float *a = in[0].data(), *b = in[1].data(), *c = in[2].data(), *d = in[3].data();
+                float *ia = out[0].data(), *ib = out[1].data(), *ic = out[2].data(), *id = out[3].data();
+                for (size_t s = 0; s < n; s++)
+                {
+                    const float inv_det = 1.f / (a[s] * d[s] - b[s] * c[s]);
+                    ia[s] = d[s] * inv_det;
+                    ib[s] = -b[s] * inv_det;
+                    ic[s] = -c[s] * inv_det;
+                    id[s] = a[s] * inv_det;
+                }
+            }
+        };
+    }
+
+    /**
+     * A bank of linear Kalman filters sharing the same model, stored as structure of arrays: every element of the
+     * state vectors and covariance matrices has a contiguous buffer indexed by the filter's slot. Predict and correct
+     * run over the slots up to the highest active one at once, in loops the compiler can vectorize. Free slots are
+     * handed out lowest first, so that range stays close to the number of active filters.
+     *
+     * The measurement model observes the first MeasDim elements of the state (H = [I 0]).
+     *
+     * @tparam StateDim dimension of the state vector
+     * @tparam MeasDim dimension of the measurement vector
+     */
+    template <int StateDim, int MeasDim>
+    class KalmanFilterBank
+    {
+        static_assert(MeasDim <= StateDim, "the measurement must be a part of the state");
+
+    public:
+        // Unaligned, so that classes holding a bank can be allocated with plain new
+        typedef Eigen::Matrix<float, StateDim, StateDim, Eigen::DontAlign> StateMatrix;
+        typedef Eigen::Matrix<float, StateDim, 1, Eigen::DontAlign> StateVector;
+        typedef Eigen::Matrix<float, MeasDim, MeasDim, Eigen::DontAlign> MeasMatrix;
+        typedef Eigen::Matrix<float, MeasDim, 1, Eigen::DontAlign> MeasVector;
+
+        KalmanFilterBank()
+        {
+            F_.setIdentity();
+            Q_.setZero();
+            P0_.setZero();
+            R_.setIdentity();
+        }
+
+        /**
+         * Set the model shared by every filter of the bank.
+         *
+         * @param F state transition matrix
+         * @param Q process noise covariance
+         * @param R measurement noise covariance
+         * @param P0 error covariance of newly allocated filters
+         */
+        void set_model(const StateMatrix &F, const StateMatrix &Q, const MeasMatrix &R, const StateMatrix &P0)
+        {
+            F_ = F;
+            Q_ = Q;
+            R_ = R;
+            P0_ = P0;
+        }
+
+        /**
+         * Take the lowest free slot (growing the buffers only if there is none) and initialize its filter at a
+         * measurement, the unobserved part of the state is set to zero.
+         *
+         * @return the slot of the new filter
+         */
+        size_t allocate(const MeasVector &z)
+        {
+            if (free_.empty())
+                grow();
+            std::pop_heap(free_.begin(), free_.end(), std::greater<size_t>());
+            const size_t slot = free_.back();
+            free_.pop_back();
+
+            for (int i = 0; i < StateDim; i++)
+                x_[i][slot] = i < MeasDim ? z(i) : 0.f;
+            for (int e = 0; e < StateDim * StateDim; e++)
+                P_[e][slot] = P0_(e / StateDim, e % StateDim);
+            active_[slot] = true;
+            measured_[slot] = 0.f;
+            active_count_++;
+            live_end_ = std::max(live_end_, slot + 1);
+            return slot;
+        }
+
+        /// Return a slot to the free list. The filter is no longer predicted or corrected.
+        void release(size_t slot)
+        {
+            active_[slot] = false;
+            measured_[slot] = 0.f;
+            free_.push_back(slot);
+            std::push_heap(free_.begin(), free_.end(), std::greater<size_t>());
+            active_count_--;
+            while (live_end_ > 0 && !active_[live_end_ - 1])
+                live_end_--;
+        }
+
+        size_t size() const { return active_count_; }
+        size_t capacity() const { return capacity_; }
+
+        /// One past the highest active slot, the range of slots predict() and correct() run over.
+        size_t live_end() const { return live_end_; }
+        bool active(size_t slot) const { return active_[slot]; }
+
+        /// Element i of the state of the filter in the given slot.
+        float state(size_t slot, int i) const { return x_[i][slot]; }
+
+        /// Element (i, j) of the error covariance of the filter in the given slot.
+        float covariance(size_t slot, int i, int j) const { return P_[i * StateDim + j][slot]; }
+
+        /// Advance every filter by one step: x = F x, P = F P F' + Q.
+        void predict()
+        {
+            const size_t n = live_end_;
+            for (int i = 0; i < StateDim; i++)
+            {
+                float *out = tx_[i].data();
+                std::fill(out, out + n, 0.f);
+                for (int k = 0; k < StateDim; k++)
+                {
+                    const float f = F_(i, k);
+                    if (f == 0.f)
+                        continue;
+                    const float *in = x_[k].data();
+                    for (size_t s = 0; s < n; s++)
+                        out[s] += f * in[s];
+                }
+            }
+            x_.swap(tx_);
+
+            // T = F P
+            for (int i = 0; i < StateDim; i++)
+                for (int j = 0; j < StateDim; j++)
+                {
+                    float *out = tP_[i * StateDim + j].data();
+                    std::fill(out, out + n, 0.f);
+                    for (int k = 0; k < StateDim; k++)
+                    {
+                        const float f = F_(i, k);
+                        if (f == 0.f)
+                            continue;
+                        const float *in = P_[k * StateDim + j].data();
+                        for (size_t s = 0; s < n; s++)
+                            out[s] += f * in[s];
+                    }
+                }
+            // P = T F' + Q
+            for (int i = 0; i < StateDim; i++)
+                for (int j = 0; j < StateDim; j++)
+                {
+                    float *out = P_[i * StateDim + j].data();
+                    std::fill(out, out + n, Q_(i, j));
+                    for (int k = 0; k < StateDim; k++)
+                    {
+                        const float f = F_(j, k);
+                        if (f == 0.f)
+                            continue;
+                        const float *in = tP_[i * StateDim + k].data();
+                        for (size_t s = 0; s < n; s++)
+                            out[s] += f * in[s];
+                    }
+                }
+        }
+
+        /// Queue a measurement for the filter in the given slot, applied by the next call to correct().
+        void set_measurement(size_t slot, const MeasVector &z)
+        {
+            for (int a = 0; a < MeasDim; a++)
+                z_[a][slot] = z(a);
+            measured_[slot] = 1.f;
+        }
+
+        /**
+         * Correct every filter that received a measurement since the last call. Filters without one are masked out
+         * instead of branched over, so the loops stay uniform.
+         */
+        void correct()
+        {
+            const size_t n = live_end_;
+
+            // innovation covariance S = H P H' + R, which is the upper left block of P
+            for (int a = 0; a < MeasDim; a++)
+                for (int b = 0; b < MeasDim; b++)
+                {
+                    const float *p = P_[a * StateDim + b].data();
+                    float *out = S_[a * MeasDim + b].data();
+                    const float r = R_(a, b);
+                    for (size_t s = 0; s < n; s++)
+                        out[s] = p[s] + r;
+                }
+            detail::SoaInverse<MeasDim>::apply(S_, Si_, n);
+
+            // gain K = P H' S^-1, the innovation is zeroed for filters without a measurement
+            for (int i = 0; i < StateDim; i++)
+                for (int a = 0; a < MeasDim; a++)
+                {
+                    float *out = K_[i * MeasDim + a].data();
+                    std::fill(out, out + n, 0.f);
+                    for (int b = 0; b < MeasDim; b++)
+                    {
+                        const float *p = P_[i * StateDim + b].data();
+                        const float *si = Si_[b * MeasDim + a].data();
+                        for (size_t s = 0; s < n; s++)
+                            out[s] += p[s] * si[s];
+                    }
+                }
+            for (int a = 0; a < MeasDim; a++)
+            {
+                const float *z = z_[a].data(), *x = x_[a].data(), *m = measured_.data();
+                float *y = y_[a].data();
+                for (size_t s = 0; s < n; s++)
+                    y[s] = (z[s] - x[s]) * m[s];
+            }
+
+            // x = x + K y
+            for (int i = 0; i < StateDim; i++)
+            {
+                float *x = x_[i].data();
+                for (int a = 0; a < MeasDim; a++)
+                {
+                    const float *k = K_[i * MeasDim + a].data(), *y = y_[a].data();
+                    for (size_t s = 0; s < n; s++)
+                        x[s] += k[s] * y[s];
+                }
+            }
+
+            // P = P - K H P, H P being the first MeasDim rows of P (copied, they are overwritten on the way)
+            for (int a = 0; a < MeasDim; a++)
+                for (int j = 0; j < StateDim; j++)
+                    HP_[a * StateDim + j] = P_[a * StateDim + j];
+            for (int i = 0; i < StateDim; i++)
+                for (int j = 0; j < StateDim; j++)
+                {
+                    float *p = P_[i * StateDim + j].data();
+                    const float *m = measured_.data();
+                    for (int a = 0; a < MeasDim; a++)
+                    {
+                        const float *k = K_[i * MeasDim + a].data(), *hp = HP_[a * StateDim + j].data();
+                        for (size_t s = 0; s < n; s++)
+                            p[s] -= m[s] * k[s] * hp[s];
+                    }
+                }
+
+            std::fill(measured_.begin(), measured_.begin() + n, 0.f);
+        }
+
+    private:
+        void grow()
+        {
+            const size_t old = capacity_;
+            capacity_ = capacity_ == 0 ? 8 : 2 * capacity_;
+            for (auto &v : x_)
+                v.resize(capacity_, 0.f);
+            for (auto &v : tx_)
+                v.resize(capacity_, 0.f);
+            for (auto &v : P_)
+                v.resize(capacity_, 0.f);
+            for (auto &v : tP_)
+                v.resize(capacity_, 0.f);
+            for (auto &v : z_)
+                v.resize(capacity_, 0.f);
+            for (auto &v : y_)
+                v.resize(capacity_, 0.f);
+            for (auto &v : S_)
+                v.resize(capacity_, 0.f);
+            for (auto &v : Si_)
+                v.resize(capacity_, 0.f);
+            for (auto &v : K_)
+                v.resize(capacity_, 0.f);
+            for (auto &v : HP_)
+                v.resize(capacity_, 0.f);
+            active_.resize(capacity_, false);
+            measured_.resize(capacity_, 0.f);
+            for (size_t s = old; s < capacity_; s++)
+            {
+                free_.push_back(s);
+                std::push_heap(free_.begin(), free_.end(), std::greater<size_t>());
+            }
+        }
+
+        StateMatrix F_, Q_, P0_;
+        MeasMatrix R_;
+
+        size_t capacity_ = 0, active_count_ = 0, live_end_ = 0;
+        std::array<std::vector<float>, StateDim> x_, tx_;
+        std::array<std::vector<float>, StateDim * StateDim> P_, tP_;
+        std::array<std::vector<float>, MeasDim> z_, y_;
+        std::array<std::vector<float>, MeasDim * MeasDim> S_, Si_;
+        std::array<std::vector<float>, StateDim * MeasDim> K_;
+        std::array<std::vector<float>, MeasDim * StateDim> HP_;
+        std::vector<bool> active_;
+        std::vector<float> measured_;
+        std::vector<size_t> free_; ///< min-heap of the free slots
+    };
+}
+
+#endif // F1TENTH_SENSOR_FUSION__KALMAN_FILTER_BANK_HPP
@@ -41,13 +41,19 @@
 #ifndef F1TENTH_SENSOR_FUSION_LASERSCAN_TO_POINTCLOUD_NODELET_H
 #define F1TENTH_SENSOR_FUSION_LASERSCAN_TO_POINTCLOUD_NODELET_H
 
+#include <f1tenth_sensor_fusion/input_queue.hpp>
+#include <f1tenth_sensor_fusion/scan_projection.hpp>
+#include <f1tenth_sensor_fusion/stage_timers.hpp>
+#include <atomic>
 #include <boost/thread/mutex.hpp>
-#include <laser_geometry/laser_geometry.h>
 #include <message_filters/subscriber.h>
 #include <nodelet/nodelet.h>
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
 #include <ros/ros.h>
 #include <sensor_msgs/LaserScan.h>
 #include <string>
+#include <vector>
 #include <tf2_ros/buffer.h>
 #include <tf2_ros/message_filter.h>
 #include <tf2_ros/transform_listener.h>
@@ -64,9 +70,21 @@ namespace f1tenth_sensor_fusion
     LaserScanToPointCloudNodelet();
 
   private:
+    //! Stages timed on ~stats, "latency" runs from the stamp of the scan to publishing
+    enum Stage
+    {
+      STAGE_PROJECTION,
+      STAGE_TF,
+      STAGE_PUBLISH,
+      STAGE_LATENCY
+    };
+
     virtual void onInit();
 
     void scanCallback(const sensor_msgs::LaserScanConstPtr &scan_msg);
+    void process(const sensor_msgs::LaserScanConstPtr &scan_msg);
+    //! Look up the transform from the frame of the scan to the target frame, unless it is cached already
+    bool update_transform(const std_msgs::Header &header);
     void failureCallback(const sensor_msgs::LaserScanConstPtr &scan_msg,
                          tf2_ros::filter_failure_reasons::FilterFailureReason reason);
 
@@ -85,12 +103,22 @@ namespace f1tenth_sensor_fusion
     message_filters::Subscriber<sensor_msgs::LaserScan> sub_;
     boost::shared_ptr<MessageFilter> message_filter_;
 
-    laser_geometry::LaserProjection projector_;
+    ScanProjection projection_;
+    ScanTransform transform_ = ScanTransform::Identity();
+    std::string laser_frame_;
+    bool transform_cached_ = false;
+    //! Clouds the scans are projected into, a cloud is reused once every subscriber released it
+    std::vector<pcl::PointCloud<pcl::PointXYZ>::Ptr> cloud_pool_;
+    InputQueue<sensor_msgs::LaserScan> queue_;
+    std::atomic<bool> processing_{false};
+    StageTimers timers_{{"projection", "tf", "publish", "latency"}};
 
     // ROS Parameters
     unsigned int input_queue_size_;
     std::string target_frame_;
     std::string subscription_topic_;
+    bool static_transform_;
+    bool drop_invalid_;
   };
 
 } // namespace f1tenth_sensor_fusion
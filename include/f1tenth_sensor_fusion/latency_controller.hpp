@@ -0,0 +1,82 @@
+/* Copyright 2021 Kovács Gergely Attila
+*
+*   Licensed under the Apache License,
+*   Version 2.0(the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License.
+*
+*/
+
+#ifndef F1TENTH_SENSOR_FUSION__LATENCY_CONTROLLER_HPP
+#define F1TENTH_SENSOR_FUSION__LATENCY_CONTROLLER_HPP
+
+#include <f1tenth_sensor_fusion/OperatingPoint.h>
+#include <ros/ros.h>
+#include <string>
+
+namespace f1tenth_sensor_fusion
+{
+    /**
+     * Controller trading the quality of a processing stage for time, to hold a processing time per frame. It sets a
+     * single parameter (e.g. a voxel leaf or a point budget) between a finest and a coarsest value. The level between
+     * them is integrated from the relative error of the smoothed processing time. It rises quickly when frames take too
+     * long and falls slowly when they are fast, and holds still within a dead band around the target, so the output
+     * settles instead of oscillating.
+     */
+    class LatencyController
+    {
+    public:
+        /**
+         * @param target [s] processing time per frame to hold, non-positive disables the controller
+         * @param finest value of the parameter at level 0, the best quality
+         * @param coarsest value of the parameter at level 1, the fastest processing. Values in between are interpolated
+         * geometrically, both must be positive
+         */
+        void configure(double target, double finest, double coarsest);
+
+        bool enabled() const { return target_ > 0.0; }
+
+        /**
+         * Add the processing time of a frame.
+         *
+         * @param duration [s]
+         * @return true if the value of the parameter changed
+         */
+        bool update(double duration);
+
+        /// The value of the parameter at the current level.
+        double value() const { return value_; }
+
+        float level() const { return level_; }
+
+        /**
+         * Publish the operating point after every frame, if the topic has subscribers.
+         *
+         * @param nh node handle to advertise the topic with, usually the private one of the nodelet
+         * @param topic name of the topic
+         * @param parameter name of the parameter set by the controller, as in the message
+         */
+        void advertise(ros::NodeHandle &nh, const std::string &topic, const std::string &parameter);
+
+        /// @param stamp stamp of the frame last added
+        void publish(const ros::Time &stamp);
+
+    private:
+        double target_ = 0.0, finest_ = 1.0, coarsest_ = 1.0;
+        double smoothed_ = 0.0; ///< [s] exponential moving average of the processing times
+        double value_ = 1.0;
+        float level_ = 0.f;
+        ros::Publisher pub_;
+        OperatingPoint::Ptr msg_;
+    };
+}
+
+#endif // F1TENTH_SENSOR_FUSION__LATENCY_CONTROLLER_HPP
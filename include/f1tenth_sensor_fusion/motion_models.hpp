@@ -0,0 +1,416 @@
+/* Copyright 2021 Kovács Gergely Attila
+*
+*   Licensed under the Apache License,
+*   Version 2.0(the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License.
+*
+*/
+
+
+#ifndef F1TENTH_SENSOR_FUSION__MOTION_MODELS_HPP
+#define F1TENTH_SENSOR_FUSION__MOTION_MODELS_HPP
+
+#include <Eigen/Core>
+#include <Eigen/LU>
+#include <algorithm>
+#include <cmath>
+
+namespace f1tenth_sensor_fusion
+{
+    enum class MotionModel
+    {
+        CV,   ///< constant velocity, linear: [x, y, v_x, v_y]
+        CA,   ///< constant acceleration, linear: [x, y, v_x, v_y, a_x, a_y]
+        CTRV, ///< constant turn rate and velocity, extended KF: [x, y, v, yaw, yaw rate]
+        IMM   ///< interacting multiple models mixing a straight and a turning CTRV mode
+    };
+
+    /// Parameters of the motion models, the noises are standard deviations.
+    struct MotionModelConfig
+    {
+        MotionModel model = MotionModel::CV;
+        float accel_noise = 2.f;       ///< [m/s^2] acceleration of CV, CTRV and IMM
+        float jerk_noise = 5.f;        ///< [m/s^3] change of the acceleration of CA
+        float yaw_accel_noise = 2.f;   ///< [rad/s^2] yaw acceleration of CTRV and IMM
+        float measurement_noise = 0.05f; ///< [m] error of the cluster centres
+        float initial_speed = 3.f;     ///< [m/s] uncertainty of the speed of new tracks
+        float initial_yaw_rate = 1.f;  ///< [rad/s] uncertainty of the yaw rate of new tracks
+        float imm_switch = 0.05f;      ///< probability of the IMM switching modes between two frames
+        float frame_period = 0.05f;    ///< [s] time step of a prediction when the frames are not stamped
+        double max_frame_gap = 1.0;    ///< [s] frames further apart in time restart the tracking
+    };
+
+    typedef Eigen::Matrix<float, 2, 1, Eigen::DontAlign> PlanarVector;
+    typedef Eigen::Matrix<float, 4, 1, Eigen::DontAlign> StateVariance; ///< diagonal of the covariance of [x, y, v_x, v_y]
+
+    /// Linear constant velocity model.
+    struct ConstantVelocity
+    {
+        enum
+        {
+            StateDim = 4
+        };
+        typedef Eigen::Matrix<float, StateDim, 1, Eigen::DontAlign> State;
+        typedef Eigen::Matrix<float, StateDim, StateDim, Eigen::DontAlign> StateMatrix;
+
+        static void transition(float dt, StateMatrix &F)
+        {
+            F.setIdentity();
+            F(0, 2) = F(1, 3) = dt;
+        }
+
+        /// Acceleration as white noise, constant during a step.
+        static void process_noise(const State &, float dt, const MotionModelConfig &config, StateMatrix &Q)
+        {
+            const float q = config.accel_noise * config.accel_noise;
+            const float g[2] = {0.5f * dt * dt, dt};
+            Q.setZero();
+            for (int i = 0; i < 2; i++)
+                for (int j = 0; j < 2; j++)
+                    Q(2 * i, 2 * j) = Q(2 * i + 1, 2 * j + 1) = q * g[i] * g[j];
+        }
+
+        static void initial_covariance(const MotionModelConfig &config, StateMatrix &P)
+        {
+            const float r = config.measurement_noise * config.measurement_noise;
+            const float v = config.initial_speed * config.initial_speed;
+            P = StateMatrix(State(r, r, v, v).asDiagonal());
+        }
+
+        static void predict(State &x, float dt, StateMatrix &F)
+        {
+            transition(dt, F);
+            x = F * x;
+        }
+
+        static void normalize(State &) {}
+        static PlanarVector velocity(const State &x) { return PlanarVector(x(2), x(3)); }
+        static StateVariance variance(const State &, const StateMatrix &P) { return StateVariance(P(0, 0), P(1, 1), P(2, 2), P(3, 3)); }
+    };
+
+    /// Linear constant acceleration model.
+    struct ConstantAcceleration
+    {
+        enum
+        {
+            StateDim = 6
+        };
+        typedef Eigen::Matrix<float, StateDim, 1, Eigen::DontAlign> State;
+        typedef Eigen::Matrix<float, StateDim, StateDim, Eigen::DontAlign> StateMatrix;
+
+        static void transition(float dt, StateMatrix &F)
+        {
+            F.setIdentity();
+            F(0, 2) = F(1, 3) = F(2, 4) = F(3, 5) = dt;
+            F(0, 4) = F(1, 5) = 0.5f * dt * dt;
+        }
+
+        /// Jerk as white noise, constant during a step.
+        static void process_noise(const State &, float dt, const MotionModelConfig &config, StateMatrix &Q)
+        {
+            const float q = config.jerk_noise * config.jerk_noise;
+            const float g[3] = {dt * dt * dt / 6.f, 0.5f * dt * dt, dt};
+            Q.setZero();
+            for (int i = 0; i < 3; i++)
+                for (int j = 0; j < 3; j++)
+                    Q(2 * i, 2 * j) = Q(2 * i + 1, 2 * j + 1) = q * g[i] * g[j];
+        }
+
+        static void initial_covariance(const MotionModelConfig &config, StateMatrix &P)
+        {
+            const float r = config.measurement_noise * config.measurement_noise;
+            const float v = config.initial_speed * config.initial_speed;
+            const float a = config.accel_noise * config.accel_noise;
+            State d;
+            d << r, r, v, v, a, a;
+            P = StateMatrix(d.asDiagonal());
+        }
+
+        static void predict(State &x, float dt, StateMatrix &F)
+        {
+            transition(dt, F);
+            x = F * x;
+        }
+
+        static void normalize(State &) {}
+        static PlanarVector velocity(const State &x) { return PlanarVector(x(2), x(3)); }
+        static StateVariance variance(const State &, const StateMatrix &P) { return StateVariance(P(0, 0), P(1, 1), P(2, 2), P(3, 3)); }
+    };
+
+    /**
+     * Constant turn rate and velocity model. The speed is along the heading, so unlike the Cartesian models it knows
+     * that a car can't move sideways, and it follows the arcs of the corners.
+     */
+    struct ConstantTurnRate
+    {
+        enum
+        {
+            StateDim = 5
+        };
+        typedef Eigen::Matrix<float, StateDim, 1, Eigen::DontAlign> State;
+        typedef Eigen::Matrix<float, StateDim, StateDim, Eigen::DontAlign> StateMatrix;
+
+        /// Advance the state and compute the Jacobian of the transition at the old state.
+        static void predict(State &x, float dt, StateMatrix &F)
+        {
+            advance(x, dt, F, true);
+        }
+
+        /// Linear and yaw accelerations as white noise, constant during a step.
+        static void process_noise(const State &x, float dt, const MotionModelConfig &config, StateMatrix &Q)
+        {
+            noise(x, dt, config, Q, true);
+        }
+
+        static void initial_covariance(const MotionModelConfig &config, StateMatrix &P)
+        {
+            const float r = config.measurement_noise * config.measurement_noise;
+            State d;
+            d << r, r, config.initial_speed * config.initial_speed, static_cast<float>(M_PI * M_PI),
+                config.initial_yaw_rate * config.initial_yaw_rate;
+            P = StateMatrix(d.asDiagonal());
+        }
+
+        /// Wrap the yaw of a state (or of a difference of states) into [-pi, pi].
+        static void normalize(State &x)
+        {
+            x(3) = std::remainder(x(3), static_cast<float>(2 * M_PI));
+        }
+
+        static PlanarVector velocity(const State &x) { return PlanarVector(x(2) * std::cos(x(3)), x(2) * std::sin(x(3))); }
+
+        /// The velocity is linearized around the state, from the variances of the speed and the yaw.
+        static StateVariance variance(const State &x, const StateMatrix &P)
+        {
+            const float c = std::cos(x(3)), s = std::sin(x(3)), v = x(2);
+            const float pvv = P(2, 2), pvy = P(2, 3), pyy = P(3, 3);
+            return StateVariance(P(0, 0), P(1, 1), c * c * pvv - 2.f * c * s * v * pvy + s * s * v * v * pyy,
+                                 s * s * pvv + 2.f * c * s * v * pvy + c * c * v * v * pyy);
+        }
+
+    protected:
+        static void advance(State &x, float dt, StateMatrix &F, bool turning)
+        {
+            const float v = x(2), yaw = x(3), w = turning ? x(4) : 0.f;
+            const float s = std::sin(yaw), c = std::cos(yaw);
+            F.setIdentity();
+            if (std::abs(w) > 1e-4f)
+            {
+                const float s1 = std::sin(yaw + w * dt), c1 = std::cos(yaw + w * dt);
+                x(0) += v / w * (s1 - s);
+                x(1) += v / w * (c - c1);
+                F(0, 2) = (s1 - s) / w;
+                F(0, 3) = v / w * (c1 - c);
+                F(0, 4) = v * dt * c1 / w - v / (w * w) * (s1 - s);
+                F(1, 2) = (c - c1) / w;
+                F(1, 3) = v / w * (s1 - s);
+                F(1, 4) = v * dt * s1 / w - v / (w * w) * (c - c1);
+            }
+            else
+            {
+                // limit of the arc as the yaw rate goes to zero
+                x(0) += v * c * dt;
+                x(1) += v * s * dt;
+                F(0, 2) = c * dt;
+                F(0, 3) = -v * s * dt;
+                F(1, 2) = s * dt;
+                F(1, 3) = v * c * dt;
+                if (turning)
+                {
+                    F(0, 4) = -0.5f * v * dt * dt * s;
+                    F(1, 4) = 0.5f * v * dt * dt * c;
+                }
+            }
+            if (turning)
+            {
+                x(3) += w * dt;
+                F(3, 4) = dt;
+                normalize(x);
+            }
+            else
+            {
+                x(4) = 0.f;
+                F(4, 4) = 0.f;
+            }
+        }
+
+        static void noise(const State &x, float dt, const MotionModelConfig &config, StateMatrix &Q, bool turning)
+        {
+            Eigen::Matrix<float, StateDim, 2> G = Eigen::Matrix<float, StateDim, 2>::Zero();
+            G(0, 0) = 0.5f * dt * dt * std::cos(x(3));
+            G(1, 0) = 0.5f * dt * dt * std::sin(x(3));
+            G(2, 0) = dt;
+            G(3, 1) = 0.5f * dt * dt;
+            G(4, 1) = turning ? dt : 0.f;
+            const Eigen::Vector2f q(config.accel_noise * config.accel_noise, config.yaw_accel_noise * config.yaw_accel_noise);
+            Q = G * q.asDiagonal() * G.transpose();
+        }
+    };
+
+    /**
+     * The straight mode of the IMM: constant velocity expressed in the state of ConstantTurnRate, the heading only
+     * changes by noise and the yaw rate is held at zero.
+     */
+    struct StraightMotion : ConstantTurnRate
+    {
+        static void predict(State &x, float dt, StateMatrix &F)
+        {
+            advance(x, dt, F, false);
+        }
+
+        static void process_noise(const State &x, float dt, const MotionModelConfig &config, StateMatrix &Q)
+        {
+            noise(x, dt, config, Q, false);
+        }
+    };
+
+    /**
+     * Extended Kalman filter of one track, measuring the position (the first two elements of the state). Every matrix
+     * has a fixed size, so predict and correct run on the stack.
+     *
+     * @tparam Model one of the motion models above
+     */
+    template <class Model>
+    struct Ekf
+    {
+        typedef typename Model::State State;
+        typedef typename Model::StateMatrix StateMatrix;
+        typedef Eigen::Matrix<float, 2, 2, Eigen::DontAlign> MeasMatrix;
+
+        State x;
+        StateMatrix P;
+
+        void init(const PlanarVector &z, const MotionModelConfig &config)
+        {
+            x.setZero();
+            x.template head<2>() = z;
+            Model::initial_covariance(config, P);
+        }
+
+        void predict(float dt, const MotionModelConfig &config)
+        {
+            StateMatrix F, Q;
+            Model::predict(x, dt, F);
+            Model::process_noise(x, dt, config, Q);
+            P = F * P * F.transpose() + Q;
+        }
+
+        /**
+         * Correct the filter with a measured position.
+         *
+         * @return likelihood of the measurement before the correction
+         */
+        float correct(const PlanarVector &z, const MeasMatrix &R)
+        {
+            const Eigen::Vector2f y = z - x.template head<2>();
+            const Eigen::Matrix2f S = P.template topLeftCorner<2, 2>() + R;
+            const Eigen::Matrix2f Si = S.inverse();
+            const Eigen::Matrix<float, Model::StateDim, 2> K = P.template leftCols<2>() * Si;
+            x += K * y;
+            Model::normalize(x);
+            P -= K * P.template topRows<2>();
+            return std::exp(-0.5f * y.dot(Si * y)) / (2.f * static_cast<float>(M_PI) * std::sqrt(S.determinant()));
+        }
+
+        PlanarVector position() const { return x.template head<2>(); }
+        PlanarVector velocity() const { return Model::velocity(x); }
+        StateVariance variance() const { return Model::variance(x, P); }
+    };
+
+    /**
+     * Interacting multiple model filter of one track, mixing two EKF modes that share the same state. Every step mixes
+     * the modes according to their probabilities, predicts both and weighs them by the likelihood of the measurement.
+     * The estimate is the weighted sum of the modes.
+     */
+    template <class ModelA, class ModelB>
+    struct Imm
+    {
+        static_assert(ModelA::StateDim == ModelB::StateDim, "the modes of an IMM must share the state");
+        typedef typename ModelA::State State;
+        typedef typename ModelA::StateMatrix StateMatrix;
+        typedef typename Ekf<ModelA>::MeasMatrix MeasMatrix;
+
+        Ekf<ModelA> a;
+        Ekf<ModelB> b;
+        float mu_a = 0.5f; ///< probability of mode a, that of mode b is 1 - mu_a
+
+        void init(const PlanarVector &z, const MotionModelConfig &config)
+        {
+            a.init(z, config);
+            b.init(z, config);
+            mu_a = 0.5f;
+        }
+
+        void predict(float dt, const MotionModelConfig &config)
+        {
+            // mixing probabilities: w_ij is the probability of having been in mode i when now being in mode j
+            const float stay = 1.f - config.imm_switch, mu_b = 1.f - mu_a;
+            const float c_a = stay * mu_a + config.imm_switch * mu_b;
+            const float c_b = config.imm_switch * mu_a + stay * mu_b;
+            const float w_aa = stay * mu_a / c_a, w_ba = 1.f - w_aa;
+            const float w_ab = config.imm_switch * mu_a / c_b, w_bb = 1.f - w_ab;
+
+            State xa, xb;
+            StateMatrix Pa, Pb;
+            mix(w_aa, w_ba, a.x, xa, Pa);
+            mix(w_ab, w_bb, b.x, xb, Pb);
+            a.x = xa;
+            a.P = Pa;
+            b.x = xb;
+            b.P = Pb;
+            mu_a = c_a;
+
+            a.predict(dt, config);
+            b.predict(dt, config);
+        }
+
+        void correct(const PlanarVector &z, const MeasMatrix &R)
+        {
+            const float la = mu_a * a.correct(z, R), lb = (1.f - mu_a) * b.correct(z, R);
+            // keep the predicted probabilities if both modes find the measurement impossible
+            if (la + lb > 1e-30f)
+                mu_a = la / (la + lb);
+            mu_a = std::min(std::max(mu_a, 1e-3f), 1.f - 1e-3f);
+        }
+
+        PlanarVector position() const { return mu_a * a.position() + (1.f - mu_a) * b.position(); }
+        PlanarVector velocity() const { return mu_a * a.velocity() + (1.f - mu_a) * b.velocity(); }
+
+        /// Variance of the mixture: that of the modes and the spread of their estimates.
+        StateVariance variance() const
+        {
+            StateVariance ma, mb;
+            ma << a.position(), a.velocity();
+            mb << b.position(), b.velocity();
+            const StateVariance m = mu_a * ma + (1.f - mu_a) * mb;
+            return mu_a * (a.variance() + (ma - m).cwiseAbs2()) + (1.f - mu_a) * (b.variance() + (mb - m).cwiseAbs2());
+        }
+
+    private:
+        /// Mix the modes with the weights wa and wb around the state ref of the target mode, so the yaw is averaged on the circle.
+        void mix(float wa, float wb, const State &ref, State &x, StateMatrix &P) const
+        {
+            State da = a.x - ref, db = b.x - ref;
+            ModelA::normalize(da);
+            ModelA::normalize(db);
+            x = ref + wa * da + wb * db;
+            ModelA::normalize(x);
+            da = a.x - x;
+            db = b.x - x;
+            ModelA::normalize(da);
+            ModelA::normalize(db);
+            P = wa * (a.P + da * da.transpose()) + wb * (b.P + db * db.transpose());
+        }
+    };
+}
+
+#endif // F1TENTH_SENSOR_FUSION__MOTION_MODELS_HPP
@@ -0,0 +1,174 @@
+/* Copyright 2021 Kovács Gergely Attila
+*
+*   Licensed under the Apache License,
+*   Version 2.0(the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License.
+*
+*/
+
+#ifndef F1TENTH_SENSOR_FUSION__POINT_TYPES_HPP
+#define F1TENTH_SENSOR_FUSION__POINT_TYPES_HPP
+
+#include <sensor_msgs/PointCloud2.h>
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+namespace f1tenth_sensor_fusion
+{
+    enum class PointType
+    {
+        XYZ,   ///< coordinates only
+        XYZI,  ///< with the intensity of LiDAR returns
+        XYZRGB ///< with the colour of RGB-D cameras
+    };
+
+    /**
+     * Parse the name of a point type as given in the parameter files.
+     *
+     * @param[in] name one of "xyz", "xyzi" or "xyzrgb"
+     * @param[out] type the parsed type, left untouched on failure
+     * @return false if the name is not recognized
+     */
+    bool parse_point_type(const std::string &name, PointType &type);
+
+    /// Byte offset of a field of the given datatype within a point of a message, -1 if there is no such field.
+    inline int field_offset(const sensor_msgs::PointCloud2 &msg, const char *name, uint8_t datatype)
+    {
+        for (const sensor_msgs::PointField &f : msg.fields)
+            if (f.name == name)
+                return f.datatype == datatype && f.offset + 4 <= msg.point_step ? static_cast<int>(f.offset) : -1;
+        return -1;
+    }
+
+    /**
+     * The fields of a point type besides x, y and z, resolved at compile time. The stages reading messages or
+     * averaging points go through these, so the PointXYZ path, which has no such fields, compiles to what it was
+     * without them. Fields missing from a message are read as zero.
+     */
+    template <class PointT>
+    struct PointFields
+    {
+        static constexpr int CHANNELS = 0; ///< float channels averaged by the voxel filter
+
+        /// Byte offsets of the fields within a point of a message
+        struct Offsets
+        {
+        };
+
+        static void find(const sensor_msgs::PointCloud2 &, Offsets &) {}
+        static void read(const uint8_t *, const Offsets &, PointT &) {}
+        static void get(const PointT &, float *) {}
+        static void set(const float *, PointT &) {}
+    };
+
+    template <>
+    struct PointFields<pcl::PointXYZI>
+    {
+        static constexpr int CHANNELS = 1;
+
+        struct Offsets
+        {
+            int intensity = -1;
+        };
+
+        static void find(const sensor_msgs::PointCloud2 &msg, Offsets &o)
+        {
+            o.intensity = field_offset(msg, "intensity", sensor_msgs::PointField::FLOAT32);
+        }
+
+        static void read(const uint8_t *p, const Offsets &o, pcl::PointXYZI &out)
+        {
+            if (o.intensity >= 0)
+                std::memcpy(&out.intensity, p + o.intensity, sizeof(float));
+            else
+                out.intensity = 0.f;
+        }
+
+        static void get(const pcl::PointXYZI &p, float *c) { c[0] = p.intensity; }
+        static void set(const float *c, pcl::PointXYZI &p) { p.intensity = c[0]; }
+    };
+
+    template <>
+    struct PointFields<pcl::PointXYZRGB>
+    {
+        static constexpr int CHANNELS = 3;
+
+        struct Offsets
+        {
+            int rgb = -1;
+        };
+
+        static void find(const sensor_msgs::PointCloud2 &msg, Offsets &o)
+        {
+            // the colour is packed into 4 bytes either way, as a float by PCL and most drivers or as rgba
+            o.rgb = field_offset(msg, "rgb", sensor_msgs::PointField::FLOAT32);
+            if (o.rgb < 0)
+                o.rgb = field_offset(msg, "rgba", sensor_msgs::PointField::UINT32);
+        }
+
+        static void read(const uint8_t *p, const Offsets &o, pcl::PointXYZRGB &out)
+        {
+            if (o.rgb >= 0)
+                std::memcpy(&out.rgba, p + o.rgb, sizeof(uint32_t));
+            else
+                out.rgba = 0xff000000u;
+        }
+
+        static void get(const pcl::PointXYZRGB &p, float *c)
+        {
+            c[0] = p.r;
+            c[1] = p.g;
+            c[2] = p.b;
+        }
+
+        static void set(const float *c, pcl::PointXYZRGB &p)
+        {
+            p.r = static_cast<uint8_t>(c[0] + 0.5f);
+            p.g = static_cast<uint8_t>(c[1] + 0.5f);
+            p.b = static_cast<uint8_t>(c[2] + 0.5f);
+        }
+    };
+
+    /**
+     * The coordinates of a cloud, for the stages using nothing else such as the clustering. A PointXYZ cloud is
+     * returned as it is, other clouds are copied into a buffer, which is allocated on the first call only.
+     *
+     * @param cloud the cloud
+     * @param buffer receives the coordinates of clouds with other point types
+     */
+    template <class PointT>
+    pcl::PointCloud<pcl::PointXYZ>::ConstPtr coordinates(const typename pcl::PointCloud<PointT>::ConstPtr &cloud,
+                                                         pcl::PointCloud<pcl::PointXYZ>::Ptr &buffer)
+    {
+        if (!buffer)
+            buffer.reset(new pcl::PointCloud<pcl::PointXYZ>);
+        buffer->header = cloud->header;
+        buffer->resize(cloud->size());
+        for (size_t i = 0; i < cloud->size(); i++)
+            (*buffer)[i].getVector3fMap() = (*cloud)[i].getVector3fMap();
+        buffer->is_dense = cloud->is_dense;
+        return buffer;
+    }
+
+    template <>
+    inline pcl::PointCloud<pcl::PointXYZ>::ConstPtr coordinates<pcl::PointXYZ>(const pcl::PointCloud<pcl::PointXYZ>::ConstPtr &cloud,
+                                                                              pcl::PointCloud<pcl::PointXYZ>::Ptr &)
+    {
+        return cloud;
+    }
+}
+
+#endif // F1TENTH_SENSOR_FUSION__POINT_TYPES_HPP
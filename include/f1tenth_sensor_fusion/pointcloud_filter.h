@@ -18,6 +18,12 @@
 #ifndef F1TENTH_SENSOR_FUSION__POINTCLOUD_FILTER_H
 #define F1TENTH_SENSOR_FUSION__POINTCLOUD_FILTER_H
 
+#include <f1tenth_sensor_fusion/cloud_preprocessor.hpp>
+#include <f1tenth_sensor_fusion/frame_log.hpp>
+#include <f1tenth_sensor_fusion/input_queue.hpp>
+#include <f1tenth_sensor_fusion/latency_controller.hpp>
+#include <f1tenth_sensor_fusion/point_types.hpp>
+#include <f1tenth_sensor_fusion/stage_timers.hpp>
 #include <ros/ros.h>
 #include <nodelet/nodelet.h>
 #include <boost/thread/mutex.hpp>
@@ -29,6 +35,10 @@
 #include <pcl/point_cloud.h>
 #include <pcl/point_types.h>
 #include <pcl_ros/point_cloud.h>
+#include <atomic>
+#include <chrono>
+#include <tuple>
+#include <vector>
 
 namespace f1tenth_sensor_fusion
 {
@@ -40,14 +50,43 @@ namespace f1tenth_sensor_fusion
         PointCloudFilter();
 
     private:
+        /// Stages timed on ~stats, "latency" runs from the stamp of the input to publishing
+        enum Stage
+        {
+            STAGE_ROI,
+            STAGE_VOXEL,
+            STAGE_GROUND,
+            STAGE_TF,
+            STAGE_PUBLISH,
+            STAGE_LATENCY
+        };
+
         virtual void onInit();
         void callback(const sensor_msgs::PointCloud2ConstPtr &msg);
+        void process(const sensor_msgs::PointCloud2ConstPtr &msg);
+        template <class PointT>
+        void process(const sensor_msgs::PointCloud2ConstPtr &msg);
+        template <class PointT>
+        void transform_and_publish(const sensor_msgs::PointCloud2ConstPtr &msg, typename pcl::PointCloud<PointT>::Ptr &cloud);
         void failureCallback(const sensor_msgs::PointCloud2ConstPtr &,
                              tf2_ros::filter_failure_reasons::FilterFailureReason);
         void connectCb();
         void disconnectCb();
-        void filter(pcl::PointCloud<pcl::PointXYZ>::Ptr &cloud);
-        void planar_segmentation(pcl::PointCloud<pcl::PointXYZ>::Ptr &cloud);
+        template <class PointT>
+        PreprocessStatus filter(typename pcl::PointCloud<PointT>::Ptr &cloud);
+
+        /// A cloud of the pool no longer used by any subscriber, or a new one added to the pool.
+        template <class PointT>
+        typename pcl::PointCloud<PointT>::Ptr pooled_cloud();
+        std::string log_config(const PreprocessorConfig &config, const std::string &voxel_mode, const std::string &point_type) const;
+
+        /**
+         * Feed the processing time of a frame to the latency controller and apply the leaf size it sets.
+         *
+         * @param start time the processing of the frame started at
+         * @param stamp stamp of the frame
+         */
+        void adapt_leaf_size(const std::chrono::steady_clock::time_point &start, const ros::Time &stamp);
         void info(int);
         ros::NodeHandle nh_;
         ros::NodeHandle private_nh_;
@@ -57,12 +96,22 @@ namespace f1tenth_sensor_fusion
         boost::shared_ptr<PointCloud2MessageFilter> message_filter_;
         ros::Publisher pub_;
         message_filters::Subscriber<sensor_msgs::PointCloud2> sub_;
+        InputQueue<sensor_msgs::PointCloud2> queue_;
+        std::atomic<bool> processing_{false};
+        StageTimers timers_{{"roi", "voxel", "ground", "tf", "publish", "latency"}};
+        CloudPreprocessor preprocessor_;
+        PointType point_type_ = PointType::XYZ; ///< points of the published clouds, the extra fields are read from the input
+        FrameLogWriter log_;                    ///< inputs and outputs of the filter if record_file is set
+        LatencyController controller_;          ///< sets the leaf size if frame_time_budget is set
+
+        template <class PointT>
+        using CloudPool = std::vector<typename pcl::PointCloud<PointT>::Ptr>;
+        /// published clouds, one pool per point type as process() is instantiated for each of them
+        std::tuple<CloudPool<pcl::PointXYZ>, CloudPool<pcl::PointXYZI>, CloudPool<pcl::PointXYZRGB>> cloud_pools_;
         std::string sub_topic_;
         std::string out_topic_;
         std::string target_frame_;
         unsigned int input_queue_size_;
-        bool segmentation;
-        float segmentation_factor;
     };
 }
 
@@ -0,0 +1,64 @@
+/* Copyright 2021 Kovács Gergely Attila
+*
+*   Licensed under the Apache License,
+*   Version 2.0(the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License.
+*
+*/
+
+#ifndef F1TENTH_SENSOR_FUSION__ROI_FILTER_HPP
+#define F1TENTH_SENSOR_FUSION__ROI_FILTER_HPP
+
+#include <f1tenth_sensor_fusion/point_types.hpp>
+#include <sensor_msgs/PointCloud2.h>
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+#include <limits>
+
+namespace f1tenth_sensor_fusion
+{
+    /// Region of interest in the frame of the incoming cloud. The default region contains every finite point.
+    struct RoiConfig
+    {
+        float min_x = std::numeric_limits<float>::lowest(), max_x = std::numeric_limits<float>::max();
+        float min_y = std::numeric_limits<float>::lowest(), max_y = std::numeric_limits<float>::max();
+        float min_height = std::numeric_limits<float>::lowest(), max_height = std::numeric_limits<float>::max(); ///< z band
+        float min_range = 0.f, max_range = std::numeric_limits<float>::max(); ///< distance from the origin of the frame
+    };
+
+    /**
+     * Conversion of PointCloud2 messages keeping only the points inside a region of interest. The points are read
+     * straight from the byte buffer of the message in a single pass, so points outside the region are never copied.
+     */
+    class RoiFilter
+    {
+    public:
+        void set_config(const RoiConfig &config);
+
+        /**
+         * Extract the finite points of a message inside the region of interest. The fields of the point type beyond x,
+         * y and z are read as well, see PointFields. Instantiated for PointXYZ, PointXYZI and PointXYZRGB.
+         *
+         * @param[in] msg the incoming cloud, its x, y and z fields must be FLOAT32
+         * @param[out] cloud the points inside the region, with the header of the message
+         * @return false if the message has no suitable x, y and z fields
+         */
+        template <class PointT>
+        bool extract(const sensor_msgs::PointCloud2 &msg, pcl::PointCloud<PointT> &cloud) const;
+
+    private:
+        RoiConfig config_;
+        float sq_min_range_ = 0.f, sq_max_range_ = std::numeric_limits<float>::max();
+    };
+}
+
+#endif // F1TENTH_SENSOR_FUSION__ROI_FILTER_HPP
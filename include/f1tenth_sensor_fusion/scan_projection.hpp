@@ -0,0 +1,64 @@
+/* Copyright 2021 Kovács Gergely Attila
+*
+*   Licensed under the Apache License,
+*   Version 2.0(the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License.
+*
+*/
+
+#ifndef F1TENTH_SENSOR_FUSION__SCAN_PROJECTION_HPP
+#define F1TENTH_SENSOR_FUSION__SCAN_PROJECTION_HPP
+
+#include <sensor_msgs/LaserScan.h>
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+#include <Eigen/Geometry>
+#include <vector>
+
+namespace f1tenth_sensor_fusion
+{
+    typedef Eigen::Transform<float, 3, Eigen::Affine, Eigen::DontAlign> ScanTransform;
+
+    /**
+     * Projection of LaserScans into point clouds using a precomputed table of beam directions.
+     *
+     * The table holds the direction of every beam already rotated into the target frame, so projecting and
+     * transforming a beam costs a single multiply-add: p = range * direction + translation. It is rebuilt only when
+     * the angle layout of the scans (angle_min, angle_increment, number of beams) or the transform changes.
+     */
+    class ScanProjection
+    {
+    public:
+        /**
+         * Project the beams of a scan into a cloud. A beam is valid if range_min <= range < range_max, same as in
+         * laser_geometry. The points keep the order of the beams. Only the points of the cloud are written, its header
+         * is left to the caller.
+         *
+         * @param[in] scan the scan to project
+         * @param[in] transform transformation from the frame of the scan to the frame of the cloud
+         * @param[out] cloud the projected points, its buffer is reused
+         * @param[in] drop_invalid leave the invalid beams out, otherwise they are NaN points and the cloud has a point
+         *                         for every beam
+         */
+        void project(const sensor_msgs::LaserScan &scan, const ScanTransform &transform, pcl::PointCloud<pcl::PointXYZ> &cloud,
+                     bool drop_invalid = true);
+
+    private:
+        void update_table(const sensor_msgs::LaserScan &scan, const ScanTransform &transform);
+
+        float angle_min_ = 0.f, angle_increment_ = 0.f;
+        ScanTransform transform_ = ScanTransform::Identity();
+        std::vector<Eigen::Vector3f> directions_;
+    };
+}
+
+#endif // F1TENTH_SENSOR_FUSION__SCAN_PROJECTION_HPP
@@ -0,0 +1,118 @@
+/* Copyright 2021 Kovács Gergely Attila
+*
+*   Licensed under the Apache License,
+*   Version 2.0(the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License.
+*
+*/
+
+#ifndef F1TENTH_SENSOR_FUSION__STAGE_TIMERS_HPP
+#define F1TENTH_SENSOR_FUSION__STAGE_TIMERS_HPP
+
+#include <ros/ros.h>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace f1tenth_sensor_fusion
+{
+#ifdef F1TENTH_SENSOR_FUSION_STAGE_TIMERS
+
+    /**
+     * Latency histograms of the processing stages of a nodelet, published periodically as StageStats messages.
+     *
+     * Durations go into logarithmic histograms (four buckets per octave, so percentiles are within 12.5%). Every
+     * thread records into a histogram of its own, claimed on its first sample, so recording is a few uncontended
+     * atomic increments. The histograms are summed and reset when a report is published.
+     */
+    class StageTimers
+    {
+    public:
+        static constexpr size_t NUM_BUCKETS = 160; ///< up to 2^40 ns
+        static constexpr size_t NUM_SLOTS = 8;     ///< threads with a histogram of their own, others share them
+
+        /// @param stages names of the stages, recorded by their index
+        explicit StageTimers(const std::vector<std::string> &stages);
+
+        /// Record the duration of a stage.
+        void record(size_t stage, std::chrono::steady_clock::duration duration);
+
+        /// Record the time passed since a (sensor) stamp, e.g. the latency from acquisition to publishing.
+        void record_since(size_t stage, const ros::Time &stamp);
+
+        /**
+         * Publish the histograms periodically.
+         *
+         * @param nh node handle to advertise the topic with, usually the private one of the nodelet
+         * @param topic name of the topic
+         * @param period [s] time between two reports
+         */
+        void advertise(ros::NodeHandle &nh, const std::string &topic, double period);
+
+    private:
+        void record_ns(size_t stage, uint64_t ns);
+        size_t slot();
+        void publish(const ros::WallTimerEvent &);
+
+        std::vector<std::string> stages_;
+        std::unique_ptr<std::atomic<std::thread::id>[]> owners_;
+        std::unique_ptr<std::atomic<uint32_t>[]> counts_; ///< [slot][stage][bucket]
+        std::unique_ptr<std::atomic<uint64_t>[]> max_;    ///< [slot][stage]
+        ros::Publisher pub_;
+        ros::WallTimer timer_;
+    };
+
+    /// Record the time from its construction to its destruction as the duration of a stage.
+    class ScopedStageTimer
+    {
+    public:
+        ScopedStageTimer(StageTimers &stats, size_t stage)
+            : stats_(stats), stage_(stage), start_(std::chrono::steady_clock::now())
+        {
+        }
+        ~ScopedStageTimer() { stats_.record(stage_, std::chrono::steady_clock::now() - start_); }
+
+        ScopedStageTimer(const ScopedStageTimer &) = delete;
+        ScopedStageTimer &operator=(const ScopedStageTimer &) = delete;
+
+    private:
+        StageTimers &stats_;
+        const size_t stage_;
+        const std::chrono::steady_clock::time_point start_;
+    };
+
+#else
+
+    // Timers compiled out (STAGE_TIMERS=OFF): the same interface, doing nothing
+    class StageTimers
+    {
+    public:
+        explicit StageTimers(const std::vector<std::string> &) {}
+        void record(size_t, std::chrono::steady_clock::duration) {}
+        void record_since(size_t, const ros::Time &) {}
+        void advertise(ros::NodeHandle &, const std::string &, double) {}
+    };
+
+    class ScopedStageTimer
+    {
+    public:
+        ScopedStageTimer(StageTimers &, size_t) {}
+    };
+
+#endif
+}
+
+#endif // F1TENTH_SENSOR_FUSION__STAGE_TIMERS_HPP
@@ -0,0 +1,201 @@
+/* Copyright 2021 Kovács Gergely Attila
+*
+*   Licensed under the Apache License,
+*   Version 2.0(the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License.
+*
+*/
+
+
+#ifndef F1TENTH_SENSOR_FUSION__TRACK_FILTERS_HPP
+#define F1TENTH_SENSOR_FUSION__TRACK_FILTERS_HPP
+
+#include <f1tenth_sensor_fusion/kalman_filter_bank.hpp>
+#include <f1tenth_sensor_fusion/motion_models.hpp>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace f1tenth_sensor_fusion
+{
+    /**
+     * Parse the name of a motion model as given in the parameter files.
+     *
+     * @param[in] name one of "cv", "ca", "ctrv" or "imm"
+     * @param[out] model the parsed model, left untouched on failure
+     * @return false if the name is not recognized
+     */
+    bool parse_motion_model(const std::string &name, MotionModel &model);
+
+    /**
+     * Interface of the filters of the tracked objects. Filters live in slots that are reused after being released, so
+     * creating a track does not allocate once the slots have grown to the number of objects in the scene.
+     */
+    class TrackFilters
+    {
+    public:
+        virtual ~TrackFilters() {}
+
+        /// Take a slot and initialize its filter at the measured position of a new track.
+        virtual size_t allocate(const PlanarVector &z) = 0;
+        virtual void release(size_t slot) = 0;
+
+        /// Advance every filter by dt [s].
+        virtual void predict(float dt) = 0;
+
+        /// Queue a measurement for the filter in the given slot, applied by the next call to correct().
+        virtual void set_measurement(size_t slot, const PlanarVector &z) = 0;
+        virtual void correct() = 0;
+
+        virtual PlanarVector position(size_t slot) const = 0;
+        virtual PlanarVector velocity(size_t slot) const = 0;
+        virtual StateVariance variance(size_t slot) const = 0;
+    };
+
+    /**
+     * Filters of a linear model, in a KalmanFilterBank. The transition and the process noise only depend on the time
+     * step, so they are shared by every filter and rebuilt only when the step changes.
+     */
+    template <class Model>
+    class LinearTrackFilters : public TrackFilters
+    {
+    public:
+        typedef KalmanFilterBank<Model::StateDim, 2> FilterBank;
+
+        explicit LinearTrackFilters(const MotionModelConfig &config) : config_(config)
+        {
+            Model::initial_covariance(config_, P0_);
+            // the filters of the first frame are allocated before any prediction, with the initial covariance as well
+            set_step(config_.frame_period);
+        }
+
+        size_t allocate(const PlanarVector &z) override { return bank_.allocate(z); }
+        void release(size_t slot) override { bank_.release(slot); }
+
+        void predict(float dt) override
+        {
+            if (dt != dt_)
+                set_step(dt);
+            bank_.predict();
+        }
+
+        void set_measurement(size_t slot, const PlanarVector &z) override { bank_.set_measurement(slot, z); }
+        void correct() override { bank_.correct(); }
+
+        PlanarVector position(size_t slot) const override { return PlanarVector(bank_.state(slot, 0), bank_.state(slot, 1)); }
+        PlanarVector velocity(size_t slot) const override { return PlanarVector(bank_.state(slot, 2), bank_.state(slot, 3)); }
+        StateVariance variance(size_t slot) const override
+        {
+            return StateVariance(bank_.covariance(slot, 0, 0), bank_.covariance(slot, 1, 1), bank_.covariance(slot, 2, 2),
+                                 bank_.covariance(slot, 3, 3));
+        }
+
+    private:
+        void set_step(float dt)
+        {
+            typename FilterBank::StateMatrix F, Q;
+            Model::transition(dt, F);
+            Model::process_noise(Model::State::Zero(), dt, config_, Q);
+            const float r = config_.measurement_noise * config_.measurement_noise;
+            bank_.set_model(F, Q, FilterBank::MeasMatrix::Identity() * r, P0_);
+            dt_ = dt;
+        }
+
+        MotionModelConfig config_;
+        typename FilterBank::StateMatrix P0_;
+        FilterBank bank_;
+        float dt_ = -1.f;
+    };
+
+    /**
+     * Filters of a nonlinear model, one Ekf or Imm per slot. The slots are a contiguous array of fixed-size filters, so
+     * a prediction or correction touches a single cache-friendly block per track.
+     */
+    template <class Filter>
+    class NonlinearTrackFilters : public TrackFilters
+    {
+    public:
+        explicit NonlinearTrackFilters(const MotionModelConfig &config) : config_(config)
+        {
+            const float r = config_.measurement_noise * config_.measurement_noise;
+            R_ = Filter::MeasMatrix::Identity() * r;
+        }
+
+        size_t allocate(const PlanarVector &z) override
+        {
+            if (free_.empty())
+            {
+                free_.push_back(filters_.size());
+                filters_.emplace_back();
+                measurements_.emplace_back();
+                state_.push_back(FREE);
+            }
+            const size_t slot = free_.back();
+            free_.pop_back();
+            filters_[slot].init(z, config_);
+            state_[slot] = ACTIVE;
+            return slot;
+        }
+
+        void release(size_t slot) override
+        {
+            state_[slot] = FREE;
+            free_.push_back(slot);
+        }
+
+        void predict(float dt) override
+        {
+            for (size_t s = 0; s < filters_.size(); s++)
+                if (state_[s] != FREE)
+                    filters_[s].predict(dt, config_);
+        }
+
+        void set_measurement(size_t slot, const PlanarVector &z) override
+        {
+            measurements_[slot] = z;
+            state_[slot] = MEASURED;
+        }
+
+        void correct() override
+        {
+            for (size_t s = 0; s < filters_.size(); s++)
+                if (state_[s] == MEASURED)
+                {
+                    filters_[s].correct(measurements_[s], R_);
+                    state_[s] = ACTIVE;
+                }
+        }
+
+        PlanarVector position(size_t slot) const override { return filters_[slot].position(); }
+        PlanarVector velocity(size_t slot) const override { return filters_[slot].velocity(); }
+        StateVariance variance(size_t slot) const override { return filters_[slot].variance(); }
+
+    private:
+        enum SlotState : char
+        {
+            FREE,
+            ACTIVE,
+            MEASURED
+        };
+
+        MotionModelConfig config_;
+        typename Filter::MeasMatrix R_;
+        std::vector<Filter> filters_;
+        std::vector<PlanarVector> measurements_;
+        std::vector<SlotState> state_;
+        std::vector<size_t> free_;
+    };
+
+    std::unique_ptr<TrackFilters> make_track_filters(const MotionModelConfig &config);
+}
+
+#endif // F1TENTH_SENSOR_FUSION__TRACK_FILTERS_HPP
@@ -18,6 +18,7 @@
 #ifndef F1TENTH_SENSOR_FUSION__TRACKER_CONFIG_HPP
 #define F1TENTH_SENSOR_FUSION__TRACKER_CONFIG_HPP
 
+#include <f1tenth_sensor_fusion/motion_models.hpp>
 #include <iostream>
 #include <ros/ros.h>
 #include <visualization_msgs/Marker.h>
@@ -57,6 +58,22 @@ namespace f1tenth_sensor_fusion
             ss << "\tscan topic:\t" << scan_topic << endl;
             ss << "\ttarget frame:\t" << target_frame << endl;
             ss << "\tvisualize:\t" << rviz << endl;
+            ss << "\ttransform objects:\t" << transform_objects << endl;
+            ss << "\tclustering:\t" << clustering << endl;
+            ss << "\tseed gate:\t" << seed_gate << endl;
+            ss << "\tfull clustering interval:\t" << full_clustering_interval << endl;
+            ss << "\tassignment:\t" << assignment << endl;
+            ss << "\tmax match distance:\t" << max_match_distance << endl;
+            ss << "\tmax missed frames:\t" << max_missed << endl;
+            ss << "\tparallel frames:\t" << parallel_frames << endl;
+            ss << "\tqueue policy:\t" << queue_policy << endl;
+            ss << "\tqueue size:\t" << queue_size << endl;
+            ss << "\tqueue deadline:\t" << queue_deadline << endl;
+            ss << "\tcluster topics:\t" << cluster_topics << endl;
+            ss << "\ttrack deltas:\t" << track_deltas << endl;
+            ss << "\tmotion model:\t" << motion_model << endl;
+            ss << "\tframe period:\t" << motion.frame_period << endl;
+            ss << "\tmax frame gap:\t" << motion.max_frame_gap << endl;
             cout << ss.str() << endl;
         }
         bool rviz;
@@ -64,6 +81,30 @@ namespace f1tenth_sensor_fusion
         double tolerance;
         string scan_frame, target_frame, scan_topic, tracker_name;
         int marker_type;
+        string clustering = "euclidean";
+        double seed_gate = 0.5;           ///< [m]
+        int full_clustering_interval = 10; ///< frames between clusterings of the whole cloud in seeded mode
+        string assignment = "hungarian";
+        double max_match_distance = 0.0;
+        int max_missed = 20; ///< consecutive frames a track is kept without a matched cluster
+        bool transform_objects = false;
+        int parallel_frames = 0; ///< frames clustered at once, 0 for one per thread
+        string queue_policy = "fifo";
+        int queue_size = 0;            ///< capacity of the input queue, 0 for one frame per thread
+        double queue_deadline = 0.1;   ///< [s]
+        double queue_stats_period = 1.0; ///< [s]
+        double stats_period = 1.0;       ///< [s]
+        int cluster_topics = 10;         ///< clusters published on topics of their own, advertised at start
+        string motion_model = "cv";
+        MotionModelConfig motion; ///< noises of the motion model, its type is parsed from motion_model
+        string record_file;       ///< frame log of the inputs and outputs of the tracker, none if empty
+        bool track_deltas = false;          ///< publish only the tracks that changed, between keyframes
+        int track_keyframe_interval = 10;   ///< frames between keyframes listing every track
+        double track_delta_distance = 0.05; ///< [m]
+        double track_delta_speed = 0.1;     ///< [m/s]
+        double frame_time_budget = 0.0;     ///< [s] processing time per frame the point budget is adapted to, 0 to disable
+        int min_point_budget = 2000;        ///< points clustered per frame at the coarsest operating point
+        int max_point_budget = 20000;       ///< points clustered per frame at the finest operating point
     };
 }
 
@@ -0,0 +1,86 @@
+/* Copyright 2021 Kovács Gergely Attila
+*
+*   Licensed under the Apache License,
+*   Version 2.0(the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License.
+*
+*/
+
+#ifndef F1TENTH_SENSOR_FUSION__TRACKER_POOL_HPP
+#define F1TENTH_SENSOR_FUSION__TRACKER_POOL_HPP
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <vector>
+
+namespace f1tenth_sensor_fusion
+{
+    /**
+     * Worker threads shared by the trackers of several inputs. An input notifies the pool for every frame it queued,
+     * and a free worker processes a frame of the input with the highest priority waiting, the longest waiting one
+     * among inputs of the same priority. So the inputs never run on more threads than the pool has, however many
+     * there are, and a busy low priority input only delays the others by the frame a worker is processing.
+     */
+    class TrackerPool
+    {
+    public:
+        /// Process a frame of the input, returns false if there was none or every workspace of the input is busy.
+        typedef std::function<bool()> ProcessFn;
+
+        /// @param threads number of workers, 0 for one per core
+        explicit TrackerPool(int threads);
+        ~TrackerPool();
+
+        /**
+         * Add an input, only before start().
+         *
+         * @param process called by a worker for every notification of the input
+         * @param priority inputs with a higher priority are processed first
+         * @return the index of the input, to notify the pool with
+         */
+        size_t add(ProcessFn process, int priority);
+
+        /// Start the workers.
+        void start();
+
+        /// Stop the workers once they finished their frame, later notifications are ignored.
+        void stop();
+
+        /// A frame of an input is waiting. Thread safe, called by the subscription callbacks of the inputs.
+        void notify(size_t input);
+
+        size_t threads() const { return num_threads_; }
+
+    private:
+        struct Input
+        {
+            ProcessFn process;
+            int priority;
+        };
+
+        void run();
+
+        size_t num_threads_;
+        std::vector<Input> inputs_;
+        boost::mutex mutex_;
+        boost::condition_variable cond_;
+        std::deque<size_t> pending_; ///< inputs notified, in the order of the notifications
+        bool stopping_ = false;
+        boost::thread_group workers_;
+    };
+}
+
+#endif // F1TENTH_SENSOR_FUSION__TRACKER_POOL_HPP
@@ -19,27 +19,128 @@
 #define F1TENTH_SENSOR_FUSION__TRACKERS_H
 
 #include <f1tenth_sensor_fusion/cluster_tracker.h>
+#include <f1tenth_sensor_fusion/scan_projection.hpp>
+#include <f1tenth_sensor_fusion/tracker_pool.hpp>
 #include <nodelet/nodelet.h>
+#include <sensor_msgs/LaserScan.h>
+#include <memory>
+#include <vector>
 
 namespace f1tenth_sensor_fusion
 {
 
-    class LidarTracker : protected ClusterTracker, public nodelet::Nodelet
+    /// Interface of the trackers of CloudTrackerNodelet, hiding the point type they were instantiated for.
+    class CloudTrackerBase
     {
     public:
-        LidarTracker();
+        virtual ~CloudTrackerBase() {}
+
+        /**
+         * Load the parameters of the tracker and start it.
+         *
+         * @param handle node handle used if the tracker is explicitly single threaded
+         * @param mt_handle multi-threaded node handle used otherwise
+         * @param private_handle node handle of the parameters
+         */
+        virtual void start(const ros::NodeHandle &handle, const ros::NodeHandle &mt_handle, const ros::NodeHandle &private_handle) = 0;
+
+        /**
+         * Load the parameters of the tracker and start it on the workers of a pool, with the priority parameter.
+         *
+         * @param mt_handle multi-threaded node handle of the subscription and the outputs
+         * @param private_handle node handle of the parameters
+         * @param pool the pool processing the frames, not started yet
+         */
+        virtual void start_pooled(const ros::NodeHandle &mt_handle, const ros::NodeHandle &private_handle, TrackerPool &pool) = 0;
+    };
+
+    template <class PointT>
+    class CloudTracker : public CloudTrackerBase, protected ClusterTracker<PointT>
+    {
+    public:
+        explicit CloudTracker(const TrackerConfig &config) { this->_config = config; }
+        void start(const ros::NodeHandle &handle, const ros::NodeHandle &mt_handle, const ros::NodeHandle &private_handle) override;
+        void start_pooled(const ros::NodeHandle &mt_handle, const ros::NodeHandle &private_handle, TrackerPool &pool) override;
+    };
+
+    /// Create the tracker of a point type, with the defaults of the given configuration.
+    std::unique_ptr<CloudTrackerBase> make_cloud_tracker(PointType type, const TrackerConfig &config);
+
+    /**
+     * Nodelet tracking the clusters of a point cloud topic. The point type of the clouds is selected by the point_type
+     * parameter, so the published clusters keep the intensity or colour of the input.
+     */
+    class CloudTrackerNodelet : public nodelet::Nodelet
+    {
+    protected:
+        explicit CloudTrackerNodelet(const TrackerConfig &config) : config_(config) {}
+        virtual void onInit();
 
     private:
+        TrackerConfig config_; ///< defaults of the parameters
+        std::unique_ptr<CloudTrackerBase> tracker_;
+    };
+
+    /**
+     * Nodelet tracking several point cloud topics on one pool of worker threads, e.g. every LiDAR and camera of the
+     * car. The inputs are named by the inputs parameter, each one takes the parameters of the tracker nodelets from
+     * the private namespace of its name and publishes its outputs under its name.
+     */
+    class MultiTrackerNodelet : public nodelet::Nodelet
+    {
+    public:
+        ~MultiTrackerNodelet();
+
+    protected:
         virtual void onInit();
+
+    private:
+        std::unique_ptr<TrackerPool> pool_;
+        std::vector<std::unique_ptr<CloudTrackerBase>> trackers_;
+    };
+
+    class LidarTracker : public CloudTrackerNodelet
+    {
+    public:
+        LidarTracker();
     };
 
-    class CameraTracker : protected ClusterTracker, public nodelet::Nodelet
+    class CameraTracker : public CloudTrackerNodelet
     {
     public:
         CameraTracker();
+    };
+
+    /**
+     * LiDAR tracker subscribing to the LaserScan messages directly. Scans are projected into the subscription frame
+     * and handed to the clustering without the PointCloud2 conversion of laserscan_to_pointcloud_nodelet.
+     */
+    class ScanTracker : protected ClusterTracker<pcl::PointXYZ>, public nodelet::Nodelet
+    {
+    public:
+        ScanTracker();
 
     protected:
         virtual void onInit();
+        virtual int _load_params();
+        virtual void _subscribe();
+        virtual void _unsubscribe();
+
+    private:
+        void scanCallback(const sensor_msgs::LaserScan::ConstPtr &scan);
+
+        /// Look up the transform from the frame of the scan to the subscription frame, unless it is cached already.
+        bool update_scan_transform(const std_msgs::Header &header);
+
+        message_filters::Subscriber<sensor_msgs::LaserScan> scan_sub_;
+        ScanProjection projection_;
+        ScanTransform scan_transform_ = ScanTransform::Identity();
+        /// Clouds the scans are projected into, a cloud is reused once the tracker released it.
+        std::vector<pcl::PointCloud<pcl::PointXYZ>::Ptr> cloud_pool_;
+        std::string laser_frame_;
+        bool static_transform_;
+        bool transform_cached_ = false;
+        bool callback_registered_ = false;
     };
 }
 
@@ -0,0 +1,98 @@
+/* Copyright 2021 Kovács Gergely Attila
+*
+*   Licensed under the Apache License,
+*   Version 2.0(the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License.
+*
+*/
+
+#ifndef F1TENTH_SENSOR_FUSION__VOXEL_FILTER_HPP
+#define F1TENTH_SENSOR_FUSION__VOXEL_FILTER_HPP
+
+#include <f1tenth_sensor_fusion/point_types.hpp>
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace f1tenth_sensor_fusion
+{
+    enum class VoxelMode
+    {
+        CENTROID,   ///< every voxel is replaced by the centroid of its points, like pcl::VoxelGrid, the other fields averaged too
+        APPROXIMATE ///< every voxel keeps the first of its points, no accumulation
+    };
+
+    /**
+     * Parse the name of a voxel mode as given in the parameter files.
+     *
+     * @param[in] name either "centroid" or "approximate"
+     * @param[out] mode the parsed mode, left untouched on failure
+     * @return false if the name is not recognized
+     */
+    bool parse_voxel_mode(const std::string &name, VoxelMode &mode);
+
+    /**
+     * Voxel grid downsampling in O(N), without sorting the points.
+     *
+     * Voxels are looked up in an open addressing hash table. The table and the accumulators are kept between frames
+     * and only grow, and entries of earlier frames are invalidated by a generation counter instead of clearing the
+     * table, so a frame of a size seen before does not allocate. The output is written into the input cloud, the
+     * voxels ordered by their first point. Non-finite points are dropped.
+     */
+    class VoxelDownsampler
+    {
+    public:
+        explicit VoxelDownsampler(float leaf_size = 0.01f, VoxelMode mode = VoxelMode::CENTROID);
+
+        void set_leaf_size(float leaf_size) { inv_leaf_ = 1.f / leaf_size; }
+        void set_mode(VoxelMode mode) { mode_ = mode; }
+
+        /**
+         * Downsample a cloud in place. Instantiated for PointXYZ, PointXYZI and PointXYZRGB.
+         *
+         * @param cloud the cloud to downsample, resized to the number of occupied voxels
+         */
+        template <class PointT>
+        void filter(pcl::PointCloud<PointT> &cloud);
+
+    private:
+        struct Entry
+        {
+            uint64_t key;
+            uint32_t generation; ///< the entry is empty unless it was written in the current frame
+            uint32_t voxel;      ///< index of the voxel in the output
+        };
+
+        struct Accumulator
+        {
+            float x, y, z;
+            uint32_t count;
+        };
+
+        void reserve(size_t num_points);
+
+        /// Find the voxel of a key, or register the next voxel index for it. Returns true if the voxel is new.
+        bool lookup(uint64_t key, uint32_t next_voxel, uint32_t &voxel);
+
+        float inv_leaf_;
+        VoxelMode mode_;
+        uint32_t generation_ = 0;
+        std::vector<Entry> table_;
+        size_t mask_ = 0;
+        std::vector<Accumulator> accumulators_;
+        std::vector<float> channels_; ///< sums of the fields besides x, y and z, PointFields::CHANNELS per voxel
+    };
+}
+
+#endif // F1TENTH_SENSOR_FUSION__VOXEL_FILTER_HPP
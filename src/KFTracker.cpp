@@ -16,42 +16,68 @@
 */
 
 #include <f1tenth_sensor_fusion/KFTracker.hpp>
+#include <algorithm>
+#include <cmath>
 
 namespace f1tenth_sensor_fusion
 {
-    void KFTracker::_init_KFilters(size_t n)
-    {
-        int stateDim = 4; // [x, y, v_x, v_y]
-        int measDim = 2;
-        float dx = 1.0f, dy = dx, dvx = 0.01f, dvy = dvx;
-        double sigmaP = 0.01, sigmaQ = 0.1;
-        boost::mutex::scoped_lock lock(mutex_);
-        for (size_t i = 0; i < n; i++)
+    KFTracker::KFTracker()
+        : k_filters_(make_track_filters(motion_)), solver_(make_assignment_solver(AssignmentMethod::GATED_NEAREST))
+    {
+    }
+
+    void KFTracker::set_assignment(AssignmentMethod method, float max_distance)
+    {
+        solver_ = make_assignment_solver(method);
+        max_match_distance_ = max_distance;
+    }
+
+    void KFTracker::set_max_missed(int frames)
+    {
+        max_missed_ = static_cast<uint32_t>(std::max(frames, 0));
+    }
+
+    void KFTracker::set_motion_model(const MotionModelConfig &config)
+    {
+        // the slots of the tracked objects are released to the bank they come from, before it is replaced
+        reset();
+        motion_ = config;
+        k_filters_ = make_track_filters(motion_);
+        slot_index_.clear();
+        slot_generation_.clear();
+    }
+
+    void KFTracker::_init_KFilter(const pcl::PointXYZ &pt)
+    {
+        const size_t slot = k_filters_->allocate(_measurement(pt));
+        if (slot >= slot_index_.size())
         {
-            auto _filt = std::make_unique<cv::KalmanFilter>(stateDim, measDim);
-            _filt->transitionMatrix = (cv::Mat_<float>(4, 4) << dx, 0, 1, 0, 0, dy, 0, 1, 0, 0, dvx, 0, 0, 0, 0, dvy);
-            cv::setIdentity(_filt->measurementMatrix);
-            cv::setIdentity(_filt->processNoiseCov, cv::Scalar::all(sigmaP));
-            cv::setIdentity(_filt->measurementNoiseCov, cv::Scalar(sigmaQ));
-            k_filters_.push_back(std::move(_filt));
+            slot_index_.resize(slot + 1, -1);
+            slot_generation_.resize(slot + 1, 0);
         }
+        slot_index_[slot] = static_cast<int>(filter_slots_.size());
+        filter_slots_.push_back(slot);
+        track_info_.push_back(TrackInfo{next_id_++, 1, 0});
     }
 
-    std::pair<int, int> KFTracker::find_min_IDX(const float *mat, const size_t row, const size_t col)
+    void KFTracker::release_slot(size_t slot)
     {
-        std::pair<int, int> minIndex(-1, -1); // needed for preventing a cluster to be registered to multiple filters in case
-                                              // there were more filters than detected clusters
-        float minEl = std::numeric_limits<float>::max();
-        for (int pp = 0; pp < row; pp++)  // for each predicted point pp
-            for (int c = 0; c < col; c++) // for each centre c
-            {
-                if (mat[pp * col + c] < minEl)
-                {
-                    minEl = mat[pp * col + c];
-                    minIndex = std::make_pair(pp, c);
-                }
-            }
-        return minIndex;
+        k_filters_->release(slot);
+        slot_index_[slot] = -1;
+        slot_generation_[slot]++;
+    }
+
+    bool KFTracker::update_track_info(const boost::container::vector<int> &objID)
+    {
+        bool expired = false;
+        for (size_t i = 0; i < objID.size(); i++)
+        {
+            TrackInfo &info = track_info_[i];
+            info.age++;
+            info.missed = objID[i] == -1 ? info.missed + 1 : 0;
+            expired |= info.missed > max_missed_;
+        }
+        return expired;
     }
 
     void KFTracker::correct_kfilter_matrices(const PointVector &cCentres, const boost::container::vector<int> &objID)
@@ -60,135 +86,153 @@ namespace f1tenth_sensor_fusion
         {
             if (objID[i] == -1)
                 continue;
-            float meas[2] = {cCentres[objID[i]].x, cCentres[objID[i]].y};
-            cv::Mat measMat = cv::Mat(2, 1, CV_32F, meas);
-            if (!(meas[0] == 0.0f || meas[1] == 0.0f))
-                k_filters_[i]->correct(measMat);
+            const pcl::PointXYZ &c = cCentres[objID[i]];
+            if (!(c.x == 0.0f || c.y == 0.0f))
+                k_filters_->set_measurement(filter_slots_[i], _measurement(c));
         }
+        k_filters_->correct();
     }
 
-    PointVector KFTracker::generate_predictions()
+    void KFTracker::generate_predictions(float dt)
     {
-        PointVector pred;
-        for (auto it = k_filters_.begin(); it != k_filters_.end(); it++)
-        {
-            auto p = (*it)->predict();
-            pcl::PointXYZ pt;
-            pt.x = p.at<float>(0);
-            pt.y = p.at<float>(1);
-            pt.z = p.at<float>(2);
+        k_filters_->predict(dt);
 
-            pred.push_back(pt);
+        predictions_.clear();
+        for (size_t slot : filter_slots_)
+        {
+            const PlanarVector p = k_filters_->position(slot);
+            predictions_.push_back(pcl::PointXYZ(p.x(), p.y(), 0.f));
         }
-        return pred;
     }
 
-    void KFTracker::create_kfilters_for_new_clusters(boost::container::vector<int> &objID, const PointVector &centres, const bool *cluster_used)
+    void KFTracker::create_kfilters_for_new_clusters(boost::container::vector<int> &objID, const PointVector &centres,
+                                                     const boost::container::vector<bool> &cluster_used)
     {
-        size_t diff = centres.size() - objID.size();
-        _init_KFilters(diff);
-        objID.resize(k_filters_.size(), -1);
-        int f = 0, c = 0;
-        while (f != k_filters_.size() && c != centres.size())
+        // Every cluster left unmatched (new, or outside the gate of each prediction) gets a filter of its own,
+        // filters that lost their cluster are kept until they are pruned
+        for (size_t c = 0; c < centres.size(); c++)
         {
-            if (objID[f] != -1) // tracked object
-            {
-                f++;
-            }
-            else if (cluster_used[c])
-                c++;
-            else
-            {
-                _set_kfilter_state_pre(k_filters_[f], centres[c]);
-                f++;
-                c++;
-            }
+            if (cluster_used[c])
+                continue;
+            _init_KFilter(centres[c]);
+            objID.push_back(c);
         }
     }
 
     void KFTracker::prune_unused_kfilters(boost::container::vector<int> &objID)
     {
-        size_t deleted = 0, i = 0;
-        for (auto it = objID.begin(); it != objID.end(); it++)
+        // release the slots of the filters unmatched for too long and compact the remaining ones in a single pass
+        size_t kept = 0;
+        for (size_t i = 0; i < objID.size(); i++)
         {
-            if (*it == -1) // no matching cluster for this filter
+            if (track_info_[i].missed > max_missed_)
             {
-                objID.erase(it--); // remove '-1' from objID --> thus sizes of filters and objects remain the same
-                k_filters_.erase(k_filters_.begin() + i - deleted++);
+                release_slot(filter_slots_[i]);
+                continue;
             }
-            i++;
+            objID[kept] = objID[i];
+            filter_slots_[kept] = filter_slots_[i];
+            track_info_[kept] = track_info_[i];
+            slot_index_[filter_slots_[kept]] = static_cast<int>(kept);
+            kept++;
         }
-        kf_prune_ctr_ = 0;
+        // sizes of filters and objects remain the same
+        objID.resize(kept);
+        filter_slots_.resize(kept);
+        track_info_.resize(kept);
     }
 
-    boost::container::vector<int> KFTracker::match_objID(const PointVector &pred, const PointVector &cCentres, bool *cluster_used)
+    void KFTracker::match_objID(const PointVector &cCentres, boost::container::vector<int> &objID)
     {
-        boost::container::vector<int> vec(pred.size(), -1); // Initializing object ID vector with negative ones
+        solver_->solve(predictions_, cCentres, max_match_distance_, objID);
 
-        // Generating distance matrix to make cross-compliance between centres and KF-s easier
-        // rows: predicted points (indirectly the KFilter)
-        // columns: the detected centres
-        float *distMatrix = new float[pred.size() * cCentres.size()];
+        cluster_used_.assign(cCentres.size(), false);
+        for (int c : objID)
+            if (c != -1)
+                cluster_used_[c] = true; // record that this cluster was matched
+    }
 
-        for (size_t i = 0; i < pred.size(); ++i)
-            for (size_t k = 0; k < cCentres.size(); ++k)
-                distMatrix[i * cCentres.size() + k] = euclidian_dst(pred[i], cCentres[k]);
+    void KFTracker::reset()
+    {
+        for (size_t slot : filter_slots_)
+            release_slot(slot);
+        filter_slots_.clear();
+        track_info_.clear();
+        initialized_ = false;
+    }
 
-        // Matching objectID to KF
-        for (size_t i = 0; i < k_filters_.size(); i++)
+    void KFTracker::positions(PointVector &positions) const
+    {
+        positions.clear();
+        for (size_t slot : filter_slots_)
         {
-            std::pair<int, int> minIdx(find_min_IDX(distMatrix, pred.size(), cCentres.size())); // find closest match
-            if (minIdx.first != -1)                                                             // if a match was found, then
-            {
-                vec[minIdx.first] = minIdx.second;  // save this match
-                cluster_used[minIdx.second] = true; // record that this cluster was matched
-
-                for (size_t c = 0; c < cCentres.size(); ++c)
-                    distMatrix[minIdx.first * cCentres.size() + c] = std::numeric_limits<float>::max(); // erase the row (filter)
-                for (size_t r = 0; r < pred.size(); r++)                                                // erase the column (point cloud)
-                    distMatrix[r * cCentres.size() + minIdx.second] = std::numeric_limits<float>::max();
-            }
+            const PlanarVector p = k_filters_->position(slot);
+            positions.push_back(pcl::PointXYZ(p.x(), p.y(), 0.f));
         }
+    }
 
-        delete distMatrix;
-
-        return vec;
+    void KFTracker::tracks(boost::container::vector<TrackState> &tracks) const
+    {
+        tracks.clear();
+        for (size_t i = 0; i < filter_slots_.size(); i++)
+        {
+            const size_t slot = filter_slots_[i];
+            const TrackInfo &info = track_info_[i];
+            const TrackHandle handle{static_cast<uint32_t>(slot), slot_generation_[slot]};
+            tracks.push_back(TrackState{info.id, handle, k_filters_->position(slot), k_filters_->velocity(slot), k_filters_->variance(slot),
+                                        info.age, info.missed});
+        }
     }
 
-    void KFTracker::initialize(const PointVector &cCentres)
+    void KFTracker::initialize(const PointVector &cCentres, double stamp)
     {
-        _init_KFilters(cCentres.size());
         for (size_t i = 0; i < cCentres.size(); i++)
         {
-            _set_kfilter_state_pre(k_filters_[i], cCentres[i]);
+            _init_KFilter(cCentres[i]);
         }
+        initialized_ = true;
+        last_stamp_ = stamp;
     }
 
-    boost::container::vector<int> KFTracker::track(const PointVector &cCentres)
+    FrameStatus KFTracker::track(const PointVector &cCentres, double stamp, boost::container::vector<int> &objID)
     {
-        PointVector predicted_pts = generate_predictions();
-
-        bool cluster_used[cCentres.size()];
-        for (auto b : cluster_used)
-            b = false;
+        float dt = motion_.frame_period;
+        if (initialized_ && stamp != 0.0 && last_stamp_ != 0.0)
+        {
+            const double elapsed = stamp - last_stamp_;
+            // Late frames come from delays upstream, but a large jump back in time is a restarted (e.g. looping) replay
+            if (elapsed < 0.0 && elapsed >= -motion_.max_frame_gap)
+                return FrameStatus::OUT_OF_ORDER;
+            if (std::abs(elapsed) > motion_.max_frame_gap)
+                reset();
+            dt = static_cast<float>(elapsed);
+        }
+        if (!initialized_)
+        {
+            initialize(cCentres, stamp);
+            objID.clear();
+            return FrameStatus::INITIALIZED;
+        }
+        last_stamp_ = stamp;
 
-        boost::container::vector<int> objID = match_objID(predicted_pts, cCentres, cluster_used);
+        generate_predictions(dt);
+        match_objID(cCentres, objID);
+        const bool expired = update_track_info(objID);
 
         // if there are new clusters, initialize new kalman filters with data of unmatched clusters
-        if (objID.size() < cCentres.size())
+        if (std::find(cluster_used_.begin(), cluster_used_.end(), false) != cluster_used_.end())
         {
-            create_kfilters_for_new_clusters(objID, cCentres, cluster_used);
+            create_kfilters_for_new_clusters(objID, cCentres, cluster_used_);
         }
-        // if there are unused filters for some time, delete them
-        else if (cCentres.size() < objID.size() && kf_prune_ctr_++ > prune_interval)
+        // delete the filters that lost their object max_missed_ frames ago, the new ones have not missed any
+        if (expired)
         {
             prune_unused_kfilters(objID);
         }
 
-        if (k_filters_.size() > 0)
+        if (!filter_slots_.empty())
             correct_kfilter_matrices(cCentres, objID);
-
-        return objID;
+        return FrameStatus::TRACKED;
     }
 
-}
\ No newline at end of file
+}
@@ -0,0 +1,144 @@
+/* Copyright 2021 Kovács Gergely Attila
+*
+*   Licensed under the Apache License,
+*   Version 2.0(the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License.
+*
+*/
+
+#include <f1tenth_sensor_fusion/alloc_counter.hpp>
+#include <cstdlib>
+#include <new>
+#include <stdlib.h>
+
+namespace
+{
+    // plain data, so the first access of a thread needs no initialization that could allocate
+    thread_local size_t thread_count = 0;
+}
+
+void *operator new(std::size_t size)
+{
+    thread_count++;
+    if (void *p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void *operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept
+{
+    thread_count++;
+    return std::malloc(size ? size : 1);
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept
+{
+    return operator new(size, std::nothrow);
+}
+
+void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void *p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+#ifdef __cpp_aligned_new
+// Over-aligned types (e.g. fixed-size Eigen members with AVX) are allocated through these since C++17
+void *operator new(std::size_t size, std::align_val_t alignment)
+{
+    thread_count++;
+    // posix_memalign takes powers of two that are multiples of the size of a pointer
+    const std::size_t a = static_cast<std::size_t>(alignment) < sizeof(void *) ? sizeof(void *) : static_cast<std::size_t>(alignment);
+    void *p;
+    if (posix_memalign(&p, a, size ? size : 1) == 0)
+        return p;
+    throw std::bad_alloc();
+}
+
+void *operator new[](std::size_t size, std::align_val_t alignment)
+{
+    return operator new(size, alignment);
+}
+
+void *operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept
+{
+    try
+    {
+        return operator new(size, alignment);
+    }
+    catch (const std::bad_alloc &)
+    {
+        return nullptr;
+    }
+}
+
+void *operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept
+{
+    return operator new(size, alignment, std::nothrow);
+}
+
+void operator delete(void *p, std::align_val_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void *p, std::align_val_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void *p, std::size_t, std::align_val_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void *p, std::size_t, std::align_val_t) noexcept
+{
+    std::free(p);
+}
+#endif
+
+namespace f1tenth_sensor_fusion
+{
+    size_t thread_allocations()
+    {
+        return thread_count;
+    }
+
+    bool allocations_counted()
+    {
+        // a direct call of operator new can not be elided like a new expression
+        const size_t before = thread_count;
+        void *volatile p = ::operator new(1);
+        ::operator delete(p);
+        return thread_count != before;
+    }
+}
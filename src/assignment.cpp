@@ -0,0 +1,190 @@
+/* Copyright 2021 Kovács Gergely Attila
+*
+*   Licensed under the Apache License,
+*   Version 2.0(the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License.
+*
+*/
+
+#include <f1tenth_sensor_fusion/assignment.hpp>
+#include <algorithm>
+#include <limits>
+
+namespace f1tenth_sensor_fusion
+{
+    bool parse_assignment_method(const std::string &name, AssignmentMethod &method)
+    {
+        if (name == "hungarian")
+            method = AssignmentMethod::HUNGARIAN;
+        else if (name == "gated_nearest")
+            method = AssignmentMethod::GATED_NEAREST;
+        else
+            return false;
+        return true;
+    }
+
+    std::unique_ptr<AssignmentSolver> make_assignment_solver(AssignmentMethod method)
+    {
+        if (method == AssignmentMethod::HUNGARIAN)
+            return std::unique_ptr<AssignmentSolver>(new HungarianSolver());
+        return std::unique_ptr<AssignmentSolver>(new GatedNearestSolver());
+    }
+
+    void HungarianSolver::solve(const PointVector &pred, const PointVector &centres, float gate,
+                                boost::container::vector<int> &assignment)
+    {
+        assignment.assign(pred.size(), -1);
+        if (pred.empty() || centres.empty())
+            return;
+
+        // Every prediction gets a dummy column of its own, so the problem is always solvable with n <= m.
+        // Leaving a prediction unmatched costs the gate (or a big constant if gating is disabled), hence
+        // pairs further apart than the gate are never preferred to the dummy.
+        const double forbidden = 1e9;
+        const double dummy = gate > 0 ? gate : forbidden / 2;
+        const size_t n = pred.size(), cols = centres.size(), m = cols + n;
+
+        cost_.resize(n * m);
+        for (size_t i = 0; i < n; i++)
+        {
+            for (size_t j = 0; j < cols; j++)
+            {
+                const double d = planar_dst(pred[i], centres[j]);
+                cost_[i * m + j] = (gate > 0 && d > gate) ? forbidden : d;
+            }
+            std::fill(cost_.begin() + i * m + cols, cost_.begin() + (i + 1) * m, dummy);
+        }
+
+        // Potentials and the matching use 1-based indices, index 0 is the virtual starting column
+        const double inf = std::numeric_limits<double>::max();
+        u_.assign(n + 1, 0.0);
+        v_.assign(m + 1, 0.0);
+        p_.assign(m + 1, 0);
+        way_.assign(m + 1, 0);
+        for (size_t i = 1; i <= n; i++)
+        {
+            p_[0] = i;
+            size_t j0 = 0;
+            minv_.assign(m + 1, inf);
+            used_.assign(m + 1, false);
+            do
+            {
+                used_[j0] = true;
+                const size_t i0 = p_[j0];
+                double delta = inf;
+                size_t j1 = 0;
+                for (size_t j = 1; j <= m; j++)
+                {
+                    if (used_[j])
+                        continue;
+                    const double cur = cost_[(i0 - 1) * m + (j - 1)] - u_[i0] - v_[j];
+                    if (cur < minv_[j])
+                    {
+                        minv_[j] = cur;
+                        way_[j] = j0;
+                    }
+                    if (minv_[j] < delta)
+                    {
+                        delta = minv_[j];
+                        j1 = j;
+                    }
+                }
+                for (size_t j = 0; j <= m; j++)
+                {
+                    if (used_[j])
+                    {
+                        u_[p_[j]] += delta;
+                        v_[j] -= delta;
+                    }
+                    else
+                        minv_[j] -= delta;
+                }
+                j0 = j1;
+            } while (p_[j0] != 0);
+
+            do // invert the augmenting path
+            {
+                const size_t j1 = way_[j0];
+                p_[j0] = p_[j1];
+                j0 = j1;
+            } while (j0);
+        }
+
+        for (size_t j = 1; j <= cols; j++)
+        {
+            if (p_[j] != 0 && cost_[(p_[j] - 1) * m + (j - 1)] < forbidden)
+                assignment[p_[j] - 1] = j - 1;
+        }
+    }
+
+    void GatedNearestSolver::collect_all(const PointVector &pred, const PointVector &centres)
+    {
+        for (size_t i = 0; i < pred.size(); i++)
+            for (size_t c = 0; c < centres.size(); c++)
+                candidates_.push_back({planar_dst(pred[i], centres[c]), static_cast<int>(i), static_cast<int>(c)});
+    }
+
+    void GatedNearestSolver::collect_gated(const PointVector &pred, const PointVector &centres, float gate)
+    {
+        // Bucket the centres into a grid with a cell size equal to the gate: every centre within the gate
+        // of a prediction is then found in the 3x3 neighbourhood of the prediction's cell.
+        grid_.clear();
+        for (size_t c = 0; c < centres.size(); c++)
+        {
+            const int cx = static_cast<int>(std::floor(centres[c].x / gate));
+            const int cy = static_cast<int>(std::floor(centres[c].y / gate));
+            grid_.push_back(std::make_pair(cell_key(cx, cy), static_cast<int>(c)));
+        }
+        std::sort(grid_.begin(), grid_.end());
+
+        for (size_t i = 0; i < pred.size(); i++)
+        {
+            const int cx = static_cast<int>(std::floor(pred[i].x / gate));
+            const int cy = static_cast<int>(std::floor(pred[i].y / gate));
+            for (int dx = -1; dx <= 1; dx++)
+                for (int dy = -1; dy <= 1; dy++)
+                {
+                    const uint64_t key = cell_key(cx + dx, cy + dy);
+                    auto it = std::lower_bound(grid_.begin(), grid_.end(), std::make_pair(key, std::numeric_limits<int>::min()));
+                    for (; it != grid_.end() && it->first == key; it++)
+                    {
+                        const float d = planar_dst(pred[i], centres[it->second]);
+                        if (d <= gate)
+                            candidates_.push_back({d, static_cast<int>(i), it->second});
+                    }
+                }
+        }
+    }
+
+    void GatedNearestSolver::solve(const PointVector &pred, const PointVector &centres, float gate,
+                                   boost::container::vector<int> &assignment)
+    {
+        assignment.assign(pred.size(), -1);
+        candidates_.clear();
+        if (gate > 0)
+            collect_gated(pred, centres, gate);
+        else
+            collect_all(pred, centres);
+
+        // Accepting candidates by increasing distance gives the same result as repeatedly taking the
+        // minimum of the whole distance matrix, without rescanning it.
+        std::sort(candidates_.begin(), candidates_.end());
+        centre_used_.assign(centres.size(), false);
+        for (const Candidate &cand : candidates_)
+        {
+            if (assignment[cand.pred] != -1 || centre_used_[cand.centre])
+                continue;
+            assignment[cand.pred] = cand.centre;
+            centre_used_[cand.centre] = true;
+        }
+    }
+}
@@ -0,0 +1,55 @@
+/* Copyright 2021 Kovács Gergely Attila
+*
+*   Licensed under the Apache License,
+*   Version 2.0(the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License.
+*
+*/
+
+#include <f1tenth_sensor_fusion/cloud_preprocessor.hpp>
+
+namespace f1tenth_sensor_fusion
+{
+    CloudPreprocessor::CloudPreprocessor(const PreprocessorConfig &config)
+    {
+        set_config(config);
+    }
+
+    void CloudPreprocessor::set_config(const PreprocessorConfig &config)
+    {
+        config_ = config;
+        roi_.set_config(config.roi);
+        downsampler_.set_leaf_size(config.leaf_size);
+        downsampler_.set_mode(config.voxel_mode);
+        ground_filter_.set_config(config.ground);
+        ground_filter_.reset();
+    }
+
+    void CloudPreprocessor::set_leaf_size(float leaf_size)
+    {
+        config_.leaf_size = leaf_size;
+        downsampler_.set_leaf_size(leaf_size);
+    }
+
+    template <class PointT>
+    PreprocessStatus CloudPreprocessor::process(const sensor_msgs::PointCloud2 &msg, pcl::PointCloud<PointT> &cloud)
+    {
+        if (!extract(msg, cloud))
+            return PreprocessStatus::NO_XYZ_FIELDS;
+        downsample(cloud);
+        return remove_ground(cloud) ? PreprocessStatus::OK : PreprocessStatus::NO_GROUND;
+    }
+
+    template PreprocessStatus CloudPreprocessor::process(const sensor_msgs::PointCloud2 &, pcl::PointCloud<pcl::PointXYZ> &);
+    template PreprocessStatus CloudPreprocessor::process(const sensor_msgs::PointCloud2 &, pcl::PointCloud<pcl::PointXYZI> &);
+    template PreprocessStatus CloudPreprocessor::process(const sensor_msgs::PointCloud2 &, pcl::PointCloud<pcl::PointXYZRGB> &);
+}
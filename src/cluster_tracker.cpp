@@ -18,16 +18,20 @@
 #include <f1tenth_sensor_fusion/cluster_tracker.h>
 #include <std_msgs/Int32MultiArray.h>
 #include <boost/thread.hpp>
+#include <algorithm>
+#include <cmath>
+#include <limits>
 #include <random>
-#include <tf2_ros/transform_listener.h>
-#include <tf2_geometry_msgs/tf2_geometry_msgs.h>
-#include <pcl/search/kdtree.h>
+#include <sstream>
+#include <f1tenth_sensor_fusion/cloud_transform.hpp>
+#include <pcl/common/io.h>
 #include <pcl_ros/point_cloud.h>
 #include <f1tenth_sensor_fusion/ObjectMessage.h>
 
 namespace f1tenth_sensor_fusion
 {
-    void ClusterTracker::initialize(int concurrency_level)
+    template <class PointT>
+    void ClusterTracker<PointT>::initialize(int concurrency_level)
     {
         srand(time(NULL));
 
@@ -35,9 +39,19 @@ namespace f1tenth_sensor_fusion
         _config.info(concurrency_level);
 #endif
 
-        cluster_extr_.setClusterTolerance(_config.tolerance);
-        cluster_extr_.setMaxClusterSize(_config.clust_max);
-        cluster_extr_.setMinClusterSize(_config.clust_min);
+        ClusteringMethod clustering = ClusteringMethod::EUCLIDEAN;
+        if (!parse_clustering_method(_config.clustering, clustering))
+            ROS_WARN("%s: unknown clustering method '%s', using euclidean", _config.tracker_name.c_str(), _config.clustering.c_str());
+
+        AssignmentMethod method = AssignmentMethod::HUNGARIAN;
+        if (!parse_assignment_method(_config.assignment, method))
+            ROS_WARN("%s: unknown assignment method '%s', using hungarian", _config.tracker_name.c_str(), _config.assignment.c_str());
+        _KFTracker.set_assignment(method, static_cast<float>(_config.max_match_distance));
+        _KFTracker.set_max_missed(_config.max_missed);
+
+        if (!parse_motion_model(_config.motion_model, _config.motion.model))
+            ROS_WARN("%s: unknown motion model '%s', using cv", _config.tracker_name.c_str(), _config.motion_model.c_str());
+        _KFTracker.set_motion_model(_config.motion);
 
         // Only queue one pointcloud per running thread
         if (concurrency_level > 0)
@@ -49,225 +63,719 @@ namespace f1tenth_sensor_fusion
             input_queue_size_ = boost::thread::hardware_concurrency();
         }
 
+        // One workspace per frame that may be clustered concurrently. The ring has room for every workspace, as a
+        // frame keeps its workspace until it is published
+        const size_t num_workspaces =
+            _config.parallel_frames > 0 ? std::min<size_t>(_config.parallel_frames, input_queue_size_) : std::max<size_t>(input_queue_size_, 1);
+        workspaces_.resize(num_workspaces);
+        for (FrameWorkspace &w : workspaces_)
+            w.clustering = make_clustering_backend(clustering, _config.tolerance, _config.clust_min, _config.clust_max, _config.seed_gate,
+                                                   _config.full_clustering_interval);
+        seeded_clustering_ = clustering == ClusteringMethod::SEEDED;
+        workspace_busy_.reset(new std::atomic<bool>[num_workspaces]);
+        for (size_t i = 0; i < num_workspaces; i++)
+            workspace_busy_[i] = false;
+        size_t ring_size = 1;
+        while (ring_size < num_workspaces)
+            ring_size *= 2;
+        ring_.reset(new FrameSlot[ring_size]);
+        ring_mask_ = ring_size - 1;
+
+        // The threads not used for clustering several frames at once split the centroids of a frame, unless the
+        // threads are those of a pool shared with other inputs
+        centroid_threads_ = notify_ ? 1 : static_cast<int>(std::max<size_t>(input_queue_size_ / num_workspaces, 1));
+
+        QueuePolicy policy = QueuePolicy::FIFO;
+        if (!parse_queue_policy(_config.queue_policy, policy))
+            ROS_WARN("%s: unknown queue policy '%s', using fifo", _config.tracker_name.c_str(), _config.queue_policy.c_str());
+        input_queue_.configure(policy, _config.queue_size > 0 ? _config.queue_size : input_queue_size_, _config.queue_deadline);
+        input_queue_.advertise_stats(private_handle_, "queue_stats", _config.queue_stats_period);
+        timers_.advertise(private_handle_, "stats", _config.stats_period);
+#ifdef F1TENTH_SENSOR_FUSION_COUNT_ALLOCATIONS
+        if (!allocations_counted())
+            ROS_WARN("%s: heap allocations are not counted, start the nodelet manager with LD_PRELOAD=liballoc_counter.so",
+                     _config.tracker_name.c_str());
+#endif
+
+        if (_config.frame_time_budget > 0.0)
+        {
+            if (_config.min_point_budget > 0 && _config.min_point_budget <= _config.max_point_budget)
+            {
+                controller_.configure(_config.frame_time_budget, _config.max_point_budget, _config.min_point_budget);
+                controller_.advertise(private_handle_, "operating_point", "point_budget");
+                point_budget_ = static_cast<size_t>(_config.max_point_budget);
+            }
+            else
+                ROS_WARN("%s: the point budgets must be positive with min_point_budget <= max_point_budget, frame_time_budget is ignored",
+                         _config.tracker_name.c_str());
+        }
+
+        if (!_config.record_file.empty())
+        {
+            if (log_.open(_config.record_file))
+                log_.write_config(LogRecord::TRACKER_CONFIG, log_config());
+            else
+                ROS_ERROR("%s: could not create the frame log %s", _config.tracker_name.c_str(), _config.record_file.c_str());
+        }
+
         transform_ = _config.scan_frame.compare(_config.target_frame) == 0 ? false : true;
+        if (transform_)
+            _init_tf();
 
-        // Subscribe to topic with input data
-        sub_.subscribe(handle_, _config.scan_topic.c_str(), input_queue_size_);
-        sub_.registerCallback(boost::bind(&ClusterTracker::cloudCallback, this, _1));
+        // The input is only subscribed while some output has subscribers, see connectCb()
+        ros::SubscriberStatusCallback connect_cb = boost::bind(&ClusterTracker<PointT>::connectCb, this);
+        ros::SubscriberStatusCallback disconnect_cb = boost::bind(&ClusterTracker<PointT>::disconnectCb, this);
+        boost::mutex::scoped_lock lock(connect_mutex_);
         // Init marker publisher if necessary
         if (_config.rviz)
-            marker_pub_ = handle_.advertise<visualization_msgs::MarkerArray>(_config.tracker_name + std::string("/viz"), 100);
-        obj_pub_ = handle_.advertise<ObjectMessage>(_config.tracker_name + std::string("/detections"), 100);
+            marker_pub_ = handle_.advertise<visualization_msgs::MarkerArray>(_config.tracker_name + std::string("/viz"), 100, connect_cb, disconnect_cb);
+        obj_pub_ = handle_.advertise<ObjectMessage>(_config.tracker_name + std::string("/detections"), 100, connect_cb, disconnect_cb);
+        tracks_pub_ = handle_.advertise<TrackArray>(_config.tracker_name + std::string("/tracks"), 100, connect_cb, disconnect_cb);
+        clusters_pub_ = handle_.advertise<pcl::PointCloud<pcl::PointXYZL>>(_config.tracker_name + std::string("/clusters"), 100, connect_cb,
+                                                                            disconnect_cb);
+        advertise_cluster_publishers(connect_cb, disconnect_cb);
     }
 
-    int ClusterTracker::_load_params()
+    template <class PointT>
+    bool ClusterTracker<PointT>::has_subscribers() const
+    {
+        if (marker_pub_.getNumSubscribers() > 0 || obj_pub_.getNumSubscribers() > 0 || tracks_pub_.getNumSubscribers() > 0 ||
+            clusters_pub_.getNumSubscribers() > 0)
+            return true;
+        for (const ros::Publisher &pub : cluster_pubs_)
+            if (pub.getNumSubscribers() > 0)
+                return true;
+        return false;
+    }
+
+    template <class PointT>
+    void ClusterTracker<PointT>::connectCb()
+    {
+        boost::mutex::scoped_lock lock(connect_mutex_);
+        if (subscribed_ || !has_subscribers())
+            return;
+        ROS_INFO("%s: got a subscriber, subscribing to %s", _config.tracker_name.c_str(), _config.scan_topic.c_str());
+        // A frame of the previous subscription may still be tracked, so the tracks are dropped by the ordered stage
+        reset_pending_ = true;
+        _subscribe();
+        subscribed_ = true;
+    }
+
+    template <class PointT>
+    void ClusterTracker<PointT>::disconnectCb()
+    {
+        boost::mutex::scoped_lock lock(connect_mutex_);
+        if (!subscribed_ || has_subscribers())
+            return;
+        ROS_INFO("%s: no subscribers left, unsubscribing from %s", _config.tracker_name.c_str(), _config.scan_topic.c_str());
+        _unsubscribe();
+        input_queue_.clear();
+        subscribed_ = false;
+    }
+
+    template <class PointT>
+    void ClusterTracker<PointT>::_subscribe()
+    {
+        // Callbacks of a subscription are serialized by default, the frame pipeline makes running them concurrently safe
+        ros::SubscribeOptions ops = ros::SubscribeOptions::create<pcl::PointCloud<PointT>>(
+            _config.scan_topic, input_queue_.subscriber_queue_size(), boost::bind(&ClusterTracker<PointT>::cloudCallback, this, _1),
+            ros::VoidPtr(), nullptr);
+        ops.allow_concurrent_callbacks = true;
+        sub_ = handle_.subscribe(ops);
+    }
+
+    template <class PointT>
+    void ClusterTracker<PointT>::_unsubscribe()
+    {
+        sub_.shutdown();
+    }
+
+    template <class PointT>
+    void ClusterTracker<PointT>::_init_tf()
+    {
+        // One buffer for the lifetime of the nodelet, so lookups never wait for a fresh /tf subscription
+        if (tf2_)
+            return;
+        tf2_.reset(new tf2_ros::Buffer());
+        tf2_listener_.reset(new tf2_ros::TransformListener(*tf2_));
+    }
+
+    template <class PointT>
+    int ClusterTracker<PointT>::_load_params()
     {
         _config.rviz = private_handle_.param<bool>("visualize_rviz", _config.rviz);
         _config.tolerance = private_handle_.param<double>("tolerance", _config.tolerance);
         _config.clust_max = private_handle_.param<int>("max_cluster_size", _config.clust_max);
         _config.clust_min = private_handle_.param<int>("min_cluster_size", _config.clust_min);
         _config.marker_size = private_handle_.param<int>("marker_size", _config.marker_size);
+        _config.transform_objects = private_handle_.param<bool>("transform_objects", _config.transform_objects);
+        _config.max_match_distance = private_handle_.param<double>("max_match_distance", _config.max_match_distance);
+        _config.max_missed = private_handle_.param<int>("max_missed", _config.max_missed);
+        _config.parallel_frames = private_handle_.param<int>("parallel_frames", _config.parallel_frames);
+        _config.queue_size = private_handle_.param<int>("queue_size", _config.queue_size);
+        _config.queue_deadline = private_handle_.param<double>("queue_deadline", _config.queue_deadline);
+        _config.queue_stats_period = private_handle_.param<double>("queue_stats_period", _config.queue_stats_period);
+        _config.stats_period = private_handle_.param<double>("stats_period", _config.stats_period);
+        _config.cluster_topics = private_handle_.param<int>("cluster_topics", _config.cluster_topics);
+        _config.seed_gate = private_handle_.param<double>("seed_gate", _config.seed_gate);
+        _config.full_clustering_interval = private_handle_.param<int>("full_clustering_interval", _config.full_clustering_interval);
+        _config.track_deltas = private_handle_.param<bool>("track_deltas", _config.track_deltas);
+        _config.track_keyframe_interval = private_handle_.param<int>("track_keyframe_interval", _config.track_keyframe_interval);
+        _config.track_delta_distance = private_handle_.param<double>("track_delta_distance", _config.track_delta_distance);
+        _config.track_delta_speed = private_handle_.param<double>("track_delta_speed", _config.track_delta_speed);
+        _config.frame_time_budget = private_handle_.param<double>("frame_time_budget", _config.frame_time_budget);
+        _config.min_point_budget = private_handle_.param<int>("min_point_budget", _config.min_point_budget);
+        _config.max_point_budget = private_handle_.param<int>("max_point_budget", _config.max_point_budget);
+        private_handle_.param<std::string>("queue_policy", _config.queue_policy, _config.queue_policy);
+        private_handle_.param<std::string>("clustering", _config.clustering, _config.clustering);
+        private_handle_.param<std::string>("assignment", _config.assignment, _config.assignment);
+        private_handle_.param<std::string>("motion_model", _config.motion_model, _config.motion_model);
+        private_handle_.param<std::string>("record_file", _config.record_file, _config.record_file);
+        MotionModelConfig &motion = _config.motion;
+        motion.accel_noise = private_handle_.param<float>("accel_noise", motion.accel_noise);
+        motion.jerk_noise = private_handle_.param<float>("jerk_noise", motion.jerk_noise);
+        motion.yaw_accel_noise = private_handle_.param<float>("yaw_accel_noise", motion.yaw_accel_noise);
+        motion.measurement_noise = private_handle_.param<float>("measurement_noise", motion.measurement_noise);
+        motion.initial_speed = private_handle_.param<float>("initial_speed", motion.initial_speed);
+        motion.initial_yaw_rate = private_handle_.param<float>("initial_yaw_rate", motion.initial_yaw_rate);
+        motion.imm_switch = private_handle_.param<float>("imm_switch", motion.imm_switch);
+        motion.frame_period = private_handle_.param<float>("frame_period", motion.frame_period);
+        motion.max_frame_gap = private_handle_.param<double>("max_frame_gap", motion.max_frame_gap);
         private_handle_.param<std::string>("subscription_frame", _config.scan_frame, _config.scan_frame.c_str());
         private_handle_.param<std::string>("target_frame", _config.target_frame, _config.scan_frame.c_str());
         private_handle_.param<std::string>("subscription_topic", _config.scan_topic, _config.scan_topic.c_str());
         return private_handle_.param("concurrency_level", 0);
     }
 
-    void ClusterTracker::publish_cloud(ros::Publisher &pub, pcl::PointCloud<pcl::PointXYZ>::Ptr &cluster)
+    template <class PointT>
+    void ClusterTracker<PointT>::publish_cloud(ros::Publisher &pub, const pcl::PointCloud<PointT> &input_cloud,
+                                               const pcl::PointIndices &indices, const Eigen::Affine3f *transform)
+    {
+        typename pcl::PointCloud<PointT>::Ptr cluster(new pcl::PointCloud<PointT>);
+        if (transform)
+            pcl::transformPointCloud(input_cloud, indices, *cluster, *transform);
+        else
+            pcl::copyPointCloud(input_cloud, indices, *cluster);
+        cluster->header.frame_id = transform ? _config.target_frame : _config.scan_frame;
+        // stamped with the acquisition time of the frame, so the cluster lines up with its objects and in TF lookups
+        cluster->header.stamp = input_cloud.header.stamp;
+        pub.publish(cluster);
+    }
+
+    template <class PointT>
+    void ClusterTracker<PointT>::publish_objects(const boost::container::vector<pcl::PointXYZ> &cCentres, const boost::container::vector<int> &objIDs,
+                                                 const std::string &frame, const ros::Time &stamp)
     {
-        sensor_msgs::PointCloud2::Ptr clustermsg(new sensor_msgs::PointCloud2);
-        pcl::toROSMsg(*cluster, *clustermsg);
-        clustermsg->header.frame_id = _config.target_frame;
-        clustermsg->header.stamp = ros::Time::now();
-        pub.publish(*clustermsg);
+        // The message of the previous frame is refilled once every subscriber released it
+        if (!objects_msg_ || objects_msg_.use_count() > 1)
+            objects_msg_.reset(new ObjectMessage);
+        ObjectMessage &msg = *objects_msg_;
+        msg.data.resize(objIDs.size());
+        for (size_t i = 0; i < objIDs.size(); i++)
+        {
+            // Objects keep the ID of their track, so subscribers can follow them across frames
+            const int id = objIDs[i];
+            ObjectData &data = msg.data[i];
+            data.ID = id == -1 ? -1 : static_cast<int32_t>(tracks_[i].id);
+            data.centre[0] = id == -1 ? 0.f : cCentres[id].x;
+            data.centre[1] = id == -1 ? 0.f : cCentres[id].y;
+            data.centre[2] = id == -1 ? 0.f : cCentres[id].z;
+        }
+        msg.header.frame_id = frame;
+        msg.header.stamp = stamp;
+        obj_pub_.publish(objects_msg_);
     }
 
-    void ClusterTracker::publish_objects(const boost::container::vector<pcl::PointXYZ> &cCentres, const boost::container::vector<int> &objIDs)
+    template <class PointT>
+    void ClusterTracker<PointT>::publish_tracks(const boost::container::vector<pcl::PointXYZ> &cCentres, const boost::container::vector<int> &objIDs,
+                                                const Eigen::Affine3f *transform, const std::string &frame, const ros::Time &stamp)
     {
-        ObjectMessage msg;
-        for (auto it = objIDs.begin(); it != objIDs.end(); ++it)
+        // The message of the previous frame is refilled once every subscriber released it
+        if (!tracks_msg_ || tracks_msg_.use_count() > 1)
+            tracks_msg_.reset(new TrackArray);
+        TrackArray &msg = *tracks_msg_;
+        msg.keyframe = !_config.track_deltas || keyframe_pending_ || ++frames_since_keyframe_ >= _config.track_keyframe_interval;
+        if (msg.keyframe)
+            frames_since_keyframe_ = 0;
+        keyframe_pending_ = false;
+        msg.tracks.clear();
+        msg.removed.clear();
+        sent_next_.clear();
+
+        const Eigen::Matrix2f sq_rotation = transform ? Eigen::Matrix2f(transform->linear().topLeftCorner<2, 2>().cwiseAbs2())
+                                                      : Eigen::Matrix2f::Identity();
+        const float sq_distance = static_cast<float>(_config.track_delta_distance * _config.track_delta_distance);
+        const float sq_speed = static_cast<float>(_config.track_delta_speed * _config.track_delta_speed);
+        size_t s = 0; // walks the tracks sent before, both lists are ordered by increasing ID
+        for (size_t i = 0; i < tracks_.size(); i++)
         {
-            ObjectData data;
-            data.ID = *it;
-            data.centre[0] = *it == -1 ? 0.f : cCentres[*it].x;
-            data.centre[1] = *it == -1 ? 0.f : cCentres[*it].y;
-            data.centre[2] = *it == -1 ? 0.f : cCentres[*it].z;
+            const TrackState &t = tracks_[i];
+            Eigen::Vector3f position(t.position.x(), t.position.y(), i < objIDs.size() && objIDs[i] != -1 ? cCentres[objIDs[i]].z : 0.f);
+            Eigen::Vector3f velocity(t.velocity.x(), t.velocity.y(), 0.f);
+            if (transform)
+            {
+                position = *transform * position;
+                velocity = transform->linear() * velocity;
+            }
+
+            if (_config.track_deltas)
+            {
+                while (s < sent_.size() && sent_[s].id < t.id)
+                    msg.removed.push_back(sent_[s++].id);
+                // An unchanged track is compared with the state it was last sent with, so slow drifts are sent eventually
+                if (!msg.keyframe && s < sent_.size() && sent_[s].id == t.id)
+                {
+                    const SentTrack &last = sent_[s++];
+                    if ((position.head<2>() - last.position).squaredNorm() <= sq_distance &&
+                        (velocity.head<2>() - last.velocity).squaredNorm() <= sq_speed && (t.missed > 0) == last.missed)
+                    {
+                        sent_next_.push_back(last);
+                        continue;
+                    }
+                }
+                sent_next_.push_back(SentTrack{t.id, position.head<2>(), velocity.head<2>(), t.missed > 0});
+            }
 
-            msg.data.push_back(data);
+            msg.tracks.emplace_back();
+            Track &track = msg.tracks.back();
+            track.id = t.id;
+            track.position[0] = position.x();
+            track.position[1] = position.y();
+            track.position[2] = position.z();
+            track.velocity[0] = velocity.x();
+            track.velocity[1] = velocity.y();
+            // Only the diagonal is known, so the variances are rotated as if x and y were uncorrelated
+            const Eigen::Vector2f position_variance = sq_rotation * t.variance.head<2>();
+            const Eigen::Vector2f velocity_variance = sq_rotation * t.variance.tail<2>();
+            track.variance[0] = position_variance.x();
+            track.variance[1] = position_variance.y();
+            track.variance[2] = velocity_variance.x();
+            track.variance[3] = velocity_variance.y();
+            track.age = t.age;
+            track.missed = t.missed;
         }
-        msg.header.frame_id = _config.target_frame;
-        msg.header.stamp = ros::Time::now();
-        obj_pub_.publish(msg);
+        for (; s < sent_.size(); s++)
+            msg.removed.push_back(sent_[s].id);
+        if (msg.keyframe) // replaces every track of the subscribers
+            msg.removed.clear();
+        sent_.swap(sent_next_);
+
+        msg.header.frame_id = frame;
+        msg.header.stamp = stamp;
+        tracks_pub_.publish(tracks_msg_);
     }
 
-    void ClusterTracker::fit_markers(const boost::container::vector<pcl::PointXYZ> &pts,
-                                     const boost::container::vector<int> &IDs, visualization_msgs::MarkerArray &markers)
+    template <class PointT>
+    void ClusterTracker<PointT>::fit_markers(const boost::container::vector<pcl::PointXYZ> &pts, const boost::container::vector<int> &IDs,
+                                             const std::string &frame, visualization_msgs::MarkerArray &markers)
     {
+        // The markers of the previous frame are overwritten, so their strings and the array keep their buffers
+        size_t n = 0;
         for (auto i = 0; i < IDs.size(); i++)
         {
             if (IDs[i] == -1)
                 continue;
 
-            visualization_msgs::Marker m;
-            m.id = i;
-            m.header.frame_id = _config.target_frame;
+            if (markers.markers.size() <= n)
+                markers.markers.emplace_back();
+            visualization_msgs::Marker &m = markers.markers[n++];
+            const uint32_t id = tracks_[i].id;
+            m.id = static_cast<int>(id);
+            m.header.frame_id = frame;
             m.type = _config.marker_type;
             m.scale.x = (double)_config.marker_size / 100;
             m.scale.y = (double)_config.marker_size / 100;
             m.scale.z = (double)_config.marker_size / 100;
             m.action = visualization_msgs::Marker::ADD;
             m.color.a = 1.0;
-            m.color.r = i % 2 ? 1 : 0;
-            m.color.g = i % 3 ? 1 : 0;
-            m.color.b = i % 4 ? 1 : 0;
+            m.color.r = id % 2 ? 1 : 0;
+            m.color.g = id % 3 ? 1 : 0;
+            m.color.b = id % 4 ? 1 : 0;
             m.lifetime = ros::Duration(0.1);
 
-            pcl::PointXYZ clusterC(pts[IDs[i]]);
-
-            if (transform_)
-            {
-                transform_centre(clusterC);
-            }
-
+            const pcl::PointXYZ &clusterC(pts[IDs[i]]);
             m.pose.position.x = clusterC.x;
             m.pose.position.y = clusterC.y;
             m.pose.position.z = clusterC.z;
 
             m.pose.orientation.w = 1;
             m.pose.orientation.x = m.pose.orientation.y = m.pose.orientation.z = 0;
-
-            markers.markers.push_back(m);
         }
+        markers.markers.resize(n);
     }
 
-    void ClusterTracker::transform_centre(pcl::PointXYZ &centres)
+    template <class PointT>
+    bool ClusterTracker<PointT>::lookup_target_transform(Eigen::Affine3f &transform)
     {
-        tf2_ros::Buffer buf_;
-        tf2_ros::TransformListener tfListener(buf_);
-
-        pcl::PointXYZ trans_cluster;
-
-        geometry_msgs::TransformStamped trans_msg;
-        tf2::Stamped<tf2::Transform> stamped_trans;
         try
         {
-            trans_msg = buf_.lookupTransform(_config.target_frame, _config.scan_frame, ros::Time(0), ros::Duration(0.2));
-            tf2::fromMsg(trans_msg, stamped_trans);
-            trans_msg = tf2::toMsg(tf2::Stamped<tf2::Transform>(stamped_trans.inverse(), stamped_trans.stamp_, stamped_trans.frame_id_));
+            // The latest transform is used without waiting: the sensors are mounted statically, so it is exact
+            geometry_msgs::TransformStamped t = tf2_->lookupTransform(_config.target_frame, _config.scan_frame, ros::Time(0));
+            transform = transform_to_eigen(t.transform);
         }
         catch (tf2::TransformException &ex)
         {
-            ROS_WARN("%s", ex.what());
-            return;
+            ROS_WARN_THROTTLE(1.0, "%s", ex.what());
+            return false;
         }
+        return true;
+    }
 
-        tf2::doTransform(centres, trans_cluster, trans_msg);
-        centres = trans_cluster;
+    template <class PointT>
+    void ClusterTracker<PointT>::transform_centres(boost::container::vector<pcl::PointXYZ> &centres, const Eigen::Affine3f &transform)
+    {
+        for (pcl::PointXYZ &c : centres)
+            c.getVector3fMap() = transform * c.getVector3fMap();
     }
 
-    void ClusterTracker::sync_cluster_publishers_size(size_t num_clusters)
+    template <class PointT>
+    void ClusterTracker<PointT>::advertise_cluster_publishers(const ros::SubscriberStatusCallback &connect_cb,
+                                                              const ros::SubscriberStatusCallback &disconnect_cb)
     {
-        // Remove unnecessary publishers from time to time
-        if (cluster_pubs_.size() > num_clusters && publisher_prune_ctr_++ > prune_interval)
+        cluster_pubs_.reserve(std::max(_config.cluster_topics, 0));
+        for (int i = 0; i < _config.cluster_topics; i++)
         {
-            while (cluster_pubs_.size() > num_clusters)
+            try
             {
-                cluster_pubs_.back()->shutdown();
-                cluster_pubs_.pop_back();
+                std::stringstream ss;
+                ss << _config.tracker_name << "/cluster_" << i;
+                cluster_pubs_.push_back(handle_.advertise<pcl::PointCloud<PointT>>(ss.str(), 100, connect_cb, disconnect_cb));
+            }
+            catch (ros::Exception &ex)
+            {
+                ROS_ERROR("%s", ex.what());
+                break;
             }
-            publisher_prune_ctr_ = 0;
         }
+    }
 
-        while (num_clusters > cluster_pubs_.size())
+    template <class PointT>
+    void ClusterTracker<PointT>::publish_labeled_clusters(const pcl::PointCloud<pcl::PointXYZ> &input_cloud,
+                                                          const std::vector<pcl::PointIndices> &clusters, const Eigen::Affine3f *transform)
+    {
+        // The cloud of the previous frame is refilled once every subscriber released it
+        if (!clusters_msg_ || clusters_msg_.use_count() > 1)
+            clusters_msg_.reset(new pcl::PointCloud<pcl::PointXYZL>);
+        pcl::PointCloud<pcl::PointXYZL> &cloud = *clusters_msg_;
+
+        size_t num_points = 0;
+        for (int c : obj_ids_)
+            if (c != -1)
+                num_points += clusters[c].indices.size();
+        cloud.resize(num_points);
+
+        size_t n = 0;
+        for (size_t i = 0; i < obj_ids_.size(); i++)
         {
-            try
+            if (obj_ids_[i] == -1)
+                continue;
+            for (int idx : clusters[obj_ids_[i]].indices)
             {
-                std::stringstream ss;
-                ss << _config.tracker_name << "/cluster_" << cluster_pubs_.size();
-                ros::Publisher *pub = new ros::Publisher(handle_.advertise<sensor_msgs::PointCloud2>(ss.str(), 100));
-                cluster_pubs_.push_back(pub);
+                pcl::PointXYZL &p = cloud[n++];
+                const Eigen::Vector3f v = input_cloud[idx].getVector3fMap();
+                p.getVector3fMap() = transform ? Eigen::Vector3f(*transform * v) : v;
+                p.label = tracks_[i].id;
             }
-            catch (ros::Exception &ex)
+        }
+        cloud.header = input_cloud.header;
+        cloud.header.frame_id = transform ? _config.target_frame : _config.scan_frame;
+        clusters_pub_.publish(clusters_msg_);
+    }
+
+    template <class PointT>
+    void ClusterTracker<PointT>::cloudCallback(const typename pcl::PointCloud<PointT>::ConstPtr &input_cloud)
+    {
+        input_queue_.push(input_cloud);
+        if (notify_)
+            notify_();
+        else
+            process_input();
+    }
+
+    template <class PointT>
+    void ClusterTracker<PointT>::process_input()
+    {
+        // Every thread holding a workspace checks the queue again after finishing its frame, so a frame that finds
+        // no free workspace is taken by one of them
+        while (process_next_frame())
+        {
+        }
+    }
+
+    template <class PointT>
+    bool ClusterTracker<PointT>::process_next_frame()
+    {
+        size_t w;
+        while (try_acquire_workspace(w))
+        {
+            FrameWorkspace &frame = workspaces_[w];
+            // The sequence number is assigned by the queue together with the frame, so the frames are tracked in the
+            // order they were taken. It is taken only with a workspace in hand, so the frames waiting to be tracked
+            // always fit the ring
+            uint64_t seq;
+            if (!input_queue_.pop(frame.cloud, seq))
             {
-                ROS_ERROR(ex.what());
+                workspace_busy_[w].store(false, std::memory_order_release);
+                if (input_queue_.empty())
+                    return false;
+                continue;
             }
+
+            extract_cluster_data(frame);
+
+            FrameSlot &slot = ring_[seq & ring_mask_];
+            slot.workspace = w;
+            slot.ready = seq + 1;
+            drain_frames();
+
+            // The notifications of the frames that found no free workspace were dropped by the pool
+            if (notify_ && !input_queue_.empty())
+                notify_();
+            return true;
         }
+        return false;
     }
 
-    void ClusterTracker::cloudCallback(const sensor_msgs::PointCloud2ConstPtr &cloud_msg)
+    template <class PointT>
+    bool ClusterTracker<PointT>::try_acquire_workspace(size_t &workspace)
     {
-        pcl::PointCloud<pcl::PointXYZ>::Ptr input_cloud(new pcl::PointCloud<pcl::PointXYZ>);
-        pcl::fromROSMsg(*cloud_msg, *input_cloud);
+        for (size_t i = 0; i < workspaces_.size(); i++)
+            if (!workspace_busy_[i].load(std::memory_order_relaxed) && !workspace_busy_[i].exchange(true, std::memory_order_acquire))
+            {
+                workspace = i;
+                return true;
+            }
+        return false;
+    }
 
-        boost::container::vector<pcl::PointCloud<pcl::PointXYZ>::Ptr> cluster_vec;
-        boost::container::vector<pcl::PointXYZ> cluster_centres;
-        boost::container::vector<int> objIDs;
+    template <class PointT>
+    void ClusterTracker<PointT>::drain_frames()
+    {
+        while (!draining_.exchange(true))
+        {
+            for (;;)
+            {
+                const uint64_t seq = next_frame_;
+                const FrameSlot &slot = ring_[seq & ring_mask_];
+                if (slot.ready != seq + 1)
+                    break;
+                const size_t w = slot.workspace;
+                track_and_publish(workspaces_[w]);
+                workspaces_[w].cloud.reset();
+                workspaces_[w].xyz.reset();
+                next_frame_ = seq + 1;
+                workspace_busy_[w].store(false, std::memory_order_release);
+            }
+            draining_ = false;
 
-        extract_cluster_data(input_cloud, cluster_vec, cluster_centres);
+            // A frame finished after the check above but before the flag was cleared would be left behind otherwise
+            const uint64_t seq = next_frame_;
+            if (ring_[seq & ring_mask_].ready != seq + 1)
+                return;
+        }
+    }
 
-        if (first_frame_)
+    template <class PointT>
+    void ClusterTracker<PointT>::track_and_publish(FrameWorkspace &frame)
+    {
+        const pcl::PointCloud<PointT> &input_cloud = *frame.cloud;
+        const boost::container::vector<pcl::PointXYZ> &cluster_centres = frame.cluster_centres;
+
+        if (reset_pending_.exchange(false))
         {
-            boost::mutex::scoped_lock lock(mutex_);
-            _KFTracker.initialize(cluster_centres);
-            first_frame_ = false;
+            _KFTracker.reset();
+            keyframe_pending_ = true;
+            if (log_.is_open())
+                log_.write_reset(input_cloud.header.stamp, input_cloud.header.seq);
         }
-        else
+
+        ScopedStageTimer frame_timer(timers_, STAGE_FRAME);
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+#ifdef F1TENTH_SENSOR_FUSION_COUNT_ALLOCATIONS
+        size_t allocations = thread_allocations();
+#endif
+        FrameStatus status;
+        {
+            ScopedStageTimer timer(timers_, STAGE_TRACKING);
+            status = _KFTracker.track(cluster_centres, input_cloud.header.stamp * 1e-6, obj_ids_);
+        }
+        if (log_.is_open())
+        {
+            // The budget changes between the frames clustered with it, which may be clustered before the last one is tracked
+            if (frame.point_budget != logged_budget_)
+            {
+                log_.write_config(LogRecord::TRACKER_TUNING, "point_budget " + std::to_string(frame.point_budget) + "\n");
+                logged_budget_ = frame.point_budget;
+            }
+            log_.write_points(LogRecord::TRACKER_INPUT, *frame.xyz);
+            log_.write_objects(cluster_centres, obj_ids_, input_cloud.header.stamp, input_cloud.header.seq, static_cast<uint32_t>(status));
+        }
+        // Frames leave the ring in arrival order, a frame stamped before the last tracked one must have been delayed upstream
+        if (status == FrameStatus::OUT_OF_ORDER)
         {
-            objIDs = _KFTracker.track(cluster_centres);
+            ROS_WARN_THROTTLE(1.0, "%s: dropping out of order frame", _config.tracker_name.c_str());
+            return;
         }
+        if (seeded_clustering_)
+        {
+            boost::mutex::scoped_lock lock(seeds_mutex_);
+            _KFTracker.positions(seeds_);
+        }
+        // IDs and handles of the objects, which keep their markers, labels and cluster topics as long as they are tracked
+        _KFTracker.tracks(tracks_);
+#ifdef F1TENTH_SENSOR_FUSION_COUNT_ALLOCATIONS
+        allocations = thread_allocations() - allocations;
+#endif
 
-        if (_config.rviz)
+        // Outputs are expressed in the target frame if the transform is available: it is looked up once per frame
+        // and applied to every centre (and published cluster) at once
+        Eigen::Affine3f to_target;
+        bool transformed;
         {
-            visualization_msgs::MarkerArray markers;
-            fit_markers(cluster_centres, objIDs, markers);
+            ScopedStageTimer timer(timers_, STAGE_TF);
+            transformed = transform_ && lookup_target_transform(to_target);
+            if (transformed)
+            {
+                target_centres_ = cluster_centres;
+                transform_centres(target_centres_, to_target);
+            }
+        }
+        const boost::container::vector<pcl::PointXYZ> &out_centres = transformed ? target_centres_ : cluster_centres;
+        const std::string &out_frame = transformed ? _config.target_frame : _config.scan_frame;
 
-            marker_pub_.publish(markers);
+        // Outputs nobody listens to are not built
+        if (_config.rviz && marker_pub_.getNumSubscribers() > 0)
+        {
+            ScopedStageTimer timer(timers_, STAGE_MARKERS);
+#ifdef F1TENTH_SENSOR_FUSION_COUNT_ALLOCATIONS
+            const size_t before = thread_allocations();
+            fit_markers(out_centres, obj_ids_, out_frame, markers_);
+            allocations += thread_allocations() - before;
+#else
+            fit_markers(out_centres, obj_ids_, out_frame, markers_);
+#endif
+
+            marker_pub_.publish(markers_);
         }
 
-        boost::mutex::scoped_lock lock(mutex_);
-        sync_cluster_publishers_size(cluster_vec.size());
-        publish_objects(cluster_centres, objIDs);
+#ifdef F1TENTH_SENSOR_FUSION_COUNT_ALLOCATIONS
+        // roscpp and tf2 allocate on their own, only the computations of the tracker are expected to stop allocating
+        allocations += frame.allocations;
+        if (allocations > 0)
+            ROS_INFO_THROTTLE(1.0, "%s: %zu heap allocations in frame %u", _config.tracker_name.c_str(), allocations, input_cloud.header.seq);
+#endif
 
-        for (size_t i = 0; i < objIDs.size(); ++i)
-            if (objIDs[i] != -1)
-                publish_cloud(*(cluster_pubs_[i]), cluster_vec[objIDs[i]]);
-    }
+        ros::Time stamp;
+        pcl_conversions::fromPCL(input_cloud.header.stamp, stamp);
 
-    void ClusterTracker::extract_cluster_data(const pcl::PointCloud<pcl::PointXYZ>::Ptr input_cloud,
-                                              boost::container::vector<pcl::PointCloud<pcl::PointXYZ>::Ptr> &cluster_vec,
-                                              boost::container::vector<pcl::PointXYZ> &cluster_centres)
-    {
-        pcl::search::KdTree<pcl::PointXYZ>::Ptr search_tree(new pcl::search::KdTree<pcl::PointXYZ>);
-        search_tree->setInputCloud(input_cloud);
+        ScopedStageTimer timer(timers_, STAGE_PUBLISH);
+        if (obj_pub_.getNumSubscribers() > 0)
+        {
+            if (_config.transform_objects)
+                publish_objects(out_centres, obj_ids_, out_frame, stamp);
+            else
+                publish_objects(cluster_centres, obj_ids_, _config.scan_frame, stamp);
+            timers_.record_since(STAGE_LATENCY, stamp);
+        }
+        if (tracks_pub_.getNumSubscribers() > 0)
+        {
+            const bool in_target = transformed && _config.transform_objects;
+            publish_tracks(cluster_centres, obj_ids_, in_target ? &to_target : nullptr, in_target ? out_frame : _config.scan_frame, stamp);
+        }
+        else
+            keyframe_pending_ = true; // a subscriber joining later starts from a full list
 
-        std::vector<pcl::PointIndices> cluster_indices;
+        // Cluster clouds are only materialized for topics somebody listens to
+        if (clusters_pub_.getNumSubscribers() > 0)
+            publish_labeled_clusters(*frame.xyz, frame.cluster_indices, transformed ? &to_target : nullptr);
+        // An object keeps the topic of its slot, slots are reused by new objects once theirs are dropped
+        for (size_t i = 0; i < obj_ids_.size(); ++i)
+        {
+            const size_t topic = tracks_[i].handle.slot;
+            if (obj_ids_[i] != -1 && topic < cluster_pubs_.size() && cluster_pubs_[topic].getNumSubscribers() > 0)
+                publish_cloud(cluster_pubs_[topic], input_cloud, frame.cluster_indices[obj_ids_[i]], transformed ? &to_target : nullptr);
+        }
+        adapt_point_budget(frame, start, stamp);
+    }
 
-        cluster_extr_.setSearchMethod(search_tree);
-        cluster_extr_.setInputCloud(input_cloud);
-        cluster_extr_.extract(cluster_indices);
+    template <class PointT>
+    void ClusterTracker<PointT>::adapt_point_budget(const FrameWorkspace &frame, const std::chrono::steady_clock::time_point &start,
+                                                    const ros::Time &stamp)
+    {
+        if (!controller_.enabled())
+            return;
+        // The frames clustered in parallel don't add up, so the time of a frame is its clustering and its ordered stage
+        const double duration = frame.clustering_time + std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (controller_.update(duration))
+            point_budget_.store(static_cast<size_t>(std::lround(controller_.value())), std::memory_order_relaxed);
+        controller_.publish(stamp);
+    }
 
-        for (std::vector<pcl::PointIndices>::const_iterator it = cluster_indices.begin(); it != cluster_indices.end(); it++)
+    template <class PointT>
+    void ClusterTracker<PointT>::extract_cluster_data(FrameWorkspace &frame)
+    {
+        // The workspace belongs to this frame until it is published, its backend and buffers are reused between frames
+#ifdef F1TENTH_SENSOR_FUSION_COUNT_ALLOCATIONS
+        const size_t allocations = thread_allocations();
+#endif
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
         {
-            pcl::PointCloud<pcl::PointXYZ>::Ptr _cluster(new pcl::PointCloud<pcl::PointXYZ>);
-            float x = 0.0f, y = 0.0f, z = 0.0f;
-            for (std::vector<int>::const_iterator pit = it->indices.begin(); pit != it->indices.end(); pit++)
+            ScopedStageTimer timer(timers_, STAGE_CLUSTERING);
+            if (seeded_clustering_)
             {
-                _cluster->push_back((*input_cloud)[*pit]);
-                x += _cluster->back().x;
-                y += _cluster->back().y;
-                z += _cluster->back().z;
+                // the objects as of the last tracked frame, which may be a few frames behind when clustering in parallel
+                boost::mutex::scoped_lock lock(seeds_mutex_);
+                frame.clustering->set_seeds(seeds_);
             }
-            _cluster->width = _cluster->size();
-            _cluster->height = 1;
-            _cluster->is_dense = true;
-
-            pcl::PointXYZ centre;
-            centre.x = x / _cluster->size();
-            centre.y = y / _cluster->size();
-            centre.z = z == 0 ? 0 : (z / _cluster->size());
+            frame.xyz = coordinates<PointT>(frame.cloud, frame.xyz_buffer);
+            frame.point_budget = point_budget_.load(std::memory_order_relaxed);
+            extract_within_budget(*frame.clustering, frame.xyz, frame.point_budget, _config.clust_min, _config.clust_max, frame.subsampled,
+                                  frame.cluster_indices);
+        }
 
-            cluster_vec.push_back(_cluster);
-            cluster_centres.push_back(centre);
+        {
+            ScopedStageTimer timer(timers_, STAGE_CENTROIDS);
+            compute_centroids(*frame.xyz, frame.cluster_indices, frame.cluster_centres, centroid_threads_);
         }
+        frame.clustering_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+#ifdef F1TENTH_SENSOR_FUSION_COUNT_ALLOCATIONS
+        // the OpenMP threads splitting the centroids are not counted, they only write preallocated centres
+        frame.allocations = thread_allocations() - allocations;
+#endif
     }
-}
\ No newline at end of file
+
+    template <class PointT>
+    std::string ClusterTracker<PointT>::log_config() const
+    {
+        // Same names as the parameters, so frame_replay can run the frames through the same clustering and tracking
+        const MotionModelConfig &motion = _config.motion;
+        std::ostringstream ss;
+        ss.precision(std::numeric_limits<double>::max_digits10);
+        ss << "clustering " << _config.clustering << "\n"
+           << "tolerance " << _config.tolerance << "\n"
+           << "min_cluster_size " << _config.clust_min << "\n"
+           << "max_cluster_size " << _config.clust_max << "\n"
+           << "seed_gate " << _config.seed_gate << "\n"
+           << "full_clustering_interval " << _config.full_clustering_interval << "\n"
+           << "parallel_frames " << workspaces_.size() << "\n"
+           << "assignment " << _config.assignment << "\n"
+           << "max_match_distance " << _config.max_match_distance << "\n"
+           << "max_missed " << _config.max_missed << "\n"
+           << "motion_model " << _config.motion_model << "\n"
+           << "accel_noise " << motion.accel_noise << "\n"
+           << "jerk_noise " << motion.jerk_noise << "\n"
+           << "yaw_accel_noise " << motion.yaw_accel_noise << "\n"
+           << "measurement_noise " << motion.measurement_noise << "\n"
+           << "initial_speed " << motion.initial_speed << "\n"
+           << "initial_yaw_rate " << motion.initial_yaw_rate << "\n"
+           << "imm_switch " << motion.imm_switch << "\n"
+           << "frame_period " << motion.frame_period << "\n"
+           << "max_frame_gap " << motion.max_frame_gap << "\n";
+        return ss.str();
+    }
+
+    template class ClusterTracker<pcl::PointXYZ>;
+    template class ClusterTracker<pcl::PointXYZI>;
+    template class ClusterTracker<pcl::PointXYZRGB>;
+}
@@ -0,0 +1,377 @@
+/* Copyright 2021 Kovács Gergely Attila
+*
+*   Licensed under the Apache License,
+*   Version 2.0(the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License.
+*
+*/
+
+#include <f1tenth_sensor_fusion/clustering.hpp>
+#include <pcl/common/point_tests.h>
+#include <algorithm>
+
+namespace f1tenth_sensor_fusion
+{
+    namespace
+    {
+        /// Resize the output of a backend. Its elements keep their buffers, those not needed now are set aside for later frames.
+        void resize_clusters(std::vector<pcl::PointIndices> &clusters, size_t size, std::vector<std::vector<int>> &spare)
+        {
+            for (size_t k = clusters.size(); k < size; k++)
+            {
+                clusters.emplace_back();
+                if (!spare.empty())
+                {
+                    clusters.back().indices.swap(spare.back());
+                    spare.pop_back();
+                }
+            }
+            for (size_t k = size; k < clusters.size(); k++)
+                spare.push_back(std::move(clusters[k].indices));
+            clusters.resize(size);
+        }
+
+        /// Largest first, ties in the order of discovery.
+        bool larger_cluster(const std::pair<size_t, size_t> &a, const std::pair<size_t, size_t> &b)
+        {
+            return a.first > b.first || (a.first == b.first && a.second < b.second);
+        }
+    }
+
+    bool parse_clustering_method(const std::string &name, ClusteringMethod &method)
+    {
+        if (name == "euclidean")
+            method = ClusteringMethod::EUCLIDEAN;
+        else if (name == "scanline")
+            method = ClusteringMethod::SCANLINE;
+        else if (name == "seeded")
+            method = ClusteringMethod::SEEDED;
+        else
+            return false;
+        return true;
+    }
+
+    std::unique_ptr<ClusteringBackend> make_clustering_backend(ClusteringMethod method, double tolerance, int min_size, int max_size,
+                                                               double seed_gate, int full_interval)
+    {
+        if (method == ClusteringMethod::SCANLINE)
+            return std::unique_ptr<ClusteringBackend>(new ScanlineClustering(tolerance, min_size, max_size));
+        if (method == ClusteringMethod::SEEDED)
+            return std::unique_ptr<ClusteringBackend>(new SeededClustering(tolerance, min_size, max_size, seed_gate, full_interval));
+        return std::unique_ptr<ClusteringBackend>(new EuclideanClustering(tolerance, min_size, max_size));
+    }
+
+    EuclideanClustering::EuclideanClustering(double tolerance, int min_size, int max_size)
+        : search_tree_(new pcl::search::KdTree<pcl::PointXYZ>)
+    {
+        cluster_extr_.setClusterTolerance(tolerance);
+        cluster_extr_.setMaxClusterSize(max_size);
+        cluster_extr_.setMinClusterSize(min_size);
+        cluster_extr_.setSearchMethod(search_tree_);
+    }
+
+    void EuclideanClustering::set_size_limits(int min_size, int max_size)
+    {
+        cluster_extr_.setMaxClusterSize(max_size);
+        cluster_extr_.setMinClusterSize(min_size);
+    }
+
+    void EuclideanClustering::extract(const pcl::PointCloud<pcl::PointXYZ>::ConstPtr &cloud, std::vector<pcl::PointIndices> &clusters)
+    {
+        // the extraction appends to its output
+        clusters.clear();
+        search_tree_->setInputCloud(cloud);
+        cluster_extr_.setInputCloud(cloud);
+        cluster_extr_.extract(clusters);
+    }
+
+    ScanlineClustering::ScanlineClustering(double tolerance, int min_size, int max_size)
+        : sq_tolerance_(static_cast<float>(tolerance * tolerance)), min_size_(std::max(min_size, 1)), max_size_(std::max(max_size, 1))
+    {
+    }
+
+    void ScanlineClustering::set_size_limits(int min_size, int max_size)
+    {
+        min_size_ = std::max(min_size, 1);
+        max_size_ = std::max(max_size, 1);
+    }
+
+    void ScanlineClustering::extract(const pcl::PointCloud<pcl::PointXYZ>::ConstPtr &cloud, std::vector<pcl::PointIndices> &clusters)
+    {
+        // Segments are collected as ranges of a flat array of point indices, only the kept ones are copied out
+        points_.clear();
+        starts_.clear();
+        int prev = -1;
+        for (int i = 0; i < static_cast<int>(cloud->size()); i++)
+        {
+            const pcl::PointXYZ &p = (*cloud)[i];
+            if (!pcl::isFinite(p))
+                continue;
+            if (prev == -1 || (p.getVector3fMap() - (*cloud)[prev].getVector3fMap()).squaredNorm() > sq_tolerance_)
+                starts_.push_back(points_.size());
+            points_.push_back(i);
+            prev = i;
+        }
+        starts_.push_back(points_.size());
+        const size_t num_segments = starts_.size() - 1;
+
+        // join the last segment with the first one if the scan closes on itself
+        const bool joined = num_segments > 1 && ((*cloud)[points_.front()].getVector3fMap() - (*cloud)[points_.back()].getVector3fMap()).squaredNorm() <= sq_tolerance_;
+        const size_t first_size = joined ? starts_[1] : 0;
+
+        kept_.clear();
+        for (size_t s = joined ? 1 : 0; s < num_segments; s++)
+        {
+            size_t size = starts_[s + 1] - starts_[s];
+            if (joined && s == num_segments - 1)
+                size += first_size;
+            if (size >= min_size_ && size <= max_size_)
+                kept_.push_back(std::make_pair(size, s));
+        }
+        std::sort(kept_.begin(), kept_.end(), larger_cluster);
+        resize_clusters(clusters, kept_.size(), spare_);
+
+        for (size_t k = 0; k < kept_.size(); k++)
+        {
+            const size_t s = kept_[k].second;
+            auto &indices = clusters[k].indices;
+            indices.assign(points_.begin() + starts_[s], points_.begin() + starts_[s + 1]);
+            if (joined && s == num_segments - 1)
+                indices.insert(indices.end(), points_.begin(), points_.begin() + first_size);
+        }
+    }
+
+    SeededClustering::SeededClustering(double tolerance, int min_size, int max_size, double seed_gate, int full_interval)
+        : inv_tolerance_(static_cast<float>(1.0 / tolerance)), sq_tolerance_(static_cast<float>(tolerance * tolerance)),
+          gate_(static_cast<float>(seed_gate)), min_size_(std::max(min_size, 1)), max_size_(std::max(max_size, 1)),
+          full_interval_(std::max(full_interval, 1))
+    {
+    }
+
+    void SeededClustering::set_size_limits(int min_size, int max_size)
+    {
+        min_size_ = std::max(min_size, 1);
+        max_size_ = std::max(max_size, 1);
+    }
+
+    void SeededClustering::set_seeds(const boost::container::vector<pcl::PointXYZ> &seeds)
+    {
+        seeds_.assign(seeds.begin(), seeds.end());
+    }
+
+    void SeededClustering::build_grid(const pcl::PointCloud<pcl::PointXYZ> &cloud)
+    {
+        size_t capacity = 16;
+        while (capacity < 2 * cloud.size())
+            capacity *= 2;
+        cell_keys_.resize(capacity);
+        cell_used_.assign(capacity, 0);
+        cell_heads_.resize(capacity);
+        next_.resize(cloud.size());
+        visited_.assign(cloud.size(), 0);
+
+        const size_t mask = capacity - 1;
+        for (int i = 0; i < static_cast<int>(cloud.size()); i++)
+        {
+            const pcl::PointXYZ &p = cloud[i];
+            if (!pcl::isFinite(p))
+            {
+                visited_[i] = 1; // never part of a cluster
+                continue;
+            }
+            const uint64_t key = cell_key(cell_coord(p.x), cell_coord(p.y));
+            size_t e = ((key * 0x9E3779B97F4A7C15ull) >> 40) & mask;
+            while (cell_used_[e] && cell_keys_[e] != key)
+                e = (e + 1) & mask;
+            if (!cell_used_[e])
+            {
+                cell_used_[e] = 1;
+                cell_keys_[e] = key;
+                cell_heads_[e] = -1;
+            }
+            next_[i] = cell_heads_[e];
+            cell_heads_[e] = i;
+        }
+    }
+
+    int SeededClustering::find_cell(int cx, int cy) const
+    {
+        const uint64_t key = cell_key(cx, cy);
+        const size_t mask = cell_heads_.size() - 1;
+        for (size_t e = ((key * 0x9E3779B97F4A7C15ull) >> 40) & mask; cell_used_[e]; e = (e + 1) & mask)
+            if (cell_keys_[e] == key)
+                return static_cast<int>(e);
+        return -1;
+    }
+
+    int SeededClustering::nearest_unvisited(const pcl::PointCloud<pcl::PointXYZ> &cloud, const pcl::PointXYZ &seed) const
+    {
+        // tracking happens in the x-y plane, so is the gate
+        const int x0 = cell_coord(seed.x - gate_), x1 = cell_coord(seed.x + gate_);
+        const int y0 = cell_coord(seed.y - gate_), y1 = cell_coord(seed.y + gate_);
+        int nearest = -1;
+        float nearest_sq = gate_ * gate_;
+        for (int cx = x0; cx <= x1; cx++)
+            for (int cy = y0; cy <= y1; cy++)
+            {
+                const int e = find_cell(cx, cy);
+                for (int j = e == -1 ? -1 : cell_heads_[e]; j != -1; j = next_[j])
+                {
+                    const float dx = cloud[j].x - seed.x, dy = cloud[j].y - seed.y;
+                    if (dx * dx + dy * dy <= nearest_sq)
+                    {
+                        nearest_sq = dx * dx + dy * dy;
+                        nearest = j;
+                    }
+                }
+            }
+        return nearest;
+    }
+
+    void SeededClustering::grow(const pcl::PointCloud<pcl::PointXYZ> &cloud, int start)
+    {
+        // Breadth-first, the points of the cluster are the queue itself. A point leaves the list of its cell when it
+        // joins a cluster, so dense cells are not scanned again for every one of their points
+        starts_.push_back(points_.size());
+        unlink(cloud, start);
+        points_.push_back(start);
+        for (size_t k = starts_.back(); k < points_.size(); k++)
+        {
+            const Eigen::Vector3f p = cloud[points_[k]].getVector3fMap();
+            const int cx = cell_coord(p.x()), cy = cell_coord(p.y());
+            for (int dx = -1; dx <= 1; dx++)
+                for (int dy = -1; dy <= 1; dy++)
+                {
+                    const int e = find_cell(cx + dx, cy + dy);
+                    if (e == -1)
+                        continue;
+                    for (int *link = &cell_heads_[e]; *link != -1;)
+                    {
+                        const int j = *link;
+                        if ((cloud[j].getVector3fMap() - p).squaredNorm() <= sq_tolerance_)
+                        {
+                            *link = next_[j];
+                            visited_[j] = 1;
+                            points_.push_back(j);
+                        }
+                        else
+                        {
+                            link = &next_[j];
+                        }
+                    }
+                }
+        }
+    }
+
+    void SeededClustering::unlink(const pcl::PointCloud<pcl::PointXYZ> &cloud, int i)
+    {
+        const int e = find_cell(cell_coord(cloud[i].x), cell_coord(cloud[i].y));
+        int *link = &cell_heads_[e];
+        while (*link != i)
+            link = &next_[*link];
+        *link = next_[i];
+        visited_[i] = 1;
+    }
+
+    void SeededClustering::extract(const pcl::PointCloud<pcl::PointXYZ>::ConstPtr &cloud, std::vector<pcl::PointIndices> &clusters)
+    {
+        build_grid(*cloud);
+        points_.clear();
+        starts_.clear();
+
+        for (const pcl::PointXYZ &seed : seeds_)
+        {
+            const int start = nearest_unvisited(*cloud, seed);
+            if (start != -1)
+                grow(*cloud, start);
+        }
+
+        // the rest of the cloud, where new objects may have appeared
+        if (seeds_.empty() || ++frames_since_full_ >= full_interval_)
+        {
+            for (int i = 0; i < static_cast<int>(cloud->size()); i++)
+                if (!visited_[i])
+                    grow(*cloud, i);
+            frames_since_full_ = 0;
+        }
+        starts_.push_back(points_.size());
+
+        kept_.clear();
+        for (size_t c = 0; c + 1 < starts_.size(); c++)
+        {
+            const size_t size = starts_[c + 1] - starts_[c];
+            if (size >= min_size_ && size <= max_size_)
+                kept_.push_back(std::make_pair(size, c));
+        }
+        std::sort(kept_.begin(), kept_.end(), larger_cluster);
+        resize_clusters(clusters, kept_.size(), spare_);
+
+        for (size_t k = 0; k < kept_.size(); k++)
+        {
+            const size_t c = kept_[k].second;
+            clusters[k].indices.assign(points_.begin() + starts_[c], points_.begin() + starts_[c + 1]);
+        }
+    }
+
+    size_t extract_within_budget(ClusteringBackend &backend, const pcl::PointCloud<pcl::PointXYZ>::ConstPtr &cloud, size_t max_points,
+                                 int min_size, int max_size, pcl::PointCloud<pcl::PointXYZ>::Ptr &buffer,
+                                 std::vector<pcl::PointIndices> &clusters)
+    {
+        const size_t stride = max_points > 0 && cloud->size() > max_points ? (cloud->size() + max_points - 1) / max_points : 1;
+        const int divisor = static_cast<int>(stride);
+        backend.set_size_limits(std::max(min_size / divisor, 1), std::max(max_size / divisor, 1));
+        if (stride == 1)
+        {
+            backend.extract(cloud, clusters);
+            return 1;
+        }
+
+        if (!buffer)
+            buffer.reset(new pcl::PointCloud<pcl::PointXYZ>);
+        buffer->header = cloud->header;
+        buffer->resize((cloud->size() + stride - 1) / stride);
+        for (size_t i = 0; i < buffer->size(); i++)
+            (*buffer)[i] = (*cloud)[i * stride];
+        backend.extract(buffer, clusters);
+        for (pcl::PointIndices &cluster : clusters)
+            for (int &idx : cluster.indices)
+                idx *= divisor;
+        return stride;
+    }
+
+    void compute_centroids(const pcl::PointCloud<pcl::PointXYZ> &cloud, const std::vector<pcl::PointIndices> &clusters,
+                           boost::container::vector<pcl::PointXYZ> &centres, int num_threads)
+    {
+        const int num_clusters = static_cast<int>(clusters.size());
+        centres.resize(num_clusters);
+
+#pragma omp parallel for num_threads(num_threads) schedule(dynamic) if (num_clusters > 1 && num_threads > 1)
+        for (int c = 0; c < num_clusters; c++)
+        {
+            const auto &indices = clusters[c].indices;
+            float x = 0.0f, y = 0.0f, z = 0.0f;
+            for (auto idx : indices)
+            {
+                const pcl::PointXYZ &p = cloud[idx];
+                x += p.x;
+                y += p.y;
+                z += p.z;
+            }
+
+            pcl::PointXYZ centre;
+            centre.x = x / indices.size();
+            centre.y = y / indices.size();
+            centre.z = z == 0 ? 0 : (z / indices.size());
+            centres[c] = centre;
+        }
+    }
+}
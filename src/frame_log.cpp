@@ -0,0 +1,313 @@
+/* Copyright 2021 Kovács Gergely Attila
+*
+*   Licensed under the Apache License,
+*   Version 2.0(the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License.
+*
+*/
+
+#include <f1tenth_sensor_fusion/frame_log.hpp>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+
+namespace f1tenth_sensor_fusion
+{
+    namespace
+    {
+        const char MAGIC[8] = {'F', '1', 'T', 'F', 'L', 'O', 'G', '\0'};
+        const uint32_t VERSION = 1;
+        const size_t INITIAL_CAPACITY = size_t(64) << 20;
+
+        struct FileHeader
+        {
+            char magic[8];
+            uint32_t version;
+            uint32_t reserved;
+        };
+
+        /// Layout of the message of a FILTER_INPUT record, followed by its fields and its data
+        struct MessageLayout
+        {
+            uint32_t width, height, point_step, row_step;
+            uint8_t is_bigendian, is_dense;
+            uint16_t num_fields;
+        };
+
+        struct FieldLayout
+        {
+            char name[16];
+            uint32_t offset, count;
+            uint8_t datatype;
+            uint8_t padding[3];
+        };
+
+        inline size_t padded(size_t size) { return (size + 7) & ~size_t(7); }
+    }
+
+    bool FrameLogWriter::open(const std::string &path)
+    {
+        close();
+        fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd_ < 0)
+            return false;
+        if (!grow(INITIAL_CAPACITY))
+        {
+            close();
+            return false;
+        }
+        FileHeader header = {};
+        std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+        header.version = VERSION;
+        std::memcpy(data_, &header, sizeof(header));
+        size_ = sizeof(header);
+        return true;
+    }
+
+    void FrameLogWriter::close()
+    {
+        if (data_)
+        {
+            munmap(data_, capacity_);
+            data_ = nullptr;
+        }
+        if (fd_ >= 0)
+        {
+            // the mapping was grown ahead of the records, the rest of the file is cut off
+            if (ftruncate(fd_, size_) != 0)
+                size_ = 0;
+            ::close(fd_);
+            fd_ = -1;
+        }
+        capacity_ = size_ = 0;
+    }
+
+    bool FrameLogWriter::grow(size_t capacity)
+    {
+        if (ftruncate(fd_, capacity) != 0)
+            return false;
+        void *data = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+        if (data == MAP_FAILED)
+            return false;
+        if (data_)
+            munmap(data_, capacity_);
+        data_ = static_cast<uint8_t *>(data);
+        capacity_ = capacity;
+        return true;
+    }
+
+    uint8_t *FrameLogWriter::begin(LogRecord type, uint32_t status, uint64_t stamp, uint32_t seq, size_t count, size_t size)
+    {
+        if (!data_)
+            return nullptr;
+        const size_t needed = size_ + sizeof(LogRecordHeader) + padded(size);
+        if (needed > capacity_ && !grow(std::max(needed, 2 * capacity_)))
+        {
+            // the records written so far stay readable, the log just ends here
+            close();
+            return nullptr;
+        }
+
+        LogRecordHeader header = {};
+        header.type = static_cast<uint32_t>(type);
+        header.status = status;
+        header.stamp = stamp;
+        header.seq = seq;
+        header.count = static_cast<uint32_t>(count);
+        header.size = static_cast<uint32_t>(size);
+        std::memcpy(data_ + size_, &header, sizeof(header));
+        uint8_t *payload = data_ + size_ + sizeof(header);
+        size_ = needed;
+        return payload;
+    }
+
+    void FrameLogWriter::write_config(LogRecord type, const std::string &config)
+    {
+        uint8_t *out = begin(type, 0, 0, 0, 0, config.size());
+        if (out)
+            std::memcpy(out, config.data(), config.size());
+    }
+
+    void FrameLogWriter::write_message(const sensor_msgs::PointCloud2 &msg, uint64_t stamp)
+    {
+        const size_t size = sizeof(MessageLayout) + msg.fields.size() * sizeof(FieldLayout) + msg.data.size();
+        uint8_t *out = begin(LogRecord::FILTER_INPUT, 0, stamp, msg.header.seq, msg.width * msg.height, size);
+        if (!out)
+            return;
+
+        MessageLayout layout = {};
+        layout.width = msg.width;
+        layout.height = msg.height;
+        layout.point_step = msg.point_step;
+        layout.row_step = msg.row_step;
+        layout.is_bigendian = msg.is_bigendian;
+        layout.is_dense = msg.is_dense;
+        layout.num_fields = static_cast<uint16_t>(msg.fields.size());
+        std::memcpy(out, &layout, sizeof(layout));
+        out += sizeof(layout);
+        for (const sensor_msgs::PointField &f : msg.fields)
+        {
+            FieldLayout field = {};
+            std::strncpy(field.name, f.name.c_str(), sizeof(field.name) - 1);
+            field.offset = f.offset;
+            field.count = f.count;
+            field.datatype = f.datatype;
+            std::memcpy(out, &field, sizeof(field));
+            out += sizeof(field);
+        }
+        std::memcpy(out, msg.data.data(), msg.data.size());
+    }
+
+    void FrameLogWriter::write_objects(const boost::container::vector<pcl::PointXYZ> &centres, const boost::container::vector<int> &ids,
+                                       uint64_t stamp, uint32_t seq, uint32_t status)
+    {
+        LogObject *out = reinterpret_cast<LogObject *>(
+            begin(LogRecord::TRACKER_OUTPUT, status, stamp, seq, ids.size(), ids.size() * sizeof(LogObject)));
+        if (!out)
+            return;
+        for (int id : ids)
+        {
+            LogObject &o = *out++;
+            o.id = id;
+            o.x = id == -1 ? 0.f : centres[id].x;
+            o.y = id == -1 ? 0.f : centres[id].y;
+            o.z = id == -1 ? 0.f : centres[id].z;
+        }
+    }
+
+    bool FrameLogReader::open(const std::string &path)
+    {
+        close();
+        fd_ = ::open(path.c_str(), O_RDONLY);
+        struct stat st;
+        if (fd_ < 0 || fstat(fd_, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(FileHeader))
+        {
+            close();
+            return false;
+        }
+        void *data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd_, 0);
+        if (data == MAP_FAILED)
+        {
+            close();
+            return false;
+        }
+        data_ = static_cast<const uint8_t *>(data);
+        size_ = st.st_size;
+
+        FileHeader header;
+        std::memcpy(&header, data_, sizeof(header));
+        if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != VERSION)
+        {
+            close();
+            return false;
+        }
+        rewind();
+        return true;
+    }
+
+    void FrameLogReader::close()
+    {
+        if (data_)
+        {
+            munmap(const_cast<uint8_t *>(data_), size_);
+            data_ = nullptr;
+        }
+        if (fd_ >= 0)
+        {
+            ::close(fd_);
+            fd_ = -1;
+        }
+        size_ = offset_ = 0;
+    }
+
+    void FrameLogReader::rewind()
+    {
+        offset_ = sizeof(FileHeader);
+    }
+
+    bool FrameLogReader::next(LogEntry &entry)
+    {
+        // A log of a process that did not close it ends in zeros, which is no valid record type
+        if (!data_ || offset_ + sizeof(LogRecordHeader) > size_)
+            return false;
+        std::memcpy(&entry.header, data_ + offset_, sizeof(LogRecordHeader));
+        const size_t end = offset_ + sizeof(LogRecordHeader) + padded(entry.header.size);
+        if (entry.header.type == 0 || end > size_)
+            return false;
+        entry.payload = data_ + offset_ + sizeof(LogRecordHeader);
+        offset_ = end;
+        return true;
+    }
+
+    std::map<std::string, std::string> parse_log_config(const LogEntry &entry)
+    {
+        std::map<std::string, std::string> config;
+        std::istringstream in(std::string(reinterpret_cast<const char *>(entry.payload), entry.header.size));
+        std::string name, value;
+        while (in >> name >> value)
+            config[name] = value;
+        return config;
+    }
+
+    bool read_message(const LogEntry &entry, sensor_msgs::PointCloud2 &msg)
+    {
+        if (entry.type() != LogRecord::FILTER_INPUT || entry.header.size < sizeof(MessageLayout))
+            return false;
+        const uint8_t *in = entry.payload;
+        MessageLayout layout;
+        std::memcpy(&layout, in, sizeof(layout));
+        in += sizeof(layout);
+        const size_t fields_size = layout.num_fields * sizeof(FieldLayout);
+        if (sizeof(layout) + fields_size > entry.header.size)
+            return false;
+
+        msg.width = layout.width;
+        msg.height = layout.height;
+        msg.point_step = layout.point_step;
+        msg.row_step = layout.row_step;
+        msg.is_bigendian = layout.is_bigendian;
+        msg.is_dense = layout.is_dense;
+        msg.fields.resize(layout.num_fields);
+        for (sensor_msgs::PointField &f : msg.fields)
+        {
+            FieldLayout field;
+            std::memcpy(&field, in, sizeof(field));
+            in += sizeof(field);
+            f.name = field.name;
+            f.offset = field.offset;
+            f.count = field.count;
+            f.datatype = field.datatype;
+        }
+        msg.data.assign(in, entry.payload + entry.header.size);
+        msg.header.seq = entry.header.seq;
+        msg.header.stamp.fromNSec(entry.header.stamp * 1000ull);
+        return true;
+    }
+
+    void read_points(const LogEntry &entry, pcl::PointCloud<pcl::PointXYZ> &cloud)
+    {
+        const float *p = entry.points();
+        cloud.resize(std::min<size_t>(entry.header.count, entry.header.size / (3 * sizeof(float))));
+        for (pcl::PointXYZ &out : cloud)
+        {
+            out.x = *p++;
+            out.y = *p++;
+            out.z = *p++;
+        }
+        cloud.header.stamp = entry.header.stamp;
+        cloud.header.seq = entry.header.seq;
+    }
+}
@@ -0,0 +1,421 @@
+/* Copyright 2021 Kovács Gergely Attila
+*
+*   Licensed under the Apache License,
+*   Version 2.0(the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License.
+*
+*/
+
+#include <f1tenth_sensor_fusion/cloud_preprocessor.hpp>
+#include <f1tenth_sensor_fusion/clustering.hpp>
+#include <f1tenth_sensor_fusion/frame_log.hpp>
+#include <f1tenth_sensor_fusion/KFTracker.hpp>
+#include <f1tenth_sensor_fusion/point_types.hpp>
+#include <sensor_msgs/PointCloud2.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/*
+ * Replay of the frame logs recorded by the record_file parameter of the filter and tracker nodelets, without a ROS
+ * master.
+ *
+ * The inputs of every frame are pushed through the processing cores as fast as they go, with the parameters written
+ * at the start of the log, and the outputs are compared to the recorded ones: the status and the points of the
+ * filtered clouds, the status, cluster indices (so the identity of the tracked objects) and centres of the tracked
+ * objects. For each pipeline the throughput and latency percentiles of the cores and the number of frames whose
+ * outputs differ are reported. The exit status is 2 if any frame differs, so the tool can gate regressions.
+ *
+ * Usage: frame_replay [--tolerance 1e-4] [--repeat N] log...
+ */
+
+namespace f1tenth_sensor_fusion
+{
+    namespace
+    {
+        typedef std::chrono::steady_clock Clock;
+        typedef std::map<std::string, std::string> LogConfig;
+
+        /// Set a value from the config of a log, left untouched if the log does not have it.
+        template <class T>
+        void get(const LogConfig &config, const char *name, T &value)
+        {
+            LogConfig::const_iterator it = config.find(name);
+            if (it != config.end())
+                std::istringstream(it->second) >> value;
+        }
+
+        std::string get_string(const LogConfig &config, const char *name, const std::string &default_value)
+        {
+            LogConfig::const_iterator it = config.find(name);
+            return it == config.end() ? default_value : it->second;
+        }
+
+        /// Durations of the frames of a pipeline and the number of frames whose outputs differ.
+        struct ReplayStats
+        {
+            std::vector<double> ms;
+            size_t frames = 0, mismatches = 0;
+
+            void report(const char *pipeline) const
+            {
+                if (frames == 0)
+                    return;
+                std::vector<double> sorted = ms;
+                std::sort(sorted.begin(), sorted.end());
+                double sum = 0.0;
+                for (double v : sorted)
+                    sum += v;
+                std::printf("%s: %zu frames, %.1f frames/s, mean %.3f ms, p50 %.3f ms, p99 %.3f ms, max %.3f ms, %zu mismatched\n",
+                            pipeline, frames, 1000.0 * sorted.size() / std::max(sum, 1e-9), sum / sorted.size(),
+                            sorted[static_cast<size_t>(0.5 * (sorted.size() - 1) + 0.5)],
+                            sorted[static_cast<size_t>(0.99 * (sorted.size() - 1) + 0.5)], sorted.back(), mismatches);
+            }
+        };
+
+        bool same_point(const pcl::PointXYZ &a, const pcl::PointXYZ &b, float tolerance)
+        {
+            return std::fabs(a.x - b.x) <= tolerance && std::fabs(a.y - b.y) <= tolerance && std::fabs(a.z - b.z) <= tolerance;
+        }
+
+        /// The core of pointcloud_filter_nodelet, configured by the FILTER_CONFIG record of a log.
+        class FilterReplay
+        {
+        public:
+            FilterReplay(const LogConfig &config, float tolerance) : tolerance_(tolerance)
+            {
+                PreprocessorConfig c;
+                get(config, "leaf_size", c.leaf_size);
+                parse_voxel_mode(get_string(config, "voxel_mode", "centroid"), c.voxel_mode);
+                get(config, "segmentation", c.segmentation);
+                get(config, "ground_distance", c.ground.distance);
+                get(config, "ground_min_inliers", c.ground.min_inliers);
+                get(config, "ground_max_iterations", c.ground.max_iterations);
+                get(config, "ground_time_budget", c.ground.time_budget);
+                get(config, "ground_sample_size", c.ground.sample_size);
+                get(config, "roi_min_x", c.roi.min_x);
+                get(config, "roi_max_x", c.roi.max_x);
+                get(config, "roi_min_y", c.roi.min_y);
+                get(config, "roi_max_y", c.roi.max_y);
+                get(config, "min_height", c.roi.min_height);
+                get(config, "max_height", c.roi.max_height);
+                get(config, "min_range", c.roi.min_range);
+                get(config, "max_range", c.roi.max_range);
+                preprocessor_.set_config(c);
+                parse_point_type(get_string(config, "point_type", "xyz"), point_type_);
+            }
+
+            /// Apply the leaf size set by the latency controller of the nodelet.
+            void tune(const LogConfig &config)
+            {
+                float leaf_size = preprocessor_.config().leaf_size;
+                get(config, "leaf_size", leaf_size);
+                preprocessor_.set_leaf_size(leaf_size);
+            }
+
+            /// Read the message of a frame, it is processed once the records before its output are read.
+            void input(const LogEntry &entry)
+            {
+                // The message is rebuilt here, outside of the timing, as the nodelet receives it ready
+                pending_ = read_message(entry, msg_);
+                iterations_ = -1;
+            }
+
+            /// The RANSAC iterations the frame took when it was recorded, replayed whatever the time budget.
+            void ground(const LogEntry &entry) { iterations_ = static_cast<int>(entry.header.count); }
+
+            void output(const LogEntry &entry, ReplayStats &stats)
+            {
+                if (!pending_)
+                    return;
+                pending_ = false;
+                process(stats);
+                if (point_type_ == PointType::XYZI)
+                    copy_coordinates(xyzi_);
+                else if (point_type_ == PointType::XYZRGB)
+                    copy_coordinates(xyzrgb_);
+                read_points(entry, recorded_);
+                if (static_cast<uint32_t>(status_) != entry.header.status || !same_cloud())
+                    stats.mismatches++;
+            }
+
+        private:
+            void process(ReplayStats &stats)
+            {
+                // Logs recorded before the iterations were logged have no FILTER_GROUND records, they run to the deadline
+                if (iterations_ >= 0)
+                    preprocessor_.force_ground_iterations(iterations_);
+                const Clock::time_point start = Clock::now();
+                switch (point_type_)
+                {
+                case PointType::XYZ:
+                    status_ = preprocessor_.process(msg_, xyz_);
+                    break;
+                case PointType::XYZI:
+                    status_ = preprocessor_.process(msg_, xyzi_);
+                    break;
+                case PointType::XYZRGB:
+                    status_ = preprocessor_.process(msg_, xyzrgb_);
+                    break;
+                }
+                stats.ms.push_back(std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+                stats.frames++;
+            }
+
+            template <class PointT>
+            void copy_coordinates(const pcl::PointCloud<PointT> &cloud)
+            {
+                xyz_.resize(cloud.size());
+                for (size_t i = 0; i < cloud.size(); i++)
+                    xyz_[i].getVector3fMap() = cloud[i].getVector3fMap();
+            }
+
+            bool same_cloud()
+            {
+                if (status_ == PreprocessStatus::NO_XYZ_FIELDS)
+                    return true;
+                if (xyz_.size() != recorded_.size())
+                    return false;
+                for (size_t i = 0; i < xyz_.size(); i++)
+                    if (!same_point(xyz_[i], recorded_[i], tolerance_))
+                        return false;
+                return true;
+            }
+
+            CloudPreprocessor preprocessor_;
+            PointType point_type_ = PointType::XYZ;
+            sensor_msgs::PointCloud2 msg_;
+            pcl::PointCloud<pcl::PointXYZ> xyz_, recorded_;
+            pcl::PointCloud<pcl::PointXYZI> xyzi_;
+            pcl::PointCloud<pcl::PointXYZRGB> xyzrgb_;
+            PreprocessStatus status_ = PreprocessStatus::OK;
+            float tolerance_;
+            bool pending_ = false; ///< an input was read, it is processed and compared at the next FILTER_OUTPUT record
+            int iterations_ = -1;  ///< RANSAC iterations of the pending frame, -1 if the log does not have them
+        };
+
+        /// The clustering and tracking of ClusterTracker, configured by the TRACKER_CONFIG record of a log.
+        class TrackerReplay
+        {
+        public:
+            TrackerReplay(const LogConfig &config, float tolerance) : cloud_(new pcl::PointCloud<pcl::PointXYZ>), tolerance_(tolerance)
+            {
+                ClusteringMethod method = ClusteringMethod::EUCLIDEAN;
+                parse_clustering_method(get_string(config, "clustering", "euclidean"), method);
+                double tolerance_m = 0.1, seed_gate = 0.5;
+                int full_interval = 10, parallel_frames = 1;
+                get(config, "tolerance", tolerance_m);
+                get(config, "min_cluster_size", min_size_);
+                get(config, "max_cluster_size", max_size_);
+                get(config, "seed_gate", seed_gate);
+                get(config, "full_clustering_interval", full_interval);
+                get(config, "parallel_frames", parallel_frames);
+                clustering_ = make_clustering_backend(method, tolerance_m, min_size_, max_size_, seed_gate, full_interval);
+                seeded_ = method == ClusteringMethod::SEEDED;
+                if (seeded_ && parallel_frames > 1)
+                    std::fprintf(stderr, "Tracker recorded with seeded clustering of %d parallel frames, the seeds of a frame may differ\n",
+                                 parallel_frames);
+
+                AssignmentMethod assignment = AssignmentMethod::HUNGARIAN;
+                parse_assignment_method(get_string(config, "assignment", "hungarian"), assignment);
+                double max_match_distance = 0.0;
+                get(config, "max_match_distance", max_match_distance);
+                tracker_.set_assignment(assignment, static_cast<float>(max_match_distance));
+                int max_missed = 20;
+                get(config, "max_missed", max_missed);
+                tracker_.set_max_missed(max_missed);
+
+                MotionModelConfig motion;
+                parse_motion_model(get_string(config, "motion_model", "cv"), motion.model);
+                get(config, "accel_noise", motion.accel_noise);
+                get(config, "jerk_noise", motion.jerk_noise);
+                get(config, "yaw_accel_noise", motion.yaw_accel_noise);
+                get(config, "measurement_noise", motion.measurement_noise);
+                get(config, "initial_speed", motion.initial_speed);
+                get(config, "initial_yaw_rate", motion.initial_yaw_rate);
+                get(config, "imm_switch", motion.imm_switch);
+                get(config, "frame_period", motion.frame_period);
+                get(config, "max_frame_gap", motion.max_frame_gap);
+                tracker_.set_motion_model(motion);
+            }
+
+            void reset() { tracker_.reset(); }
+
+            /// Apply the point budget set by the latency controller of the nodelet.
+            void tune(const LogConfig &config) { get(config, "point_budget", point_budget_); }
+
+            void input(const LogEntry &entry, ReplayStats &stats)
+            {
+                read_points(entry, *cloud_);
+                const Clock::time_point start = Clock::now();
+                clustering_->set_seeds(seeds_);
+                extract_within_budget(*clustering_, cloud_, point_budget_, min_size_, max_size_, subsampled_, clusters_);
+                compute_centroids(*cloud_, clusters_, centres_);
+                status_ = tracker_.track(centres_, cloud_->header.stamp * 1e-6, ids_);
+                if (seeded_)
+                    tracker_.positions(seeds_);
+                stats.ms.push_back(std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+                stats.frames++;
+                pending_ = true;
+            }
+
+            void output(const LogEntry &entry, ReplayStats &stats)
+            {
+                if (!pending_)
+                    return;
+                pending_ = false;
+                if (static_cast<uint32_t>(status_) != entry.header.status || !same_objects(entry))
+                    stats.mismatches++;
+            }
+
+        private:
+            bool same_objects(const LogEntry &entry) const
+            {
+                if (ids_.size() != entry.header.count)
+                    return false;
+                const LogObject *objects = entry.objects();
+                for (size_t i = 0; i < ids_.size(); i++)
+                {
+                    const LogObject &o = objects[i];
+                    if (o.id != ids_[i])
+                        return false;
+                    if (o.id != -1 && !same_point(centres_[o.id], pcl::PointXYZ(o.x, o.y, o.z), tolerance_))
+                        return false;
+                }
+                return true;
+            }
+
+            std::unique_ptr<ClusteringBackend> clustering_;
+            int min_size_ = 20, max_size_ = 100;
+            size_t point_budget_ = 0;
+            KFTracker tracker_;
+            pcl::PointCloud<pcl::PointXYZ>::Ptr cloud_, subsampled_;
+            std::vector<pcl::PointIndices> clusters_;
+            PointVector centres_, seeds_;
+            boost::container::vector<int> ids_;
+            FrameStatus status_ = FrameStatus::TRACKED;
+            float tolerance_;
+            bool seeded_ = false;
+            bool pending_ = false;
+        };
+
+        /// Replay a log once, from a fresh filter and tracker.
+        void replay(FrameLogReader &log, float tolerance, ReplayStats &filter_stats, ReplayStats &tracker_stats)
+        {
+            std::unique_ptr<FilterReplay> filter;
+            std::unique_ptr<TrackerReplay> tracker;
+            LogEntry entry;
+            log.rewind();
+            while (log.next(entry))
+            {
+                switch (entry.type())
+                {
+                case LogRecord::FILTER_CONFIG:
+                    filter.reset(new FilterReplay(parse_log_config(entry), tolerance));
+                    break;
+                case LogRecord::FILTER_TUNING:
+                    if (filter)
+                        filter->tune(parse_log_config(entry));
+                    break;
+                case LogRecord::FILTER_INPUT:
+                    if (filter)
+                        filter->input(entry);
+                    break;
+                case LogRecord::FILTER_GROUND:
+                    if (filter)
+                        filter->ground(entry);
+                    break;
+                case LogRecord::FILTER_OUTPUT:
+                    if (filter)
+                        filter->output(entry, filter_stats);
+                    break;
+                case LogRecord::TRACKER_CONFIG:
+                    tracker.reset(new TrackerReplay(parse_log_config(entry), tolerance));
+                    break;
+                case LogRecord::TRACKER_TUNING:
+                    if (tracker)
+                        tracker->tune(parse_log_config(entry));
+                    break;
+                case LogRecord::TRACKER_RESET:
+                    if (tracker)
+                        tracker->reset();
+                    break;
+                case LogRecord::TRACKER_INPUT:
+                    if (tracker)
+                        tracker->input(entry, tracker_stats);
+                    break;
+                case LogRecord::TRACKER_OUTPUT:
+                    if (tracker)
+                        tracker->output(entry, tracker_stats);
+                    break;
+                }
+            }
+        }
+
+        int usage(const char *name)
+        {
+            std::fprintf(stderr, "Usage: %s [--tolerance METERS] [--repeat N] log...\n", name);
+            return 1;
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    using namespace f1tenth_sensor_fusion;
+
+    float tolerance = 1e-4f;
+    int repeat = 1;
+    std::vector<std::string> logs;
+    for (int i = 1; i < argc; i++)
+    {
+        const bool has_value = i + 1 < argc;
+        if (!std::strcmp(argv[i], "--tolerance") && has_value)
+            tolerance = static_cast<float>(std::atof(argv[++i]));
+        else if (!std::strcmp(argv[i], "--repeat") && has_value)
+            repeat = std::max(std::atoi(argv[++i]), 1);
+        else if (argv[i][0] == '-')
+            return usage(argv[0]);
+        else
+            logs.push_back(argv[i]);
+    }
+    if (logs.empty())
+        return usage(argv[0]);
+
+    bool mismatch = false;
+    for (const std::string &path : logs)
+    {
+        FrameLogReader log;
+        if (!log.open(path))
+        {
+            std::fprintf(stderr, "%s: not a frame log\n", path.c_str());
+            return 1;
+        }
+        ReplayStats filter_stats, tracker_stats;
+        for (int r = 0; r < repeat; r++)
+            replay(log, tolerance, filter_stats, tracker_stats);
+
+        std::printf("== %s\n", path.c_str());
+        filter_stats.report("filter");
+        tracker_stats.report("tracker");
+        mismatch = mismatch || filter_stats.mismatches > 0 || tracker_stats.mismatches > 0;
+    }
+    return mismatch ? 2 : 0;
+}
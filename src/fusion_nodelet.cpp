@@ -0,0 +1,218 @@
+/* Copyright 2021 Kovács Gergely Attila
+*
+*   Licensed under the Apache License,
+*   Version 2.0(the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License. 
+*   
+*/
+
+#include <f1tenth_sensor_fusion/fusion_nodelet.h>
+#include <f1tenth_sensor_fusion/cloud_transform.hpp>
+#include <pluginlib/class_list_macros.h>
+#include <cstdint>
+
+namespace f1tenth_sensor_fusion
+{
+    FusionNodelet::FusionNodelet() {}
+
+    void FusionNodelet::onInit()
+    {
+        private_nh_ = getPrivateNodeHandle();
+
+        std::string lidar_topic, camera_topic, output_topic, assignment;
+        private_nh_.param<std::string>("lidar_topic", lidar_topic, "laser_cloud/detections");
+        private_nh_.param<std::string>("camera_topic", camera_topic, "camera_cloud/detections");
+        private_nh_.param<std::string>("output_topic", output_topic, "fusion/detections");
+        private_nh_.param<std::string>("assignment", assignment, "hungarian");
+        private_nh_.param<float>("max_match_distance", max_match_distance_, 0.3f);
+        private_nh_.param<float>("lidar_weight", lidar_weight_, 0.5f);
+        private_nh_.param<int>("camera_id_offset", camera_id_offset_, 1000000000);
+        int queue_size = private_nh_.param<int>("queue_size", 10);
+        double max_interval = private_nh_.param<double>("max_interval", 0.1);
+        int concurrency = private_nh_.param<int>("concurrency_level", 1);
+        private_nh_.param<double>("stale_timeout", stale_timeout_, 0.5);
+
+        AssignmentMethod method = AssignmentMethod::HUNGARIAN;
+        if (!parse_assignment_method(assignment, method))
+            NODELET_WARN("Unknown assignment method \"%s\", using hungarian", assignment.c_str());
+        solver_ = make_assignment_solver(method);
+
+        // Check if explicitly single threaded, otherwise, let nodelet manager dictate thread pool size
+        if (concurrency == 1)
+        {
+            nh_ = getNodeHandle();
+        }
+        else
+        {
+            nh_ = getMTNodeHandle();
+        }
+
+        tf2_.reset(new tf2_ros::Buffer());
+        tf2_listener_.reset(new tf2_ros::TransformListener(*tf2_));
+
+        pub_ = nh_.advertise<ObjectMessage>(output_topic, 100);
+        timers_.advertise(private_nh_, "stats", private_nh_.param<double>("stats_period", 1.0));
+
+        // The synchronizer buffers at most queue_size messages per stream, the trackers publish into it without waiting
+        sync_.reset(new message_filters::Synchronizer<DetectionSyncPolicy>(DetectionSyncPolicy(queue_size), lidar_sub_, camera_sub_));
+        sync_->setMaxIntervalDuration(ros::Duration(max_interval));
+        sync_->registerCallback(boost::bind(&FusionNodelet::detectionsCallback, this, _1, _2));
+        lidar_sub_.registerCallback(boost::bind(&FusionNodelet::lidarCallback, this, _1));
+        camera_sub_.registerCallback(boost::bind(&FusionNodelet::cameraCallback, this, _1));
+        lidar_sub_.subscribe(nh_, lidar_topic, queue_size);
+        camera_sub_.subscribe(nh_, camera_topic, queue_size);
+
+        NODELET_INFO("Fusion nodelet initialized, fusing %s and %s into %s", lidar_topic.c_str(), camera_topic.c_str(),
+                     output_topic.c_str());
+    }
+
+    void FusionNodelet::collect_objects(const ObjectMessage &msg, PointVector &centres, boost::container::vector<int> &ids) const
+    {
+        centres.clear();
+        ids.clear();
+        for (size_t i = 0; i < msg.data.size(); i++)
+        {
+            const ObjectData &o = msg.data[i];
+            if (o.ID == -1)
+                continue;
+            centres.push_back(pcl::PointXYZ(o.centre[0], o.centre[1], o.centre[2]));
+            ids.push_back(o.ID);
+        }
+    }
+
+    bool FusionNodelet::transform_camera_centres(const std::string &camera_frame, const std::string &lidar_frame)
+    {
+        try
+        {
+            // The sensors are mounted statically, the latest transform is exact
+            geometry_msgs::TransformStamped t = tf2_->lookupTransform(lidar_frame, camera_frame, ros::Time(0));
+            const Eigen::Affine3f transform = transform_to_eigen(t.transform);
+            for (pcl::PointXYZ &c : camera_centres_)
+                c.getVector3fMap() = transform * c.getVector3fMap();
+        }
+        catch (tf2::TransformException &ex)
+        {
+            NODELET_WARN_THROTTLE(1.0, "%s", ex.what());
+            return false;
+        }
+        return true;
+    }
+
+    bool FusionNodelet::stale(const ros::Time &last_received, const ros::Time &now) const
+    {
+        return stale_timeout_ > 0.0 && (last_received.isZero() || (now - last_received).toSec() > stale_timeout_);
+    }
+
+    void FusionNodelet::lidarCallback(const ObjectMessage::ConstPtr &lidar)
+    {
+        boost::mutex::scoped_lock lock(mutex_);
+        lidar_received_ = ros::Time::now();
+        lidar_frame_ = lidar->header.frame_id;
+        // Pairs are fused by the synchronizer, only the detections without a partner are handled here
+        if (stale(camera_received_, lidar_received_))
+            fuse(lidar.get(), nullptr);
+    }
+
+    void FusionNodelet::cameraCallback(const ObjectMessage::ConstPtr &camera)
+    {
+        boost::mutex::scoped_lock lock(mutex_);
+        camera_received_ = ros::Time::now();
+        if (stale(lidar_received_, camera_received_))
+            fuse(nullptr, camera.get());
+    }
+
+    void FusionNodelet::detectionsCallback(const ObjectMessage::ConstPtr &lidar, const ObjectMessage::ConstPtr &camera)
+    {
+        boost::mutex::scoped_lock lock(mutex_);
+        fuse(lidar.get(), camera.get());
+    }
+
+    void FusionNodelet::fuse(const ObjectMessage *lidar, const ObjectMessage *camera)
+    {
+        if (lidar)
+            collect_objects(*lidar, lidar_centres_, lidar_ids_);
+        else
+        {
+            lidar_centres_.clear();
+            lidar_ids_.clear();
+        }
+        if (camera)
+            collect_objects(*camera, camera_centres_, camera_ids_);
+        else
+        {
+            camera_centres_.clear();
+            camera_ids_.clear();
+        }
+
+        // Without LiDAR detections the camera objects are still published in its frame, once it is known
+        const std::string &frame = lidar ? lidar->header.frame_id : lidar_frame_.empty() ? camera->header.frame_id : lidar_frame_;
+        if (camera && camera->header.frame_id != frame)
+        {
+            ScopedStageTimer timer(timers_, STAGE_TF);
+            if (!transform_camera_centres(camera->header.frame_id, frame))
+                camera_centres_.clear();
+        }
+
+        {
+            ScopedStageTimer timer(timers_, STAGE_MATCHING);
+            solver_->solve(lidar_centres_, camera_centres_, max_match_distance_, assignment_);
+        }
+
+        ObjectMessage::Ptr fused(new ObjectMessage);
+        {
+            ScopedStageTimer timer(timers_, STAGE_MERGE);
+            fused->header = lidar ? lidar->header : camera->header;
+            fused->header.frame_id = frame;
+            fused->data.reserve(lidar_centres_.size() + camera_centres_.size());
+            camera_used_.assign(camera_centres_.size(), false);
+
+            // Objects seen by the LiDAR keep its IDs, matched camera objects refine their position
+            for (size_t i = 0; i < lidar_centres_.size(); i++)
+            {
+                ObjectData o;
+                o.ID = lidar_ids_[i];
+                Eigen::Vector3f centre = lidar_centres_[i].getVector3fMap();
+                if (assignment_[i] != -1)
+                {
+                    camera_used_[assignment_[i]] = true;
+                    centre = lidar_weight_ * centre + (1.f - lidar_weight_) * camera_centres_[assignment_[i]].getVector3fMap();
+                }
+                o.centre[0] = centre.x();
+                o.centre[1] = centre.y();
+                o.centre[2] = centre.z();
+                fused->data.push_back(o);
+            }
+
+            // Objects only the camera sees, their IDs are offset to keep them apart from the LiDAR's
+            for (size_t j = 0; j < camera_centres_.size(); j++)
+            {
+                if (camera_used_[j])
+                    continue;
+                ObjectData o;
+                // added as unsigned, a signed overflow would be undefined: IDs past the range of int32 wrap around
+                o.ID = static_cast<int32_t>(static_cast<uint32_t>(camera_ids_[j]) + static_cast<uint32_t>(camera_id_offset_));
+                o.centre[0] = camera_centres_[j].x;
+                o.centre[1] = camera_centres_[j].y;
+                o.centre[2] = camera_centres_[j].z;
+                fused->data.push_back(o);
+            }
+        }
+
+        {
+            ScopedStageTimer timer(timers_, STAGE_PUBLISH);
+            pub_.publish(fused);
+        }
+        timers_.record_since(STAGE_LATENCY, fused->header.stamp);
+    }
+}
+
+PLUGINLIB_EXPORT_CLASS(f1tenth_sensor_fusion::FusionNodelet, nodelet::Nodelet);
@@ -0,0 +1,132 @@
+/* Copyright 2021 Kovács Gergely Attila
+*
+*   Licensed under the Apache License,
+*   Version 2.0(the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License.
+*
+*/
+
+#include <f1tenth_sensor_fusion/ground_filter.hpp>
+#include <Eigen/Eigenvalues>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+namespace f1tenth_sensor_fusion
+{
+    namespace
+    {
+        template <class PointT>
+        inline float plane_distance(const Eigen::Vector4f &plane, const PointT &p)
+        {
+            return std::fabs(plane[0] * p.x + plane[1] * p.y + plane[2] * p.z + plane[3]);
+        }
+    }
+
+    GroundPlaneFilter::GroundPlaneFilter(const GroundFilterConfig &config)
+        : config_(config), plane_(0.f, 0.f, 1.f, 0.f)
+    {
+    }
+
+    template <class PointT>
+    bool GroundPlaneFilter::refit(const pcl::PointCloud<PointT> &cloud, Eigen::Vector4f &plane) const
+    {
+        // Sums for the mean and covariance of the inliers, in double to keep the covariance accurate
+        Eigen::Vector3d sum = Eigen::Vector3d::Zero();
+        Eigen::Matrix3d sq_sum = Eigen::Matrix3d::Zero();
+        size_t n = 0;
+        for (const PointT &p : cloud)
+        {
+            if (plane_distance(plane, p) > config_.distance)
+                continue;
+            const Eigen::Vector3d v(p.x, p.y, p.z);
+            sum += v;
+            sq_sum += v * v.transpose();
+            n++;
+        }
+        if (n < 3 || n < config_.min_inliers * cloud.size())
+            return false;
+
+        const Eigen::Vector3d mean = sum / n;
+        const Eigen::Matrix3d covariance = sq_sum / n - mean * mean.transpose();
+        Eigen::SelfAdjointEigenSolver<Eigen::Matrix3d> solver(covariance);
+        // the normal is the direction of the smallest variance, eigenvalues are sorted increasingly
+        Eigen::Vector3d normal = solver.eigenvectors().col(0);
+        if (normal.dot(plane.head<3>().cast<double>()) < 0)
+            normal = -normal;
+        plane << normal.cast<float>(), static_cast<float>(-normal.dot(mean));
+        return true;
+    }
+
+    template <class PointT>
+    bool GroundPlaneFilter::ransac(const pcl::PointCloud<PointT> &cloud, Eigen::Vector4f &plane)
+    {
+        const size_t n = cloud.size();
+        if (n < 3)
+            return false;
+        // A forced count replays a recorded frame, so the deadline of the recording is not checked again
+        const bool forced = forced_iterations_ >= 0;
+        const int max_iterations = forced ? forced_iterations_ : config_.max_iterations;
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::duration<double>(config_.time_budget);
+        std::uniform_int_distribution<size_t> pick(0, n - 1);
+
+        // Hypotheses are scored on random points, a regular stride could alias with the structure of organized clouds
+        sample_.resize(std::min<size_t>(n, std::max(config_.sample_size, 1)));
+        for (size_t &i : sample_)
+            i = pick(rng_);
+
+        size_t best_score = 0;
+        for (; iterations_ < max_iterations && (forced || std::chrono::steady_clock::now() < deadline); iterations_++)
+        {
+            const Eigen::Vector3f a = cloud[pick(rng_)].getVector3fMap(), b = cloud[pick(rng_)].getVector3fMap(),
+                                  c = cloud[pick(rng_)].getVector3fMap();
+            Eigen::Vector3f normal = (b - a).cross(c - a);
+            const float norm = normal.norm();
+            if (norm < 1e-6f) // collinear or repeated samples
+                continue;
+            normal /= norm;
+            const Eigen::Vector4f candidate(normal.x(), normal.y(), normal.z(), -normal.dot(a));
+
+            size_t score = 0;
+            for (size_t i : sample_)
+                score += plane_distance(candidate, cloud[i]) <= config_.distance;
+            if (score > best_score)
+            {
+                best_score = score;
+                plane = candidate;
+            }
+        }
+        return best_score > 0 && refit(cloud, plane);
+    }
+
+    template <class PointT>
+    bool GroundPlaneFilter::remove(pcl::PointCloud<PointT> &cloud)
+    {
+        Eigen::Vector4f plane = plane_;
+        iterations_ = 0;
+        tracked_ = (tracked_ && refit(cloud, plane)) || ransac(cloud, plane);
+        forced_iterations_ = -1;
+        if (!tracked_)
+            return false;
+        plane_ = plane;
+
+        auto end = std::remove_if(cloud.begin(), cloud.end(), [&plane, this](const PointT &p) {
+            return plane_distance(plane, p) <= config_.distance;
+        });
+        cloud.resize(end - cloud.begin());
+        return true;
+    }
+
+    template bool GroundPlaneFilter::remove(pcl::PointCloud<pcl::PointXYZ> &);
+    template bool GroundPlaneFilter::remove(pcl::PointCloud<pcl::PointXYZI> &);
+    template bool GroundPlaneFilter::remove(pcl::PointCloud<pcl::PointXYZRGB> &);
+}
@@ -39,11 +39,13 @@
  */
 
 #include <f1tenth_sensor_fusion/laserscan_to_pointcloud_nodelet.h>
+#include <f1tenth_sensor_fusion/cloud_transform.hpp>
 #include <sensor_msgs/LaserScan.h>
 #include <pluginlib/class_list_macros.h>
-#include <sensor_msgs/point_cloud2_iterator.h>
+#include <pcl_conversions/pcl_conversions.h>
+#include <pcl_ros/point_cloud.h>
+#include <algorithm>
 #include <string>
-#include <tf2_sensor_msgs/tf2_sensor_msgs.h>
 
 namespace f1tenth_sensor_fusion
 {
@@ -58,6 +60,8 @@ namespace f1tenth_sensor_fusion
 
     private_nh_.param<std::string>("target_frame", target_frame_, "");
     private_nh_.param<std::string>("subscription_topic", subscription_topic_, "scan");
+    private_nh_.param<bool>("static_transform", static_transform_, true);
+    private_nh_.param<bool>("drop_invalid", drop_invalid_, true);
     int concurrency_level = private_nh_.param("concurrency_level", 0);
 
 #ifndef NDEBUG
@@ -84,12 +88,21 @@ namespace f1tenth_sensor_fusion
       input_queue_size_ = boost::thread::hardware_concurrency();
     }
 
+    QueuePolicy policy = QueuePolicy::FIFO;
+    std::string queue_policy = private_nh_.param<std::string>("queue_policy", "fifo");
+    if (!parse_queue_policy(queue_policy, policy))
+      NODELET_WARN("Unknown queue policy \"%s\", using fifo", queue_policy.c_str());
+    int queue_size = private_nh_.param<int>("queue_size", 0);
+    queue_.configure(policy, queue_size > 0 ? queue_size : input_queue_size_, private_nh_.param<double>("queue_deadline", 0.1));
+    queue_.advertise_stats(private_nh_, "queue_stats", private_nh_.param<double>("queue_stats_period", 1.0));
+    timers_.advertise(private_nh_, "stats", private_nh_.param<double>("stats_period", 1.0));
+
     // if pointcloud target frame specified, we need to filter by transform availability
     if (!target_frame_.empty())
     {
       tf2_.reset(new tf2_ros::Buffer());
       tf2_listener_.reset(new tf2_ros::TransformListener(*tf2_));
-      message_filter_.reset(new MessageFilter(sub_, *tf2_, target_frame_, input_queue_size_, nh_));
+      message_filter_.reset(new MessageFilter(sub_, *tf2_, target_frame_, queue_.subscriber_queue_size(), nh_));
       message_filter_->registerCallback(boost::bind(&LaserScanToPointCloudNodelet::scanCallback, this, _1));
       message_filter_->registerFailureCallback(boost::bind(&LaserScanToPointCloudNodelet::failureCallback, this, _1, _2));
     }
@@ -99,7 +112,7 @@ namespace f1tenth_sensor_fusion
     }
 
     pub_ =
-        nh_.advertise<sensor_msgs::PointCloud2>("lidar_cloud", 10, boost::bind(&LaserScanToPointCloudNodelet::connectCb, this),
+        nh_.advertise<pcl::PointCloud<pcl::PointXYZ>>("lidar_cloud", 10, boost::bind(&LaserScanToPointCloudNodelet::connectCb, this),
                                                 boost::bind(&LaserScanToPointCloudNodelet::disconnectCb, this));
   }
 
@@ -109,7 +122,7 @@ namespace f1tenth_sensor_fusion
     if (pub_.getNumSubscribers() > 0 && sub_.getSubscriber().getNumPublishers() == 0)
     {
       NODELET_INFO("Got a subscriber to lidar_cloud, starting laserscan subscriber");
-      sub_.subscribe(nh_, subscription_topic_, input_queue_size_);
+      sub_.subscribe(nh_, subscription_topic_, queue_.subscriber_queue_size());
     }
   }
 
@@ -120,6 +133,7 @@ namespace f1tenth_sensor_fusion
     {
       NODELET_INFO("No subscibers to lidar_cloud, shutting down subscriber to laserscan");
       sub_.unsubscribe();
+      queue_.clear();
     }
   }
 
@@ -146,27 +160,71 @@ namespace f1tenth_sensor_fusion
 
   void LaserScanToPointCloudNodelet::scanCallback(const sensor_msgs::LaserScanConstPtr &scan_msg)
   {
-    sensor_msgs::PointCloud2Ptr scan_cloud;
-    scan_cloud.reset(new sensor_msgs::PointCloud2);
-    projector_.projectLaser(*scan_msg, *scan_cloud);
+    queue_.push(scan_msg);
 
-    // Transform cloud if necessary
-    if (!target_frame_.empty() && scan_cloud->header.frame_id != target_frame_)
+    // One thread processes the queue at a time, the others only add their scan to it
+    while (!processing_.exchange(true))
     {
-      /* std::stringstream ss;
-      ss << "Converting frames from " << scan_msg->header.frame_id << " to " << target_frame_ << ".";
-      NODELET_INFO(ss.str().c_str()); */
-      try
-      {
-        *scan_cloud = tf2_->transform(*scan_cloud, target_frame_);
-      }
-      catch (tf2::TransformException &ex)
-      {
-        NODELET_ERROR_STREAM("Transform failure: " << ex.what());
+      sensor_msgs::LaserScanConstPtr next;
+      while (queue_.pop(next))
+        process(next);
+      processing_ = false;
+
+      // A scan pushed after the queue was found empty but before the flag was cleared would be left behind otherwise
+      if (queue_.empty())
         return;
-      }
     }
-    pub_.publish(*scan_cloud);
+  }
+
+  bool LaserScanToPointCloudNodelet::update_transform(const std_msgs::Header &header)
+  {
+    if (target_frame_.empty() || (transform_cached_ && header.frame_id == laser_frame_))
+      return true;
+    try
+    {
+      geometry_msgs::TransformStamped t =
+          tf2_->lookupTransform(target_frame_, header.frame_id, static_transform_ ? ros::Time(0) : header.stamp);
+      transform_ = transform_to_eigen(t.transform);
+    }
+    catch (tf2::TransformException &ex)
+    {
+      NODELET_ERROR_STREAM("Transform failure: " << ex.what());
+      return false;
+    }
+    laser_frame_ = header.frame_id;
+    transform_cached_ = static_transform_;
+    return true;
+  }
+
+  void LaserScanToPointCloudNodelet::process(const sensor_msgs::LaserScanConstPtr &scan_msg)
+  {
+    {
+      ScopedStageTimer timer(timers_, STAGE_TF);
+      if (!update_transform(scan_msg->header))
+        return;
+    }
+
+    // Only one scan is processed at a time, and a cloud is reused once the subscribers dropped it. Intra-process
+    // subscribers hold on to it as long as they need, so there are as many clouds as scans still being used
+    auto cloud = std::find_if(cloud_pool_.begin(), cloud_pool_.end(),
+                              [](const pcl::PointCloud<pcl::PointXYZ>::Ptr &c) { return c.use_count() == 1; });
+    if (cloud == cloud_pool_.end())
+      cloud = cloud_pool_.insert(cloud_pool_.end(), pcl::PointCloud<pcl::PointXYZ>::Ptr(new pcl::PointCloud<pcl::PointXYZ>));
+
+    // The beams are projected straight into the target frame, without the intermediate PointCloud2 of laser_geometry
+    {
+      ScopedStageTimer timer(timers_, STAGE_PROJECTION);
+      projection_.project(*scan_msg, transform_, **cloud, drop_invalid_);
+      pcl_conversions::toPCL(scan_msg->header, (*cloud)->header);
+      if (!target_frame_.empty())
+        (*cloud)->header.frame_id = target_frame_;
+    }
+    // Handing over the shared pointer avoids serialization for subscribers within the same nodelet manager
+    {
+      ScopedStageTimer timer(timers_, STAGE_PUBLISH);
+      pub_.publish(*cloud);
+    }
+    timers_.record_since(STAGE_LATENCY, scan_msg->header.stamp);
   }
 } // namespace pointcloud_to_laserscan
 
@@ -0,0 +1,86 @@
+/* Copyright 2021 Kovács Gergely Attila
+*
+*   Licensed under the Apache License,
+*   Version 2.0(the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License.
+*
+*/
+
+#include <f1tenth_sensor_fusion/latency_controller.hpp>
+#include <algorithm>
+#include <cmath>
+
+namespace f1tenth_sensor_fusion
+{
+    namespace
+    {
+        constexpr double SMOOTHING = 0.2;   ///< weight of the latest frame in the moving average
+        constexpr double DEAD_BAND = 0.1;   ///< relative error left uncorrected
+        constexpr double RAISE_GAIN = 0.1;  ///< level added per frame at twice the target time
+        constexpr double LOWER_GAIN = 0.02; ///< level removed per frame at no processing time
+    }
+
+    void LatencyController::configure(double target, double finest, double coarsest)
+    {
+        target_ = target;
+        finest_ = finest;
+        coarsest_ = coarsest;
+        smoothed_ = 0.0;
+        level_ = 0.f;
+        value_ = finest;
+    }
+
+    bool LatencyController::update(double duration)
+    {
+        if (!enabled())
+            return false;
+        smoothed_ = smoothed_ > 0.0 ? SMOOTHING * duration + (1.0 - SMOOTHING) * smoothed_ : duration;
+        const double error = smoothed_ / target_ - 1.0;
+        if (std::abs(error) <= DEAD_BAND)
+            return false;
+
+        // Frames over the target hold up the ones behind them, so quality is given up faster than it is regained
+        const double step = error > 0.0 ? RAISE_GAIN * std::min(error, 1.0) : LOWER_GAIN * error;
+        const float level = static_cast<float>(std::min(std::max(level_ + step, 0.0), 1.0));
+        if (level == level_)
+            return false;
+        level_ = level;
+        value_ = finest_ * std::pow(coarsest_ / finest_, static_cast<double>(level_));
+        return true;
+    }
+
+    void LatencyController::advertise(ros::NodeHandle &nh, const std::string &topic, const std::string &parameter)
+    {
+        pub_ = nh.advertise<OperatingPoint>(topic, 10);
+        msg_.reset(new OperatingPoint);
+        msg_->parameter = parameter;
+    }
+
+    void LatencyController::publish(const ros::Time &stamp)
+    {
+        if (!msg_ || pub_.getNumSubscribers() == 0)
+            return;
+        // The message of the previous frame is refilled once every subscriber released it
+        if (msg_.use_count() > 1)
+        {
+            const std::string parameter = msg_->parameter;
+            msg_.reset(new OperatingPoint);
+            msg_->parameter = parameter;
+        }
+        msg_->header.stamp = stamp;
+        msg_->target = static_cast<float>(target_ * 1e3);
+        msg_->frame_time = static_cast<float>(smoothed_ * 1e3);
+        msg_->level = level_;
+        msg_->value = static_cast<float>(value_);
+        pub_.publish(msg_);
+    }
+}
@@ -0,0 +1,681 @@
+/* Copyright 2021 Kovács Gergely Attila
+*
+*   Licensed under the Apache License,
+*   Version 2.0(the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License.
+*
+*/
+
+#include <f1tenth_sensor_fusion/alloc_counter.hpp>
+#include <f1tenth_sensor_fusion/cloud_preprocessor.hpp>
+#include <f1tenth_sensor_fusion/clustering.hpp>
+#include <f1tenth_sensor_fusion/KFTracker.hpp>
+#include <f1tenth_sensor_fusion/point_types.hpp>
+#include <f1tenth_sensor_fusion/scan_projection.hpp>
+#include <rosbag/bag.h>
+#include <rosbag/view.h>
+#include <sensor_msgs/LaserScan.h>
+#include <sensor_msgs/PointCloud2.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+
+/*
+ * Offline benchmark of the processing cores of the nodelets on recorded bags, without a ROS master.
+ *
+ * The messages of a bag are loaded into memory first, so reading and decompressing the bag is not measured. Then
+ * every LiDAR scan is projected, clusterized and tracked, and every camera cloud is filtered, clusterized and tracked,
+ * with the parameters of the shipped .yaml files. For each pipeline, nodelet and stage the throughput, the latency
+ * percentiles and the number of heap allocations per frame are reported, the latter counted by the alloc_counter
+ * library when configured with COUNT_ALLOCATIONS. The stability of the tracks is measured without ground truth, see
+ * TrackingQuality. With --json the results are written to a file as well, to be compared between builds. With
+ * --max-id-switches or --max-births the tracking metrics of every pipeline are checked against the limits, and the
+ * benchmark exits with status 2 if any exceeds them.
+ *
+ * Usage: pipeline_bench [--lidar-topic /scan] [--camera-topic /mynteye/points/data_raw] [--segmentation] [--motion-model cv]
+ *                       [--seeded] [--point-type xyz] [--repeat N] [--json FILE] [--max-id-switches N] [--max-births R] bag...
+ */
+
+namespace f1tenth_sensor_fusion
+{
+    namespace
+    {
+        typedef std::chrono::steady_clock Clock;
+
+#ifndef F1TENTH_SENSOR_FUSION_COUNT_ALLOCATIONS
+        // without the counting operator new every stage reports no allocations
+        size_t thread_allocations()
+        {
+            return 0;
+        }
+#endif
+
+        /// Variants of the pipelines selected on the command line.
+        struct BenchOptions
+        {
+            bool segmentation = false; ///< remove the ground of the camera clouds
+            bool seeded = false;       ///< seeded clustering instead of the backends of the .yaml files
+            MotionModelConfig motion;
+            PointType point_type = PointType::XYZ; ///< points of the camera clouds
+            int repeat = 1;
+            long max_id_switches = -1; ///< limit of the ID switches of a pipeline per bag, negative for none
+            double max_births = -1.0;  ///< limit of the births per frame of a pipeline, negative for none
+        };
+
+        /// Durations and allocation counts of one stage, one sample per frame.
+        struct StageSamples
+        {
+            std::string name;
+            std::vector<double> ms;
+            std::vector<size_t> allocs;
+        };
+
+        // Recording a sample must not allocate, or it would be counted by the enclosing stages
+        void reserve(std::vector<StageSamples> &stages, size_t num_frames)
+        {
+            for (StageSamples &s : stages)
+            {
+                s.ms.reserve(num_frames);
+                s.allocs.reserve(num_frames);
+            }
+        }
+
+        /// Record the time and the allocations of a stage started at start, with allocs allocations made so far.
+        void record(StageSamples &stage, const Clock::time_point &start, size_t allocs)
+        {
+            const Clock::time_point end = Clock::now();
+            stage.ms.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+            stage.allocs.push_back(thread_allocations() - allocs);
+        }
+
+        /// Times a stage, from its construction (or the given start) to its destruction.
+        class Sample
+        {
+        public:
+            explicit Sample(StageSamples &stage)
+                : stage_(stage), allocs_(thread_allocations()), start_(Clock::now())
+            {
+            }
+            Sample(StageSamples &stage, const Clock::time_point &start, size_t allocs)
+                : stage_(stage), allocs_(allocs), start_(start)
+            {
+            }
+            ~Sample()
+            {
+                record(stage_, start_, allocs_);
+            }
+
+        private:
+            StageSamples &stage_;
+            const size_t allocs_;
+            const Clock::time_point start_;
+        };
+
+        double percentile(std::vector<double> sorted, double p)
+        {
+            if (sorted.empty())
+                return 0.0;
+            std::sort(sorted.begin(), sorted.end());
+            const size_t i = static_cast<size_t>(p * (sorted.size() - 1) + 0.5);
+            return sorted[i];
+        }
+
+        /**
+         * Stability of the tracks of a pipeline, measured without ground truth from the estimates after every frame.
+         *
+         * - churn: tracks created (_init_KFilter) and dropped (prune_unused_kfilters, reset) per frame
+         * - ID switches: tracks created within twice the matching gate of a track that lost its cluster in the same
+         *   frame, i.e. an object likely picked up under a new ID. Every lost track explains at most one
+         * - fragmentation: runs of frames with a matched cluster per track, more than one if the track lost its object
+         *   and found it again. Tracks matched in fewer than SHORT_TRACK frames are counted as short, most are clutter
+         *   or fragments of an object tracked under another ID
+         */
+        class TrackingQuality
+        {
+        public:
+            static constexpr size_t SHORT_TRACK = 5;
+
+            explicit TrackingQuality(float max_match_distance)
+                : sq_switch_distance_(4.f * max_match_distance * max_match_distance)
+            {
+                if (max_match_distance <= 0.f)
+                    sq_switch_distance_ = std::numeric_limits<float>::infinity();
+            }
+
+            void update(const boost::container::vector<TrackState> &tracks)
+            {
+                frames_++;
+                lost_.clear();
+                born_.clear();
+                next_.clear();
+                // Both are ordered by increasing ID
+                size_t o = 0;
+                for (const TrackState &t : tracks)
+                {
+                    for (; o < open_.size() && open_[o].id < t.id; o++)
+                        drop(open_[o]);
+                    const bool matched = t.missed == 0;
+                    if (o < open_.size() && open_[o].id == t.id)
+                    {
+                        Lifetime life = open_[o++];
+                        if (life.matched && !matched)
+                            lost_.push_back(life.position);
+                        if (matched && !life.matched)
+                            life.runs++;
+                        life.matched_frames += matched;
+                        life.matched = matched;
+                        life.position = t.position;
+                        next_.push_back(life);
+                    }
+                    else
+                    {
+                        born_.push_back(t.position);
+                        next_.push_back(Lifetime{t.id, 1, 1, true, t.position});
+                    }
+                }
+                for (; o < open_.size(); o++)
+                    drop(open_[o]);
+
+                births_ += born_.size();
+                for (const PlanarVector &b : born_)
+                {
+                    for (PlanarVector &p : lost_)
+                    {
+                        if ((p - b).squaredNorm() <= sq_switch_distance_)
+                        {
+                            id_switches_++;
+                            p.setConstant(std::numeric_limits<float>::quiet_NaN()); // explains no other switch
+                            break;
+                        }
+                    }
+                }
+                open_.swap(next_);
+            }
+
+            /// End the tracks still open, at the end of the frames.
+            void finish()
+            {
+                for (const Lifetime &life : open_)
+                    close(life, false);
+                open_.clear();
+            }
+
+            size_t frames() const { return frames_; }
+            size_t tracks() const { return closed_; }
+            size_t births() const { return births_; }
+            size_t deaths() const { return deaths_; }
+            size_t id_switches() const { return id_switches_; }
+            size_t short_tracks() const { return short_tracks_; }
+            double runs_per_track() const { return closed_ ? static_cast<double>(runs_) / closed_ : 0.0; }
+            double matched_frames_per_track() const { return closed_ ? static_cast<double>(matched_frames_) / closed_ : 0.0; }
+
+        private:
+            struct Lifetime
+            {
+                uint32_t id;
+                size_t matched_frames, runs;
+                bool matched;
+                PlanarVector position;
+            };
+
+            void drop(const Lifetime &life)
+            {
+                if (life.matched)
+                    lost_.push_back(life.position);
+                close(life);
+            }
+
+            void close(const Lifetime &life, bool dropped = true)
+            {
+                deaths_ += dropped;
+                closed_++;
+                runs_ += life.runs;
+                matched_frames_ += life.matched_frames;
+                short_tracks_ += life.matched_frames < SHORT_TRACK;
+            }
+
+            float sq_switch_distance_;
+            std::vector<Lifetime> open_, next_;
+            std::vector<PlanarVector> lost_, born_; ///< positions of the tracks that lost their cluster, and of the new ones
+            size_t frames_ = 0, births_ = 0, deaths_ = 0, id_switches_ = 0;
+            size_t closed_ = 0, runs_ = 0, matched_frames_ = 0, short_tracks_ = 0;
+        };
+
+        /// Results of every bag, written with --json.
+        class JsonReport
+        {
+        public:
+            void begin_bag(const std::string &path, size_t scans, size_t clouds)
+            {
+                if (!bags_.empty())
+                    bags_ += ",";
+                bags_ += "\n    {\"bag\": " + quote(path) + ", \"scans\": " + std::to_string(scans) + ", \"clouds\": " +
+                         std::to_string(clouds) + ", \"pipelines\": [";
+                first_pipeline_ = true;
+            }
+
+            void end_bag() { bags_ += "]}"; }
+
+            void add_pipeline(const std::string &pipeline, const std::vector<StageSamples> &nodelets, const std::vector<StageSamples> &stages,
+                              size_t num_clusters, size_t rejected, const TrackingQuality &quality)
+            {
+                const StageSamples &total = stages.back();
+                bags_ += first_pipeline_ ? "\n      " : ",\n      ";
+                first_pipeline_ = false;
+                bags_ += "{\"name\": " + quote(pipeline) + ", \"frames\": " + std::to_string(total.ms.size()) +
+                         ", \"rejected\": " + std::to_string(rejected) + ", \"fps\": " + number(fps(total)) +
+                         ", \"clusters_per_frame\": " + number(static_cast<double>(num_clusters) / std::max<size_t>(total.ms.size(), 1));
+                bags_ += ",\n       \"nodelets\": [" + summaries(nodelets) + "]";
+                bags_ += ",\n       \"stages\": [" + summaries(stages) + "]";
+                bags_ += ",\n       \"tracking\": {\"frames\": " + std::to_string(quality.frames()) +
+                         ", \"tracks\": " + std::to_string(quality.tracks()) +
+                         ", \"births\": " + std::to_string(quality.births()) +
+                         ", \"deaths\": " + std::to_string(quality.deaths()) +
+                         ", \"id_switches\": " + std::to_string(quality.id_switches()) +
+                         ", \"runs_per_track\": " + number(quality.runs_per_track()) +
+                         ", \"matched_frames_per_track\": " + number(quality.matched_frames_per_track()) +
+                         ", \"short_tracks\": " + std::to_string(quality.short_tracks()) + "}}";
+            }
+
+            bool write(const std::string &path) const
+            {
+                FILE *f = std::fopen(path.c_str(), "w");
+                if (!f)
+                    return false;
+                std::fprintf(f, "{\"bags\": [%s\n]}\n", bags_.c_str());
+                return std::fclose(f) == 0;
+            }
+
+            static double fps(const StageSamples &total)
+            {
+                double sum = 0.0;
+                for (double ms : total.ms)
+                    sum += ms;
+                return sum > 0.0 ? 1000.0 * total.ms.size() / sum : 0.0;
+            }
+
+        private:
+            static std::string number(double v)
+            {
+                char buffer[32];
+                std::snprintf(buffer, sizeof(buffer), "%.6g", v);
+                return buffer;
+            }
+
+            static std::string quote(const std::string &s)
+            {
+                std::string q = "\"";
+                for (char c : s)
+                {
+                    if (c == '"' || c == '\\')
+                        q += '\\';
+                    q += c;
+                }
+                return q + "\"";
+            }
+
+            static std::string summaries(const std::vector<StageSamples> &stages)
+            {
+                std::string out;
+                for (const StageSamples &s : stages)
+                {
+                    double sum = 0.0;
+                    size_t allocs = 0;
+                    for (size_t i = 0; i < s.ms.size(); i++)
+                    {
+                        sum += s.ms[i];
+                        allocs += s.allocs[i];
+                    }
+                    const double n = std::max<size_t>(s.ms.size(), 1);
+                    if (!out.empty())
+                        out += ", ";
+                    out += "{\"name\": " + quote(s.name) + ", \"fps\": " + number(fps(s)) + ", \"mean_ms\": " + number(sum / n) +
+                           ", \"p50_ms\": " + number(percentile(s.ms, 0.5)) + ", \"p99_ms\": " + number(percentile(s.ms, 0.99)) +
+                           ", \"max_ms\": " + number(percentile(s.ms, 1.0)) + ", \"allocs_per_frame\": " + number(allocs / n) + "}";
+                }
+                return out;
+            }
+
+            std::string bags_;
+            bool first_pipeline_ = true;
+        };
+
+        void print_table(const std::vector<StageSamples> &stages, const char *title)
+        {
+            std::printf("  %-26s %10s %10s %10s %10s %12s\n", title, "mean [ms]", "p50 [ms]", "p99 [ms]", "max [ms]", "allocs/frame");
+            for (const StageSamples &s : stages)
+            {
+                double stage_sum = 0.0;
+                size_t allocs = 0;
+                for (size_t i = 0; i < s.ms.size(); i++)
+                {
+                    stage_sum += s.ms[i];
+                    allocs += s.allocs[i];
+                }
+                const double n = std::max<size_t>(s.ms.size(), 1);
+                std::printf("  %-26s %10.3f %10.3f %10.3f %10.3f %12.1f\n", s.name.c_str(), stage_sum / n, percentile(s.ms, 0.5),
+                            percentile(s.ms, 0.99), percentile(s.ms, 1.0), allocs / n);
+            }
+        }
+
+        /**
+         * Check the tracking metrics of a pipeline against the limits of the options.
+         *
+         * @return false if a limit is exceeded, which is printed to stderr
+         */
+        bool check_limits(const std::string &pipeline, const TrackingQuality &quality, const BenchOptions &options)
+        {
+            bool passed = true;
+            if (options.max_id_switches >= 0 && quality.id_switches() > static_cast<size_t>(options.max_id_switches))
+            {
+                std::fprintf(stderr, "%s: %zu ID switches, more than %ld\n", pipeline.c_str(), quality.id_switches(), options.max_id_switches);
+                passed = false;
+            }
+            const double births = static_cast<double>(quality.births()) / std::max<size_t>(quality.frames(), 1);
+            if (options.max_births >= 0.0 && births > options.max_births)
+            {
+                std::fprintf(stderr, "%s: %.3f births/frame, more than %.3f\n", pipeline.c_str(), births, options.max_births);
+                passed = false;
+            }
+            return passed;
+        }
+
+        /// @return false if a limit of the tracking metrics is exceeded
+        bool report(const std::string &pipeline, const std::vector<StageSamples> &nodelets, const std::vector<StageSamples> &stages,
+                    size_t num_clusters, size_t rejected, const TrackingQuality &quality, const BenchOptions &options, JsonReport &json)
+        {
+            json.add_pipeline(pipeline, nodelets, stages, num_clusters, rejected, quality);
+            const StageSamples &total = stages.back();
+            if (total.ms.empty())
+            {
+                std::printf("%s: no frames, %zu rejected\n", pipeline.c_str(), rejected);
+                return true;
+            }
+            std::printf("%s: %zu frames, %zu rejected, %.1f frames/s, %.2f clusters/frame\n", pipeline.c_str(), total.ms.size(), rejected,
+                        JsonReport::fps(total), static_cast<double>(num_clusters) / total.ms.size());
+            print_table(nodelets, "nodelet");
+            print_table(stages, "stage");
+            std::printf("  tracks: %zu, %.2f births/frame, %.2f deaths/frame, %zu ID switches, %.2f runs/track, %.1f matched frames/track, "
+                        "%zu short tracks\n",
+                        quality.tracks(), static_cast<double>(quality.births()) / std::max<size_t>(quality.frames(), 1),
+                        static_cast<double>(quality.deaths()) / std::max<size_t>(quality.frames(), 1), quality.id_switches(),
+                        quality.runs_per_track(), quality.matched_frames_per_track(), quality.short_tracks());
+            return check_limits(pipeline, quality, options);
+        }
+
+        /// Clusterize and track the clouds of a pipeline, the centroids are calculated by the clustering stage.
+        class TrackingStages
+        {
+        public:
+            TrackingStages(ClusteringMethod method, double tolerance, int min_size, int max_size, float max_match_distance,
+                           const BenchOptions &options)
+                : clustering_(make_clustering_backend(options.seeded ? ClusteringMethod::SEEDED : method, tolerance, min_size, max_size)),
+                  quality_(max_match_distance)
+            {
+                tracker_.set_assignment(AssignmentMethod::HUNGARIAN, max_match_distance);
+                tracker_.set_motion_model(options.motion);
+            }
+
+            void run(const pcl::PointCloud<pcl::PointXYZ>::ConstPtr &cloud, const ros::Time &stamp, StageSamples &clustering,
+                     StageSamples &tracking)
+            {
+                {
+                    Sample sample(clustering);
+                    clustering_->set_seeds(seeds_);
+                    clustering_->extract(cloud, clusters_);
+                    compute_centroids(*cloud, clusters_, centres_);
+                }
+                num_clusters_ += clusters_.size();
+
+                Sample sample(tracking);
+                tracker_.track(centres_, stamp.toSec(), ids_);
+                tracker_.positions(seeds_);
+            }
+
+            /// Measure the stability of the tracks after a frame, outside of the timed stages.
+            void evaluate()
+            {
+                tracker_.tracks(tracks_);
+                quality_.update(tracks_);
+            }
+
+            size_t num_clusters() const { return num_clusters_; }
+
+            /// Stability of the tracks of the frames run so far, the open tracks are ended by the first call.
+            const TrackingQuality &quality()
+            {
+                quality_.finish();
+                return quality_;
+            }
+
+        private:
+            std::unique_ptr<ClusteringBackend> clustering_;
+            KFTracker tracker_;
+            std::vector<pcl::PointIndices> clusters_;
+            PointVector centres_, seeds_;
+            boost::container::vector<int> ids_;
+            boost::container::vector<TrackState> tracks_;
+            TrackingQuality quality_;
+            size_t num_clusters_ = 0;
+        };
+
+        // LiDAR chain of scan_tracker_nodelet with the parameters of lidar_cloud.yaml
+        bool bench_lidar(const std::vector<sensor_msgs::LaserScan::ConstPtr> &scans, const BenchOptions &options, JsonReport &json)
+        {
+            std::vector<StageSamples> nodelets = {{"laserscan_to_pointcloud"}, {"lidar_tracker"}};
+            std::vector<StageSamples> stages = {{"projection"}, {"clustering"}, {"tracking"}, {"total"}};
+            reserve(nodelets, scans.size() * options.repeat);
+            reserve(stages, scans.size() * options.repeat);
+            ScanProjection projection;
+            pcl::PointCloud<pcl::PointXYZ>::Ptr cloud(new pcl::PointCloud<pcl::PointXYZ>);
+            const ScanTransform identity = ScanTransform::Identity();
+            const float max_match_distance = 0.3f;
+            TrackingQuality quality(max_match_distance);
+            size_t num_clusters = 0;
+            for (int r = 0; r < options.repeat; r++)
+            {
+                TrackingStages tracking(ClusteringMethod::SCANLINE, 0.04, 40, 150, max_match_distance, options);
+                for (const auto &scan : scans)
+                {
+                    {
+                        Sample total(stages[3]);
+                        {
+                            Sample converter(nodelets[0]);
+                            Sample sample(stages[0]);
+                            projection.project(*scan, identity, *cloud);
+                        }
+                        Sample tracker(nodelets[1]);
+                        tracking.run(cloud, scan->header.stamp, stages[1], stages[2]);
+                    }
+                    tracking.evaluate();
+                }
+                num_clusters += tracking.num_clusters();
+                // the repetitions track the same objects
+                if (r == 0)
+                    quality = tracking.quality();
+            }
+            return report("lidar", nodelets, stages, num_clusters, 0, quality, options, json);
+        }
+
+        // Camera chain of pointcloud_filter_nodelet and camera_tracker_nodelet with the parameters of
+        // pointcloud_filter.yaml and camera_cloud.yaml
+        template <class PointT>
+        bool bench_camera(const std::vector<sensor_msgs::PointCloud2::ConstPtr> &clouds, const BenchOptions &options, JsonReport &json)
+        {
+            std::vector<StageSamples> nodelets = {{"pointcloud_filter"}, {"camera_tracker"}};
+            std::vector<StageSamples> stages = {{"roi"}, {"voxel"}, {"ground"}, {"clustering"}, {"tracking"}, {"total"}};
+            reserve(nodelets, clouds.size() * options.repeat);
+            reserve(stages, clouds.size() * options.repeat);
+            PreprocessorConfig config;
+            config.roi.max_range = 10.f;
+            config.segmentation = options.segmentation;
+            typename pcl::PointCloud<PointT>::Ptr cloud(new pcl::PointCloud<PointT>);
+            pcl::PointCloud<pcl::PointXYZ>::Ptr xyz_buffer;
+            const float max_match_distance = 0.5f;
+            TrackingQuality quality(max_match_distance);
+            size_t num_clusters = 0, rejected = 0;
+            for (int r = 0; r < options.repeat; r++)
+            {
+                CloudPreprocessor preprocessor(config);
+                TrackingStages tracking(ClusteringMethod::EUCLIDEAN, 0.2, 200, 3000, max_match_distance, options);
+                for (const auto &msg : clouds)
+                {
+                    // A rejected cloud leaves every stage without a sample, so the stages keep one sample per frame
+                    const size_t allocs = thread_allocations();
+                    const Clock::time_point start = Clock::now();
+                    if (!preprocessor.extract(*msg, *cloud))
+                    {
+                        rejected++;
+                        continue;
+                    }
+                    record(stages[0], start, allocs);
+                    {
+                        Sample total(stages[5], start, allocs);
+                        {
+                            Sample filter(nodelets[0], start, allocs);
+                            {
+                                Sample sample(stages[1]);
+                                preprocessor.downsample(*cloud);
+                            }
+                            {
+                                Sample sample(stages[2]);
+                                preprocessor.remove_ground(*cloud);
+                            }
+                        }
+                        // the tracker copies the coordinates of richer points for the clustering as well
+                        Sample tracker(nodelets[1]);
+                        tracking.run(coordinates<PointT>(cloud, xyz_buffer), msg->header.stamp, stages[3], stages[4]);
+                    }
+                    tracking.evaluate();
+                }
+                num_clusters += tracking.num_clusters();
+                if (r == 0)
+                    quality = tracking.quality();
+            }
+            return report("camera", nodelets, stages, num_clusters, rejected, quality, options, json);
+        }
+
+        int usage(const char *name)
+        {
+            std::fprintf(stderr, "Usage: %s [--lidar-topic TOPIC] [--camera-topic TOPIC] [--segmentation] [--motion-model cv|ca|ctrv|imm] "
+                                 "[--seeded] [--point-type xyz|xyzi|xyzrgb] [--repeat N] [--json FILE] [--max-id-switches N] [--max-births R] bag...\n",
+                         name);
+            return 1;
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    using namespace f1tenth_sensor_fusion;
+
+    std::string lidar_topic = "/scan", camera_topic = "/mynteye/points/data_raw";
+    BenchOptions options;
+    std::string json_path;
+    std::vector<std::string> bags;
+    for (int i = 1; i < argc; i++)
+    {
+        const bool has_value = i + 1 < argc;
+        if (!std::strcmp(argv[i], "--lidar-topic") && has_value)
+            lidar_topic = argv[++i];
+        else if (!std::strcmp(argv[i], "--camera-topic") && has_value)
+            camera_topic = argv[++i];
+        else if (!std::strcmp(argv[i], "--segmentation"))
+            options.segmentation = true;
+        else if (!std::strcmp(argv[i], "--seeded"))
+            options.seeded = true;
+        else if (!std::strcmp(argv[i], "--motion-model") && has_value)
+        {
+            if (!parse_motion_model(argv[++i], options.motion.model))
+                return usage(argv[0]);
+        }
+        else if (!std::strcmp(argv[i], "--point-type") && has_value)
+        {
+            if (!parse_point_type(argv[++i], options.point_type))
+                return usage(argv[0]);
+        }
+        else if (!std::strcmp(argv[i], "--repeat") && has_value)
+            options.repeat = std::max(std::atoi(argv[++i]), 1);
+        else if (!std::strcmp(argv[i], "--json") && has_value)
+            json_path = argv[++i];
+        else if (!std::strcmp(argv[i], "--max-id-switches") && has_value)
+            options.max_id_switches = std::atol(argv[++i]);
+        else if (!std::strcmp(argv[i], "--max-births") && has_value)
+            options.max_births = std::atof(argv[++i]);
+        else if (argv[i][0] == '-')
+            return usage(argv[0]);
+        else
+            bags.push_back(argv[i]);
+    }
+    if (bags.empty())
+        return usage(argv[0]);
+#ifdef F1TENTH_SENSOR_FUSION_COUNT_ALLOCATIONS
+    if (!allocations_counted())
+        std::fprintf(stderr, "Allocations are not counted, the operator new of liballoc_counter.so is not in use\n");
+#else
+    std::fprintf(stderr, "Allocations are not counted, pipeline_bench was built without COUNT_ALLOCATIONS\n");
+#endif
+
+    JsonReport json;
+    bool passed = true;
+    for (const std::string &path : bags)
+    {
+        std::vector<sensor_msgs::LaserScan::ConstPtr> scans;
+        std::vector<sensor_msgs::PointCloud2::ConstPtr> clouds;
+        try
+        {
+            rosbag::Bag bag(path, rosbag::bagmode::Read);
+            rosbag::View view(bag, rosbag::TopicQuery(std::vector<std::string>{lidar_topic, camera_topic}));
+            for (const rosbag::MessageInstance &m : view)
+            {
+                if (sensor_msgs::LaserScan::ConstPtr scan = m.instantiate<sensor_msgs::LaserScan>())
+                    scans.push_back(scan);
+                else if (sensor_msgs::PointCloud2::ConstPtr cloud = m.instantiate<sensor_msgs::PointCloud2>())
+                    clouds.push_back(cloud);
+            }
+        }
+        catch (const rosbag::BagException &e)
+        {
+            std::fprintf(stderr, "%s: %s\n", path.c_str(), e.what());
+            return 1;
+        }
+
+        std::printf("== %s: %zu scans on %s, %zu clouds on %s\n", path.c_str(), scans.size(), lidar_topic.c_str(), clouds.size(),
+                    camera_topic.c_str());
+        json.begin_bag(path, scans.size(), clouds.size());
+        passed &= bench_lidar(scans, options, json);
+        switch (options.point_type)
+        {
+        case PointType::XYZ:
+            passed &= bench_camera<pcl::PointXYZ>(clouds, options, json);
+            break;
+        case PointType::XYZI:
+            passed &= bench_camera<pcl::PointXYZI>(clouds, options, json);
+            break;
+        case PointType::XYZRGB:
+            passed &= bench_camera<pcl::PointXYZRGB>(clouds, options, json);
+            break;
+        }
+        json.end_bag();
+    }
+    if (!json_path.empty() && !json.write(json_path))
+    {
+        std::fprintf(stderr, "Can't write %s\n", json_path.c_str());
+        return 1;
+    }
+    return passed ? 0 : 2;
+}
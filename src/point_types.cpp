@@ -0,0 +1,34 @@
+/* Copyright 2021 Kovács Gergely Attila
+*
+*   Licensed under the Apache License,
+*   Version 2.0(the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License.
+*
+*/
+
+#include <f1tenth_sensor_fusion/point_types.hpp>
+
+namespace f1tenth_sensor_fusion
+{
+    bool parse_point_type(const std::string &name, PointType &type)
+    {
+        if (name == "xyz")
+            type = PointType::XYZ;
+        else if (name == "xyzi")
+            type = PointType::XYZI;
+        else if (name == "xyzrgb")
+            type = PointType::XYZRGB;
+        else
+            return false;
+        return true;
+    }
+}
@@ -16,14 +16,12 @@
 */
 
 #include <f1tenth_sensor_fusion/pointcloud_filter.h>
-#include <pcl/segmentation/sac_segmentation.h>
-#include <pcl/segmentation/extract_clusters.h>
-#include <pcl/filters/extract_indices.h>
-#include <pcl/filters/voxel_grid.h>
-#include <pcl/kdtree/kdtree.h>
-#include <pcl/io/pcd_io.h>
+#include <f1tenth_sensor_fusion/cloud_transform.hpp>
 #include <boost/thread.hpp>
 #include <pluginlib/class_list_macros.h>
+#include <algorithm>
+#include <limits>
+#include <sstream>
 
 namespace f1tenth_sensor_fusion
 {
@@ -36,8 +34,61 @@ namespace f1tenth_sensor_fusion
         private_nh_.param<std::string>("subscription_topic", sub_topic_, "cloud");
         private_nh_.param<std::string>("output_topic", out_topic_, "filtered_cloud");
         private_nh_.param<std::string>("target_frame", target_frame_, "fusion_base");
-        private_nh_.param<bool>("segmentation", segmentation, false);
-        private_nh_.param<float>("segmentation_factor", segmentation_factor, 1.0f);
+        PreprocessorConfig config;
+        private_nh_.param<bool>("segmentation", config.segmentation, config.segmentation);
+        private_nh_.param<float>("ground_distance", config.ground.distance, config.ground.distance);
+        private_nh_.param<float>("ground_min_inliers", config.ground.min_inliers, config.ground.min_inliers);
+        private_nh_.param<int>("ground_max_iterations", config.ground.max_iterations, config.ground.max_iterations);
+        private_nh_.param<double>("ground_time_budget", config.ground.time_budget, config.ground.time_budget);
+        private_nh_.param<int>("ground_sample_size", config.ground.sample_size, config.ground.sample_size);
+        private_nh_.param<float>("leaf_size", config.leaf_size, config.leaf_size);
+        std::string voxel_mode = private_nh_.param<std::string>("voxel_mode", "centroid");
+        if (!parse_voxel_mode(voxel_mode, config.voxel_mode))
+            NODELET_WARN("Unknown voxel mode \"%s\", using centroid", voxel_mode.c_str());
+        if (config.leaf_size <= 0.f)
+        {
+            NODELET_WARN("Leaf size must be positive, using 0.01");
+            config.leaf_size = 0.01f;
+        }
+
+        RoiConfig &roi = config.roi;
+        private_nh_.param<float>("roi_min_x", roi.min_x, roi.min_x);
+        private_nh_.param<float>("roi_max_x", roi.max_x, roi.max_x);
+        private_nh_.param<float>("roi_min_y", roi.min_y, roi.min_y);
+        private_nh_.param<float>("roi_max_y", roi.max_y, roi.max_y);
+        private_nh_.param<float>("min_height", roi.min_height, roi.min_height);
+        private_nh_.param<float>("max_height", roi.max_height, roi.max_height);
+        private_nh_.param<float>("min_range", roi.min_range, roi.min_range);
+        private_nh_.param<float>("max_range", roi.max_range, roi.max_range);
+        preprocessor_.set_config(config);
+
+        std::string point_type = private_nh_.param<std::string>("point_type", "xyz");
+        if (!parse_point_type(point_type, point_type_))
+            NODELET_WARN("Unknown point type \"%s\", using xyz", point_type.c_str());
+
+        // The leaf size is adapted between leaf_size and max_leaf_size to hold the frame time budget, if one is given
+        const double frame_time_budget = private_nh_.param<double>("frame_time_budget", 0.0);
+        const float max_leaf_size = private_nh_.param<float>("max_leaf_size", 4.f * config.leaf_size);
+        bool adaptive = frame_time_budget > 0.0;
+        if (adaptive && max_leaf_size < config.leaf_size)
+        {
+            NODELET_WARN("max_leaf_size is smaller than leaf_size, frame_time_budget is ignored");
+            adaptive = false;
+        }
+        if (adaptive)
+        {
+            controller_.configure(frame_time_budget, config.leaf_size, max_leaf_size);
+            controller_.advertise(private_nh_, "operating_point", "leaf_size");
+        }
+
+        std::string record_file = private_nh_.param<std::string>("record_file", "");
+        if (!record_file.empty())
+        {
+            if (log_.open(record_file))
+                log_.write_config(LogRecord::FILTER_CONFIG, log_config(config, voxel_mode, point_type));
+            else
+                NODELET_ERROR("Could not create the frame log %s", record_file.c_str());
+        }
         int concurrency = private_nh_.param<int>("concurrency_level", 0);
 
 #ifndef NDEBUG
@@ -64,15 +115,37 @@ namespace f1tenth_sensor_fusion
             input_queue_size_ = boost::thread::hardware_concurrency();
         }
 
-        pub_ = nh_.advertise<sensor_msgs::PointCloud2>(out_topic_.c_str(), 30, boost::bind(&PointCloudFilter::connectCb, this),
-                                                       boost::bind(&PointCloudFilter::disconnectCb, this));
+        QueuePolicy policy = QueuePolicy::FIFO;
+        std::string queue_policy = private_nh_.param<std::string>("queue_policy", "fifo");
+        if (!parse_queue_policy(queue_policy, policy))
+            NODELET_WARN("Unknown queue policy \"%s\", using fifo", queue_policy.c_str());
+        int queue_size = private_nh_.param<int>("queue_size", 0);
+        queue_.configure(policy, queue_size > 0 ? queue_size : input_queue_size_, private_nh_.param<double>("queue_deadline", 0.1));
+        queue_.advertise_stats(private_nh_, "queue_stats", private_nh_.param<double>("queue_stats_period", 1.0));
+        timers_.advertise(private_nh_, "stats", private_nh_.param<double>("stats_period", 1.0));
+
+        // The output keeps the point type of the processing, see process()
+        const ros::SubscriberStatusCallback connect_cb = boost::bind(&PointCloudFilter::connectCb, this);
+        const ros::SubscriberStatusCallback disconnect_cb = boost::bind(&PointCloudFilter::disconnectCb, this);
+        switch (point_type_)
+        {
+        case PointType::XYZ:
+            pub_ = nh_.advertise<pcl::PointCloud<pcl::PointXYZ>>(out_topic_, 30, connect_cb, disconnect_cb);
+            break;
+        case PointType::XYZI:
+            pub_ = nh_.advertise<pcl::PointCloud<pcl::PointXYZI>>(out_topic_, 30, connect_cb, disconnect_cb);
+            break;
+        case PointType::XYZRGB:
+            pub_ = nh_.advertise<pcl::PointCloud<pcl::PointXYZRGB>>(out_topic_, 30, connect_cb, disconnect_cb);
+            break;
+        }
         if (target_frame_.empty())
             sub_.registerCallback(boost::bind(&PointCloudFilter::callback, this, _1));
         else
         {
             tf2_.reset(new tf2_ros::Buffer());
             tf2_listener_.reset(new tf2_ros::TransformListener(*tf2_));
-            message_filter_.reset(new PointCloud2MessageFilter(sub_, *tf2_, target_frame_, input_queue_size_, nh_));
+            message_filter_.reset(new PointCloud2MessageFilter(sub_, *tf2_, target_frame_, queue_.subscriber_queue_size(), nh_));
             message_filter_->registerCallback(boost::bind(&PointCloudFilter::callback, this, _1));
             message_filter_->registerFailureCallback(boost::bind(&PointCloudFilter::failureCallback, this, _1, _2));
         }
@@ -84,7 +157,7 @@ namespace f1tenth_sensor_fusion
         if (pub_.getNumSubscribers() > 0 && sub_.getSubscriber().getNumPublishers() == 0)
         {
             NODELET_INFO("Got a subscriber to %s, starting %s subscriber", out_topic_.c_str(), sub_topic_.c_str());
-            sub_.subscribe(nh_, sub_topic_, input_queue_size_);
+            sub_.subscribe(nh_, sub_topic_, queue_.subscriber_queue_size());
         }
     }
 
@@ -95,26 +168,117 @@ namespace f1tenth_sensor_fusion
         {
             NODELET_INFO("No subscibers to %s, shutting down subscriber to %s.", out_topic_.c_str(), sub_topic_.c_str());
             sub_.unsubscribe();
+            queue_.clear();
         }
     }
 
     void PointCloudFilter::callback(const sensor_msgs::PointCloud2ConstPtr &msg)
     {
-        pcl::PointCloud<pcl::PointXYZ>::Ptr cloud(new pcl::PointCloud<pcl::PointXYZ>);
-        pcl::fromROSMsg(*msg, *cloud);
+        queue_.push(msg);
+
+        // One thread processes the queue at a time, the others only add their frame to it
+        while (!processing_.exchange(true))
+        {
+            sensor_msgs::PointCloud2ConstPtr next;
+            while (queue_.pop(next))
+                process(next);
+            processing_ = false;
+
+            // A frame pushed after the queue was found empty but before the flag was cleared would be left behind otherwise
+            if (queue_.empty())
+                return;
+        }
+    }
+
+    void PointCloudFilter::process(const sensor_msgs::PointCloud2ConstPtr &msg)
+    {
+        switch (point_type_)
+        {
+        case PointType::XYZ:
+            process<pcl::PointXYZ>(msg);
+            break;
+        case PointType::XYZI:
+            process<pcl::PointXYZI>(msg);
+            break;
+        case PointType::XYZRGB:
+            process<pcl::PointXYZRGB>(msg);
+            break;
+        }
+    }
+
+    template <class PointT>
+    void PointCloudFilter::process(const sensor_msgs::PointCloud2ConstPtr &msg)
+    {
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        // Points outside the region of interest are dropped while reading the message, before any other stage
+        typename pcl::PointCloud<PointT>::Ptr cloud = pooled_cloud<PointT>();
+        if (log_.is_open())
+            log_.write_message(*msg, msg->header.stamp.toNSec() / 1000);
+        {
+            ScopedStageTimer timer(timers_, STAGE_ROI);
+            if (!preprocessor_.extract(*msg, *cloud))
+            {
+                NODELET_WARN_THROTTLE(1.0, "Point cloud on %s has no FLOAT32 x, y, z fields", sub_topic_.c_str());
+                cloud->clear(); // still holds the points of an earlier frame
+                if (log_.is_open())
+                    log_.write_points(LogRecord::FILTER_OUTPUT, *cloud, static_cast<uint32_t>(PreprocessStatus::NO_XYZ_FIELDS));
+                return;
+            }
+        }
 
-        filter(cloud);
+        const PreprocessStatus status = filter<PointT>(cloud);
+        if (log_.is_open())
+        {
+            // RANSAC stops at a deadline, the replay runs the same number of iterations instead
+            if (preprocessor_.config().segmentation)
+                log_.write_ground(cloud->header.stamp, cloud->header.seq, preprocessor_.ground_iterations());
+            log_.write_points(LogRecord::FILTER_OUTPUT, *cloud, static_cast<uint32_t>(status));
+        }
+        transform_and_publish<PointT>(msg, cloud);
+        adapt_leaf_size(start, msg->header.stamp);
+    }
 
-        sensor_msgs::PointCloud2::Ptr clustermsg(new sensor_msgs::PointCloud2);
-        pcl::toROSMsg(*cloud, *clustermsg);
-        clustermsg->header = msg->header;
-        clustermsg->header.stamp = ros::Time::now();
+    template <class PointT>
+    typename pcl::PointCloud<PointT>::Ptr PointCloudFilter::pooled_cloud()
+    {
+        // Only one frame is processed at a time, and a cloud is reused once the subscribers dropped it. Intra-process
+        // subscribers hold on to it as long as they need, so there are as many clouds as frames still being used
+        CloudPool<PointT> &pool = std::get<CloudPool<PointT>>(cloud_pools_);
+        auto cloud = std::find_if(pool.begin(), pool.end(), [](const typename pcl::PointCloud<PointT>::Ptr &c) { return c.use_count() == 1; });
+        if (cloud == pool.end())
+            cloud = pool.insert(pool.end(), typename pcl::PointCloud<PointT>::Ptr(new pcl::PointCloud<PointT>));
+        return *cloud;
+    }
+
+    void PointCloudFilter::adapt_leaf_size(const std::chrono::steady_clock::time_point &start, const ros::Time &stamp)
+    {
+        if (!controller_.enabled())
+            return;
+        if (controller_.update(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count()))
+        {
+            preprocessor_.set_leaf_size(static_cast<float>(controller_.value()));
+            // The new leaf size applies from the next frame, which replays the same way
+            if (log_.is_open())
+            {
+                std::ostringstream ss;
+                ss.precision(std::numeric_limits<float>::max_digits10);
+                ss << "leaf_size " << preprocessor_.config().leaf_size << "\n";
+                log_.write_config(LogRecord::FILTER_TUNING, ss.str());
+            }
+        }
+        controller_.publish(stamp);
+    }
 
+    template <class PointT>
+    void PointCloudFilter::transform_and_publish(const sensor_msgs::PointCloud2ConstPtr &msg, typename pcl::PointCloud<PointT>::Ptr &cloud)
+    {
         if (!target_frame_.empty() && cloud->header.frame_id != target_frame_)
         {
+            ScopedStageTimer timer(timers_, STAGE_TF);
             try
             {
-                *clustermsg = tf2_->transform(*clustermsg, target_frame_);
+                geometry_msgs::TransformStamped t = tf2_->lookupTransform(target_frame_, msg->header.frame_id, msg->header.stamp);
+                transform_cloud_in_place(*cloud, t.transform, target_frame_);
             }
             catch (tf2::TransformException &ex)
             {
@@ -122,60 +286,59 @@ namespace f1tenth_sensor_fusion
                 return;
             }
         }
-        pub_.publish(clustermsg);
+        // Publishing the shared pointer lets subscribers in the same manager receive the cloud without serialization
+        {
+            ScopedStageTimer timer(timers_, STAGE_PUBLISH);
+            pub_.publish(cloud);
+        }
+        timers_.record_since(STAGE_LATENCY, msg->header.stamp);
     }
 
-    void PointCloudFilter::filter(pcl::PointCloud<pcl::PointXYZ>::Ptr &cloud)
+    template <class PointT>
+    PreprocessStatus PointCloudFilter::filter(typename pcl::PointCloud<PointT>::Ptr &cloud)
     {
-        // Create the filtering object: downsample the dataset using a leaf size of 1cm
-        pcl::VoxelGrid<pcl::PointXYZ> vg;
-        pcl::PointCloud<pcl::PointXYZ>::Ptr cloud_filtered(new pcl::PointCloud<pcl::PointXYZ>);
-        vg.setInputCloud(cloud);
-        vg.setLeafSize(0.01f, 0.01f, 0.01f);
-        vg.filter(*cloud_filtered);
-
-        if (segmentation)
-            planar_segmentation(cloud_filtered);
-
-        *cloud = *cloud_filtered;
-    }
+        // The cloud is freshly converted from the message, so it is downsampled in place
+        {
+            ScopedStageTimer timer(timers_, STAGE_VOXEL);
+            preprocessor_.downsample(*cloud);
+        }
 
-    void PointCloudFilter::planar_segmentation(pcl::PointCloud<pcl::PointXYZ>::Ptr &cloud_filtered)
-    {
-        // Create the segmentation object for the planar model and set all the parameters
-        pcl::SACSegmentation<pcl::PointXYZ> seg;
-        pcl::PointIndices::Ptr inliers(new pcl::PointIndices);
-        pcl::ModelCoefficients::Ptr coefficients(new pcl::ModelCoefficients);
-        pcl::PointCloud<pcl::PointXYZ>::Ptr cloud_plane(new pcl::PointCloud<pcl::PointXYZ>()), cloud_f(new pcl::PointCloud<pcl::PointXYZ>());
-        pcl::PCDWriter writer;
-        seg.setOptimizeCoefficients(true);
-        seg.setModelType(pcl::SACMODEL_PLANE);
-        seg.setMethodType(pcl::SAC_RANSAC);
-        seg.setMaxIterations(100);
-        seg.setDistanceThreshold(0.02);
-
-        int i = 0, nr_points = (int)cloud_filtered->size();
-        while (cloud_filtered->size() > segmentation_factor * nr_points)
-        {
-            // Segment the largest planar component from the remaining cloud
-            seg.setInputCloud(cloud_filtered);
-            seg.segment(*inliers, *coefficients);
-            if (inliers->indices.size() == 0)
+        if (preprocessor_.config().segmentation)
+        {
+            ScopedStageTimer timer(timers_, STAGE_GROUND);
+            if (!preprocessor_.remove_ground(*cloud))
             {
-                NODELET_ERROR_STREAM("Could not estimate a planar model for the given dataset.");
-                break;
+                NODELET_WARN_THROTTLE(1.0, "Could not estimate a planar model for the given dataset.");
+                return PreprocessStatus::NO_GROUND;
             }
-
-            // Extract the planar inliers from the input cloud
-            pcl::ExtractIndices<pcl::PointXYZ> extract;
-            extract.setInputCloud(cloud_filtered);
-            extract.setIndices(inliers);
-
-            // Remove the planar inliers, extract the rest
-            extract.setNegative(true);
-            extract.filter(*cloud_f);
-            *cloud_filtered = *cloud_f;
         }
+        return PreprocessStatus::OK;
+    }
+
+    std::string PointCloudFilter::log_config(const PreprocessorConfig &config, const std::string &voxel_mode,
+                                             const std::string &point_type) const
+    {
+        // Same names as the parameters, so frame_replay can run the frames through the same filter
+        std::ostringstream ss;
+        ss.precision(std::numeric_limits<float>::max_digits10);
+        ss << "point_type " << point_type << "\n"
+           << "leaf_size " << config.leaf_size << "\n"
+           << "voxel_mode " << voxel_mode << "\n"
+           << "segmentation " << config.segmentation << "\n"
+           << "ground_distance " << config.ground.distance << "\n"
+           << "ground_min_inliers " << config.ground.min_inliers << "\n"
+           << "ground_max_iterations " << config.ground.max_iterations << "\n"
+           << "ground_time_budget " << config.ground.time_budget << "\n"
+           << "ground_sample_size " << config.ground.sample_size << "\n"
+           << "roi_min_x " << config.roi.min_x << "\n"
+           << "roi_max_x " << config.roi.max_x << "\n"
+           << "roi_min_y " << config.roi.min_y << "\n"
+           << "roi_max_y " << config.roi.max_y << "\n"
+           << "min_height " << config.roi.min_height << "\n"
+           << "max_height " << config.roi.max_height << "\n"
+           << "min_range " << config.roi.min_range << "\n"
+           << "max_range " << config.roi.max_range << "\n";
+        return ss.str();
     }
 
     void PointCloudFilter::failureCallback(const sensor_msgs::PointCloud2ConstPtr &scan_msg,
@@ -0,0 +1,96 @@
+/* Copyright 2021 Kovács Gergely Attila
+*
+*   Licensed under the Apache License,
+*   Version 2.0(the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License.
+*
+*/
+
+#include <f1tenth_sensor_fusion/roi_filter.hpp>
+#include <pcl_conversions/pcl_conversions.h>
+#include <cmath>
+#include <cstring>
+
+namespace f1tenth_sensor_fusion
+{
+    namespace
+    {
+        bool float_field_offset(const sensor_msgs::PointCloud2 &msg, const char *name, uint32_t &offset)
+        {
+            for (const sensor_msgs::PointField &f : msg.fields)
+                if (f.name == name)
+                {
+                    offset = f.offset;
+                    return f.datatype == sensor_msgs::PointField::FLOAT32 && f.offset + sizeof(float) <= msg.point_step;
+                }
+            return false;
+        }
+    }
+
+    void RoiFilter::set_config(const RoiConfig &config)
+    {
+        config_ = config;
+        sq_min_range_ = config.min_range * config.min_range;
+        // a squared maximum range would overflow with the default limit
+        sq_max_range_ = config.max_range < std::sqrt(std::numeric_limits<float>::max()) ? config.max_range * config.max_range
+                                                                                          : std::numeric_limits<float>::max();
+    }
+
+    template <class PointT>
+    bool RoiFilter::extract(const sensor_msgs::PointCloud2 &msg, pcl::PointCloud<PointT> &cloud) const
+    {
+        uint32_t ox, oy, oz;
+        if (!float_field_offset(msg, "x", ox) || !float_field_offset(msg, "y", oy) || !float_field_offset(msg, "z", oz))
+            return false;
+        typename PointFields<PointT>::Offsets extra;
+        PointFields<PointT>::find(msg, extra);
+
+        pcl_conversions::toPCL(msg.header, cloud.header);
+        const size_t num_points = static_cast<size_t>(msg.width) * msg.height;
+        cloud.resize(num_points);
+
+        size_t n = 0;
+        for (uint32_t row = 0; row < msg.height; row++)
+        {
+            const uint8_t *p = msg.data.data() + row * msg.row_step;
+            for (uint32_t col = 0; col < msg.width; col++, p += msg.point_step)
+            {
+                // the buffer holds no alignment guarantees, copy instead of casting
+                float x, y, z;
+                std::memcpy(&x, p + ox, sizeof(float));
+                std::memcpy(&y, p + oy, sizeof(float));
+                std::memcpy(&z, p + oz, sizeof(float));
+
+                // comparisons with NaN are false, so non-finite points drop out here as well
+                if (!(x >= config_.min_x && x <= config_.max_x && y >= config_.min_y && y <= config_.max_y &&
+                      z >= config_.min_height && z <= config_.max_height))
+                    continue;
+                const float sq_range = x * x + y * y + z * z;
+                if (!(sq_range >= sq_min_range_ && sq_range <= sq_max_range_))
+                    continue;
+
+                PointT &out = cloud[n++];
+                out.x = x;
+                out.y = y;
+                out.z = z;
+                PointFields<PointT>::read(p, extra, out);
+            }
+        }
+        cloud.resize(n);
+        cloud.is_dense = true;
+        return true;
+    }
+
+    template bool RoiFilter::extract(const sensor_msgs::PointCloud2 &, pcl::PointCloud<pcl::PointXYZ> &) const;
+    template bool RoiFilter::extract(const sensor_msgs::PointCloud2 &, pcl::PointCloud<pcl::PointXYZI> &) const;
+    template bool RoiFilter::extract(const sensor_msgs::PointCloud2 &, pcl::PointCloud<pcl::PointXYZRGB> &) const;
+}
@@ -0,0 +1,68 @@
+/* Copyright 2021 Kovács Gergely Attila
+*
+*   Licensed under the Apache License,
+*   Version 2.0(the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License.
+*
+*/
+
+#include <f1tenth_sensor_fusion/scan_projection.hpp>
+#include <cmath>
+#include <limits>
+
+namespace f1tenth_sensor_fusion
+{
+    void ScanProjection::update_table(const sensor_msgs::LaserScan &scan, const ScanTransform &transform)
+    {
+        if (directions_.size() == scan.ranges.size() && angle_min_ == scan.angle_min && angle_increment_ == scan.angle_increment &&
+            transform_.matrix() == transform.matrix())
+            return;
+
+        angle_min_ = scan.angle_min;
+        angle_increment_ = scan.angle_increment;
+        transform_ = transform;
+        directions_.resize(scan.ranges.size());
+        for (size_t i = 0; i < directions_.size(); i++)
+        {
+            const double angle = scan.angle_min + i * static_cast<double>(scan.angle_increment);
+            directions_[i] = transform.linear() * Eigen::Vector3f(std::cos(angle), std::sin(angle), 0.f);
+        }
+    }
+
+    void ScanProjection::project(const sensor_msgs::LaserScan &scan, const ScanTransform &transform, pcl::PointCloud<pcl::PointXYZ> &cloud,
+                                 bool drop_invalid)
+    {
+        update_table(scan, transform);
+
+        const Eigen::Vector3f t = transform.translation();
+        const float nan = std::numeric_limits<float>::quiet_NaN();
+        cloud.resize(scan.ranges.size());
+        size_t n = 0;
+        bool dense = true;
+        for (size_t i = 0; i < scan.ranges.size(); i++)
+        {
+            const float r = scan.ranges[i];
+            if (!(r >= scan.range_min && r < scan.range_max)) // also rejects NaN
+            {
+                if (!drop_invalid)
+                {
+                    cloud[n++].getVector3fMap().setConstant(nan);
+                    dense = false;
+                }
+                continue;
+            }
+            cloud[n++].getVector3fMap() = r * directions_[i] + t;
+        }
+        cloud.resize(n);
+        cloud.is_dense = dense;
+    }
+}
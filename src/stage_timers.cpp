@@ -0,0 +1,166 @@
+/* Copyright 2021 Kovács Gergely Attila
+*
+*   Licensed under the Apache License,
+*   Version 2.0(the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License.
+*
+*/
+
+#include <f1tenth_sensor_fusion/stage_timers.hpp>
+
+#ifdef F1TENTH_SENSOR_FUSION_STAGE_TIMERS
+
+#include <f1tenth_sensor_fusion/StageStats.h>
+#include <algorithm>
+#include <functional>
+
+namespace f1tenth_sensor_fusion
+{
+    namespace
+    {
+        /// Buckets 0-3 hold 0-3 ns, then every octave [2^k, 2^(k+1)) is split into four buckets.
+        inline size_t bucket_of(uint64_t ns)
+        {
+            if (ns < 4)
+                return static_cast<size_t>(ns);
+            const int msb = 63 - __builtin_clzll(ns);
+            const size_t bucket = 4 * (msb - 1) + ((ns >> (msb - 2)) & 3);
+            return std::min(bucket, StageTimers::NUM_BUCKETS - 1);
+        }
+
+        /// Middle of a bucket in milliseconds.
+        inline float bucket_value(size_t bucket)
+        {
+            if (bucket < 4)
+                return bucket * 1e-6f;
+            const int msb = static_cast<int>(bucket / 4) + 1;
+            const double width = static_cast<double>(uint64_t(1) << (msb - 2));
+            const double lower = (4 + bucket % 4) * width;
+            return static_cast<float>((lower + width / 2) * 1e-6);
+        }
+    }
+
+    constexpr size_t StageTimers::NUM_BUCKETS;
+    constexpr size_t StageTimers::NUM_SLOTS;
+
+    StageTimers::StageTimers(const std::vector<std::string> &stages)
+        : stages_(stages), owners_(new std::atomic<std::thread::id>[NUM_SLOTS]),
+          counts_(new std::atomic<uint32_t>[NUM_SLOTS * stages.size() * NUM_BUCKETS]),
+          max_(new std::atomic<uint64_t>[NUM_SLOTS * stages.size()])
+    {
+        for (size_t i = 0; i < NUM_SLOTS; i++)
+            owners_[i] = std::thread::id();
+        for (size_t i = 0; i < NUM_SLOTS * stages.size() * NUM_BUCKETS; i++)
+            counts_[i] = 0;
+        for (size_t i = 0; i < NUM_SLOTS * stages.size(); i++)
+            max_[i] = 0;
+    }
+
+    size_t StageTimers::slot()
+    {
+        const std::thread::id self = std::this_thread::get_id();
+        const size_t home = std::hash<std::thread::id>()(self) % NUM_SLOTS;
+        for (size_t i = 0; i < NUM_SLOTS; i++)
+        {
+            const size_t s = (home + i) % NUM_SLOTS;
+            std::thread::id owner = owners_[s].load(std::memory_order_relaxed);
+            if (owner == self)
+                return s;
+            if (owner == std::thread::id() && owners_[s].compare_exchange_strong(owner, self))
+                return s;
+        }
+        // every slot is taken, share the home slot, the counters are atomic anyway
+        return home;
+    }
+
+    void StageTimers::record_ns(size_t stage, uint64_t ns)
+    {
+        const size_t base = slot() * stages_.size() + stage;
+        counts_[base * NUM_BUCKETS + bucket_of(ns)].fetch_add(1, std::memory_order_relaxed);
+        std::atomic<uint64_t> &max = max_[base];
+        uint64_t current = max.load(std::memory_order_relaxed);
+        while (ns > current && !max.compare_exchange_weak(current, ns, std::memory_order_relaxed))
+        {
+        }
+    }
+
+    void StageTimers::record(size_t stage, std::chrono::steady_clock::duration duration)
+    {
+        record_ns(stage, std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count());
+    }
+
+    void StageTimers::record_since(size_t stage, const ros::Time &stamp)
+    {
+        const ros::Duration age = ros::Time::now() - stamp;
+        record_ns(stage, age.toNSec() > 0 ? static_cast<uint64_t>(age.toNSec()) : 0);
+    }
+
+    void StageTimers::advertise(ros::NodeHandle &nh, const std::string &topic, double period)
+    {
+        pub_ = nh.advertise<f1tenth_sensor_fusion::StageStats>(topic, 10);
+        timer_ = nh.createWallTimer(ros::WallDuration(period), &StageTimers::publish, this);
+    }
+
+    void StageTimers::publish(const ros::WallTimerEvent &)
+    {
+        const size_t num_stages = stages_.size();
+        f1tenth_sensor_fusion::StageStats::Ptr msg(new f1tenth_sensor_fusion::StageStats);
+        msg->header.stamp = ros::Time::now();
+        msg->stages = stages_;
+        msg->count.resize(num_stages);
+        msg->p50.resize(num_stages);
+        msg->p99.resize(num_stages);
+        msg->max.resize(num_stages);
+
+        std::vector<uint64_t> histogram(NUM_BUCKETS);
+        for (size_t stage = 0; stage < num_stages; stage++)
+        {
+            // Buckets are taken and reset one by one, a sample recorded meanwhile lands in this report or the next
+            std::fill(histogram.begin(), histogram.end(), 0);
+            uint64_t count = 0, max = 0;
+            for (size_t s = 0; s < NUM_SLOTS; s++)
+            {
+                const size_t base = s * num_stages + stage;
+                for (size_t b = 0; b < NUM_BUCKETS; b++)
+                {
+                    const uint32_t n = counts_[base * NUM_BUCKETS + b].exchange(0, std::memory_order_relaxed);
+                    histogram[b] += n;
+                    count += n;
+                }
+                max = std::max(max, max_[base].exchange(0, std::memory_order_relaxed));
+            }
+
+            // the middle of the last bucket may lie above the maximum
+            msg->count[stage] = count;
+            msg->max[stage] = max * 1e-6f;
+            uint64_t cumulative = 0;
+            bool p50_set = false;
+            for (size_t b = 0; b < NUM_BUCKETS && count > 0; b++)
+            {
+                cumulative += histogram[b];
+                if (!p50_set && 2 * cumulative >= count)
+                {
+                    msg->p50[stage] = std::min(bucket_value(b), msg->max[stage]);
+                    p50_set = true;
+                }
+                if (100 * cumulative >= 99 * count)
+                {
+                    msg->p99[stage] = std::min(bucket_value(b), msg->max[stage]);
+                    break;
+                }
+            }
+        }
+        pub_.publish(msg);
+    }
+}
+
+#endif // F1TENTH_SENSOR_FUSION_STAGE_TIMERS
@@ -0,0 +1,52 @@
+/* Copyright 2021 Kovács Gergely Attila
+*
+*   Licensed under the Apache License,
+*   Version 2.0(the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License.
+*
+*/
+
+
+#include <f1tenth_sensor_fusion/track_filters.hpp>
+
+namespace f1tenth_sensor_fusion
+{
+    bool parse_motion_model(const std::string &name, MotionModel &model)
+    {
+        if (name == "cv")
+            model = MotionModel::CV;
+        else if (name == "ca")
+            model = MotionModel::CA;
+        else if (name == "ctrv")
+            model = MotionModel::CTRV;
+        else if (name == "imm")
+            model = MotionModel::IMM;
+        else
+            return false;
+        return true;
+    }
+
+    std::unique_ptr<TrackFilters> make_track_filters(const MotionModelConfig &config)
+    {
+        switch (config.model)
+        {
+        case MotionModel::CA:
+            return std::unique_ptr<TrackFilters>(new LinearTrackFilters<ConstantAcceleration>(config));
+        case MotionModel::CTRV:
+            return std::unique_ptr<TrackFilters>(new NonlinearTrackFilters<Ekf<ConstantTurnRate>>(config));
+        case MotionModel::IMM:
+            return std::unique_ptr<TrackFilters>(new NonlinearTrackFilters<Imm<StraightMotion, ConstantTurnRate>>(config));
+        default:
+            return std::unique_ptr<TrackFilters>(new LinearTrackFilters<ConstantVelocity>(config));
+        }
+    }
+}
@@ -0,0 +1,89 @@
+/* Copyright 2021 Kovács Gergely Attila
+*
+*   Licensed under the Apache License,
+*   Version 2.0(the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License.
+*
+*/
+
+#include <f1tenth_sensor_fusion/tracker_pool.hpp>
+#include <algorithm>
+
+namespace f1tenth_sensor_fusion
+{
+    TrackerPool::TrackerPool(int threads)
+        : num_threads_(threads > 0 ? static_cast<size_t>(threads) : std::max<size_t>(boost::thread::hardware_concurrency(), 1))
+    {
+    }
+
+    TrackerPool::~TrackerPool()
+    {
+        stop();
+    }
+
+    size_t TrackerPool::add(ProcessFn process, int priority)
+    {
+        inputs_.push_back(Input{process, priority});
+        return inputs_.size() - 1;
+    }
+
+    void TrackerPool::start()
+    {
+        for (size_t i = 0; i < num_threads_; i++)
+            workers_.create_thread([this]() { run(); });
+    }
+
+    void TrackerPool::stop()
+    {
+        {
+            boost::mutex::scoped_lock lock(mutex_);
+            stopping_ = true;
+            pending_.clear();
+        }
+        cond_.notify_all();
+        workers_.join_all();
+    }
+
+    void TrackerPool::notify(size_t input)
+    {
+        {
+            boost::mutex::scoped_lock lock(mutex_);
+            if (stopping_)
+                return;
+            pending_.push_back(input);
+        }
+        cond_.notify_one();
+    }
+
+    void TrackerPool::run()
+    {
+        for (;;)
+        {
+            size_t input;
+            {
+                boost::mutex::scoped_lock lock(mutex_);
+                while (pending_.empty() && !stopping_)
+                    cond_.wait(lock);
+                if (stopping_)
+                    return;
+                // There are only a few notifications per input waiting, a linear search is cheaper than a heap
+                auto next = pending_.begin();
+                for (auto it = pending_.begin(); it != pending_.end(); ++it)
+                    if (inputs_[*it].priority > inputs_[*next].priority)
+                        next = it;
+                input = *next;
+                pending_.erase(next);
+            }
+            inputs_[input].process();
+        }
+    }
+}
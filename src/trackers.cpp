@@ -16,38 +16,112 @@
 */
 
 #include <f1tenth_sensor_fusion/trackers.h>
+#include <f1tenth_sensor_fusion/cloud_transform.hpp>
+#include <pcl_conversions/pcl_conversions.h>
 #include <pluginlib/class_list_macros.h>
+#include <algorithm>
 
 namespace f1tenth_sensor_fusion
 {
-    LidarTracker::LidarTracker()
+    template <class PointT>
+    void CloudTracker<PointT>::start(const ros::NodeHandle &handle, const ros::NodeHandle &mt_handle, const ros::NodeHandle &private_handle)
     {
-        _config = TrackerConfig("laser_cloud", 20, 100, 0.1, "asd", "asd", 8, visualization_msgs::Marker::CUBE);
+        this->private_handle_ = private_handle;
+        int concurrency_level = this->_load_params();
+        // Check if explicitly single threaded, otherwise, let nodelet manager dictate thread pool size
+        this->handle_ = concurrency_level == 1 ? handle : mt_handle;
+        this->initialize(concurrency_level);
     }
 
-    void LidarTracker::onInit()
+    template <class PointT>
+    void CloudTracker<PointT>::start_pooled(const ros::NodeHandle &mt_handle, const ros::NodeHandle &private_handle, TrackerPool &pool)
     {
-        private_handle_ = getPrivateNodeHandle();
-        int concurrency_level = _load_params();
-        // Check if explicitly single threaded, otherwise, let nodelet manager dictate thread pool size
-        if (concurrency_level == 1)
+        this->private_handle_ = private_handle;
+        int concurrency_level = this->_load_params();
+        this->handle_ = mt_handle;
+        const size_t input = pool.add([this]() { return this->process_next_frame(); }, private_handle.param("priority", 0));
+        this->_set_notify([&pool, input]() { pool.notify(input); });
+        // The input queue holds one frame per worker by default
+        this->initialize(concurrency_level > 0 ? concurrency_level : static_cast<int>(pool.threads()));
+    }
+
+    std::unique_ptr<CloudTrackerBase> make_cloud_tracker(PointType type, const TrackerConfig &config)
+    {
+        switch (type)
         {
-            handle_ = getNodeHandle();
+        case PointType::XYZI:
+            return std::unique_ptr<CloudTrackerBase>(new CloudTracker<pcl::PointXYZI>(config));
+        case PointType::XYZRGB:
+            return std::unique_ptr<CloudTrackerBase>(new CloudTracker<pcl::PointXYZRGB>(config));
+        default:
+            return std::unique_ptr<CloudTrackerBase>(new CloudTracker<pcl::PointXYZ>(config));
         }
-        else
+    }
+
+    void CloudTrackerNodelet::onInit()
+    {
+        std::string name = getPrivateNodeHandle().param<std::string>("point_type", "xyz");
+        PointType type = PointType::XYZ;
+        if (!parse_point_type(name, type))
+            NODELET_WARN("Unknown point type \"%s\", using xyz", name.c_str());
+        tracker_ = make_cloud_tracker(type, config_);
+        tracker_->start(getNodeHandle(), getMTNodeHandle(), getPrivateNodeHandle());
+        NODELET_INFO("%s tracker nodelet initialized...", config_.tracker_name.c_str());
+    }
+
+    MultiTrackerNodelet::~MultiTrackerNodelet()
+    {
+        // The workers are stopped before the trackers they process are destroyed
+        if (pool_)
+            pool_->stop();
+        trackers_.clear();
+    }
+
+    void MultiTrackerNodelet::onInit()
+    {
+        ros::NodeHandle &private_handle = getPrivateNodeHandle();
+        std::vector<std::string> inputs;
+        if (!private_handle.getParam("inputs", inputs) || inputs.empty())
         {
-            handle_ = getMTNodeHandle();
+            NODELET_ERROR("No inputs to track, the inputs parameter should list their names");
+            return;
         }
-        initialize(concurrency_level);
-        NODELET_INFO("%s tracker nodelet initialized...", _config.tracker_name.c_str());
+        pool_.reset(new TrackerPool(private_handle.param("threads", 0)));
+
+        for (const std::string &name : inputs)
+        {
+            ros::NodeHandle input_handle(private_handle, name);
+            std::string point_type = input_handle.param<std::string>("point_type", "xyz");
+            PointType type = PointType::XYZ;
+            if (!parse_point_type(point_type, type))
+                NODELET_WARN("%s: unknown point type \"%s\", using xyz", name.c_str(), point_type.c_str());
+
+            // Each input clusters one frame at a time by default, so the workspaces grow with the inputs and not with the workers
+            TrackerConfig config(name, 20, 100, 0.1, name, name, 8, visualization_msgs::Marker::CUBE);
+            config.parallel_frames = 1;
+            trackers_.push_back(make_cloud_tracker(type, config));
+            trackers_.back()->start_pooled(getMTNodeHandle(), input_handle, *pool_);
+        }
+        pool_->start();
+        NODELET_INFO("Multi tracker nodelet initialized, tracking %zu inputs on %zu threads", trackers_.size(), pool_->threads());
+    }
+
+    LidarTracker::LidarTracker()
+        : CloudTrackerNodelet(TrackerConfig("laser_cloud", 20, 100, 0.1, "asd", "asd", 8, visualization_msgs::Marker::CUBE))
+    {
     }
 
     CameraTracker::CameraTracker()
+        : CloudTrackerNodelet(TrackerConfig("camera_cloud", 40, 400, 0.1, "camera", "points", 8, visualization_msgs::Marker::SPHERE))
     {
-        _config = TrackerConfig("camera_cloud", 40, 400, 0.1, "camera", "points", 8, visualization_msgs::Marker::SPHERE);
     }
 
-    void CameraTracker::onInit()
+    ScanTracker::ScanTracker()
+    {
+        _config = TrackerConfig("laser_cloud", 20, 100, 0.1, "fusion_base", "scan", 8, visualization_msgs::Marker::CUBE);
+    }
+
+    void ScanTracker::onInit()
     {
         private_handle_ = getPrivateNodeHandle();
         int concurrency_level = _load_params();
@@ -63,7 +137,71 @@ namespace f1tenth_sensor_fusion
         initialize(concurrency_level);
         NODELET_INFO("%s tracker nodelet initialized...", _config.tracker_name.c_str());
     }
+
+    int ScanTracker::_load_params()
+    {
+        int concurrency_level = ClusterTracker<pcl::PointXYZ>::_load_params();
+        private_handle_.param<bool>("static_transform", static_transform_, true);
+        return concurrency_level;
+    }
+
+    void ScanTracker::_subscribe()
+    {
+        _init_tf();
+        if (!callback_registered_)
+        {
+            scan_sub_.registerCallback(boost::bind(&ScanTracker::scanCallback, this, _1));
+            callback_registered_ = true;
+        }
+        scan_sub_.subscribe(handle_, _config.scan_topic.c_str(), _subscriber_queue_size());
+    }
+
+    void ScanTracker::_unsubscribe()
+    {
+        scan_sub_.unsubscribe();
+    }
+
+    bool ScanTracker::update_scan_transform(const std_msgs::Header &header)
+    {
+        if (transform_cached_ && header.frame_id == laser_frame_)
+            return true;
+        try
+        {
+            geometry_msgs::TransformStamped t = tf2_->lookupTransform(_config.scan_frame, header.frame_id,
+                                                                      static_transform_ ? ros::Time(0) : header.stamp);
+            scan_transform_ = transform_to_eigen(t.transform);
+        }
+        catch (tf2::TransformException &ex)
+        {
+            NODELET_WARN_THROTTLE(1.0, "%s", ex.what());
+            return false;
+        }
+        laser_frame_ = header.frame_id;
+        transform_cached_ = static_transform_;
+        return true;
+    }
+
+    void ScanTracker::scanCallback(const sensor_msgs::LaserScan::ConstPtr &scan)
+    {
+        if (!update_scan_transform(scan->header))
+            return;
+
+        // A cloud is only read by the clustering and copied by the publishers, so its buffer is reused as soon as the
+        // tracker dropped it. There are as many clouds as frames waiting in the queue or being processed at once
+        auto cloud = std::find_if(cloud_pool_.begin(), cloud_pool_.end(),
+                                  [](const pcl::PointCloud<pcl::PointXYZ>::Ptr &c) { return c.use_count() == 1; });
+        if (cloud == cloud_pool_.end())
+            cloud = cloud_pool_.insert(cloud_pool_.end(), pcl::PointCloud<pcl::PointXYZ>::Ptr(new pcl::PointCloud<pcl::PointXYZ>));
+
+        pcl::PointCloud<pcl::PointXYZ> &scan_cloud = **cloud;
+        projection_.project(*scan, scan_transform_, scan_cloud);
+        pcl_conversions::toPCL(scan->header, scan_cloud.header);
+        scan_cloud.header.frame_id = _config.scan_frame;
+        cloudCallback(*cloud);
+    }
 }
 
 PLUGINLIB_EXPORT_CLASS(f1tenth_sensor_fusion::LidarTracker, nodelet::Nodelet);
-PLUGINLIB_EXPORT_CLASS(f1tenth_sensor_fusion::CameraTracker, nodelet::Nodelet);
\ No newline at end of file
+PLUGINLIB_EXPORT_CLASS(f1tenth_sensor_fusion::CameraTracker, nodelet::Nodelet);
+PLUGINLIB_EXPORT_CLASS(f1tenth_sensor_fusion::ScanTracker, nodelet::Nodelet);
+PLUGINLIB_EXPORT_CLASS(f1tenth_sensor_fusion::MultiTrackerNodelet, nodelet::Nodelet);
\ No newline at end of file
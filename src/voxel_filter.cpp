@@ -0,0 +1,172 @@
+/* Copyright 2021 Kovács Gergely Attila
+*
+*   Licensed under the Apache License,
+*   Version 2.0(the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License.
+*
+*/
+
+#include <f1tenth_sensor_fusion/voxel_filter.hpp>
+#include <algorithm>
+#include <cmath>
+
+namespace f1tenth_sensor_fusion
+{
+    namespace
+    {
+        // 21 bits per axis: +-1M voxels, i.e. +-10 km at a 1 cm leaf
+        constexpr int KEY_BITS = 21;
+        constexpr uint64_t KEY_MASK = (uint64_t(1) << KEY_BITS) - 1;
+
+        inline uint64_t voxel_key(float x, float y, float z, float inv_leaf)
+        {
+            const uint64_t ix = static_cast<uint64_t>(static_cast<int64_t>(std::floor(x * inv_leaf))) & KEY_MASK;
+            const uint64_t iy = static_cast<uint64_t>(static_cast<int64_t>(std::floor(y * inv_leaf))) & KEY_MASK;
+            const uint64_t iz = static_cast<uint64_t>(static_cast<int64_t>(std::floor(z * inv_leaf))) & KEY_MASK;
+            return (ix << (2 * KEY_BITS)) | (iy << KEY_BITS) | iz;
+        }
+
+        inline size_t hash(uint64_t key)
+        {
+            // Fibonacci hashing spreads neighbouring voxels over the table
+            return static_cast<size_t>((key * 0x9E3779B97F4A7C15ull) >> 32);
+        }
+    }
+
+    bool parse_voxel_mode(const std::string &name, VoxelMode &mode)
+    {
+        if (name == "centroid")
+            mode = VoxelMode::CENTROID;
+        else if (name == "approximate")
+            mode = VoxelMode::APPROXIMATE;
+        else
+            return false;
+        return true;
+    }
+
+    VoxelDownsampler::VoxelDownsampler(float leaf_size, VoxelMode mode)
+        : inv_leaf_(1.f / leaf_size), mode_(mode)
+    {
+    }
+
+    void VoxelDownsampler::reserve(size_t num_points)
+    {
+        // keep the load factor of the table below one half
+        size_t size = std::max<size_t>(table_.size(), 1024);
+        while (size < 2 * num_points)
+            size *= 2;
+        if (size != table_.size())
+        {
+            table_.assign(size, Entry{0, 0, 0});
+            mask_ = size - 1;
+            generation_ = 0;
+        }
+        if (mode_ == VoxelMode::CENTROID && accumulators_.size() < num_points)
+            accumulators_.resize(num_points);
+
+        // generation 0 marks the entries as empty
+        if (++generation_ == 0)
+        {
+            std::fill(table_.begin(), table_.end(), Entry{0, 0, 0});
+            generation_ = 1;
+        }
+    }
+
+    bool VoxelDownsampler::lookup(uint64_t key, uint32_t next_voxel, uint32_t &voxel)
+    {
+        for (size_t i = hash(key) & mask_;; i = (i + 1) & mask_)
+        {
+            Entry &e = table_[i];
+            if (e.generation != generation_)
+            {
+                e = Entry{key, generation_, next_voxel};
+                voxel = next_voxel;
+                return true;
+            }
+            if (e.key == key)
+            {
+                voxel = e.voxel;
+                return false;
+            }
+        }
+    }
+
+    template <class PointT>
+    void VoxelDownsampler::filter(pcl::PointCloud<PointT> &cloud)
+    {
+        constexpr int channels = PointFields<PointT>::CHANNELS;
+        reserve(cloud.size());
+        if (channels > 0 && mode_ == VoxelMode::CENTROID && channels_.size() < channels * cloud.size())
+            channels_.resize(channels * cloud.size());
+
+        // A voxel is numbered when its first point is met, so voxel <= i and the output can overwrite the input
+        uint32_t num_voxels = 0;
+        for (size_t i = 0; i < cloud.size(); i++)
+        {
+            const PointT p = cloud[i];
+            if (!std::isfinite(p.x) || !std::isfinite(p.y) || !std::isfinite(p.z))
+                continue;
+
+            uint32_t voxel;
+            const bool is_new = lookup(voxel_key(p.x, p.y, p.z, inv_leaf_), num_voxels, voxel);
+            if (mode_ == VoxelMode::APPROXIMATE)
+            {
+                if (is_new)
+                    cloud[num_voxels++] = p;
+                continue;
+            }
+
+            Accumulator &a = accumulators_[voxel];
+            float *sums = channels_.data() + channels * voxel;
+            if (is_new)
+            {
+                a = Accumulator{p.x, p.y, p.z, 1};
+                PointFields<PointT>::get(p, sums);
+                num_voxels++;
+            }
+            else
+            {
+                a.x += p.x;
+                a.y += p.y;
+                a.z += p.z;
+                a.count++;
+                float values[channels > 0 ? channels : 1];
+                PointFields<PointT>::get(p, values);
+                for (int c = 0; c < channels; c++)
+                    sums[c] += values[c];
+            }
+        }
+
+        if (mode_ == VoxelMode::CENTROID)
+        {
+            for (uint32_t v = 0; v < num_voxels; v++)
+            {
+                const Accumulator &a = accumulators_[v];
+                const float inv_count = 1.f / a.count;
+                cloud[v].x = a.x * inv_count;
+                cloud[v].y = a.y * inv_count;
+                cloud[v].z = a.z * inv_count;
+                float values[channels > 0 ? channels : 1];
+                for (int c = 0; c < channels; c++)
+                    values[c] = channels_[channels * v + c] * inv_count;
+                PointFields<PointT>::set(values, cloud[v]);
+            }
+        }
+
+        cloud.resize(num_voxels);
+        cloud.is_dense = true;
+    }
+
+    template void VoxelDownsampler::filter(pcl::PointCloud<pcl::PointXYZ> &);
+    template void VoxelDownsampler::filter(pcl::PointCloud<pcl::PointXYZI> &);
+    template void VoxelDownsampler::filter(pcl::PointCloud<pcl::PointXYZRGB> &);
+}
@@ -0,0 +1,212 @@
+/* Copyright 2021 Kovács Gergely Attila
+*
+*   Licensed under the Apache License,
+*   Version 2.0(the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License.
+*
+*/
+
+#include <f1tenth_sensor_fusion/assignment.hpp>
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <limits>
+#include <random>
+#include <vector>
+
+using namespace f1tenth_sensor_fusion;
+
+namespace
+{
+    PointVector points(std::initializer_list<std::pair<float, float>> xy)
+    {
+        PointVector out;
+        for (const auto &p : xy)
+            out.push_back(pcl::PointXYZ(p.first, p.second, 0.f));
+        return out;
+    }
+
+    PointVector random_points(std::mt19937 &rng, size_t n, float extent)
+    {
+        std::uniform_real_distribution<float> coord(0.f, extent);
+        PointVector out;
+        for (size_t i = 0; i < n; i++)
+            out.push_back(pcl::PointXYZ(coord(rng), coord(rng), coord(rng)));
+        return out;
+    }
+
+    /// Total distance of an assignment, an unmatched prediction costs the gate as in HungarianSolver.
+    double cost(const PointVector &pred, const PointVector &centres, float gate, const boost::container::vector<int> &assignment)
+    {
+        double total = 0.0;
+        for (size_t i = 0; i < pred.size(); i++)
+            total += assignment[i] == -1 ? gate : planar_dst(pred[i], centres[assignment[i]]);
+        return total;
+    }
+
+    /// Cheapest assignment of the predictions from i on, trying every centre within the gate and leaving it unmatched.
+    double brute_force(const PointVector &pred, const PointVector &centres, float gate, size_t i, std::vector<bool> &used)
+    {
+        if (i == pred.size())
+            return 0.0;
+        double best = gate + brute_force(pred, centres, gate, i + 1, used);
+        for (size_t j = 0; j < centres.size(); j++)
+        {
+            const float d = planar_dst(pred[i], centres[j]);
+            if (used[j] || d > gate)
+                continue;
+            used[j] = true;
+            best = std::min(best, d + brute_force(pred, centres, gate, i + 1, used));
+            used[j] = false;
+        }
+        return best;
+    }
+
+    /// Repeatedly match the closest pair left within the gate, as GatedNearestSolver should.
+    boost::container::vector<int> greedy(const PointVector &pred, const PointVector &centres, float gate)
+    {
+        boost::container::vector<int> assignment(pred.size(), -1);
+        std::vector<bool> used(centres.size(), false);
+        while (true)
+        {
+            int best_i = -1, best_j = -1;
+            float best = gate > 0 ? gate : std::numeric_limits<float>::max();
+            for (size_t i = 0; i < pred.size(); i++)
+                for (size_t j = 0; j < centres.size(); j++)
+                    if (assignment[i] == -1 && !used[j] && planar_dst(pred[i], centres[j]) <= best)
+                    {
+                        best = planar_dst(pred[i], centres[j]);
+                        best_i = i;
+                        best_j = j;
+                    }
+            if (best_i == -1)
+                return assignment;
+            assignment[best_i] = best_j;
+            used[best_j] = true;
+        }
+    }
+
+    void expect_one_to_one(const boost::container::vector<int> &assignment, size_t num_centres)
+    {
+        std::vector<int> seen(num_centres, 0);
+        for (int c : assignment)
+        {
+            ASSERT_GE(c, -1);
+            ASSERT_LT(c, static_cast<int>(num_centres));
+            if (c != -1)
+            {
+                EXPECT_EQ(++seen[c], 1) << "centre " << c << " matched twice";
+            }
+        }
+    }
+}
+
+TEST(Assignment, ParsesMethodNames)
+{
+    AssignmentMethod method = AssignmentMethod::GATED_NEAREST;
+    EXPECT_TRUE(parse_assignment_method("hungarian", method));
+    EXPECT_EQ(method, AssignmentMethod::HUNGARIAN);
+    EXPECT_TRUE(parse_assignment_method("gated_nearest", method));
+    EXPECT_EQ(method, AssignmentMethod::GATED_NEAREST);
+    EXPECT_FALSE(parse_assignment_method("auction", method));
+    EXPECT_EQ(method, AssignmentMethod::GATED_NEAREST);
+}
+
+TEST(Assignment, PlanarDistanceIgnoresHeight)
+{
+    EXPECT_FLOAT_EQ(planar_dst(pcl::PointXYZ(0.f, 0.f, 0.f), pcl::PointXYZ(3.f, 4.f, 10.f)), 5.f);
+}
+
+TEST(Assignment, EmptyInputsLeaveEveryPredictionUnmatched)
+{
+    for (AssignmentMethod method : {AssignmentMethod::HUNGARIAN, AssignmentMethod::GATED_NEAREST})
+    {
+        std::unique_ptr<AssignmentSolver> solver = make_assignment_solver(method);
+        boost::container::vector<int> assignment(5, 3);
+        solver->solve(points({{0.f, 0.f}, {1.f, 1.f}}), PointVector(), 1.f, assignment);
+        EXPECT_EQ(assignment, boost::container::vector<int>(2, -1));
+        solver->solve(PointVector(), points({{0.f, 0.f}}), 1.f, assignment);
+        EXPECT_TRUE(assignment.empty());
+    }
+}
+
+TEST(Assignment, HungarianMinimizesTheTotalDistance)
+{
+    // The closest pair (1, 0) forces the other prediction far away, the optimum pairs them in order
+    const PointVector pred = points({{0.f, 0.f}, {1.f, 0.f}});
+    const PointVector centres = points({{0.9f, 0.f}, {1.9f, 0.f}});
+    HungarianSolver hungarian;
+    boost::container::vector<int> assignment;
+    hungarian.solve(pred, centres, 0.f, assignment);
+    EXPECT_EQ(assignment, (boost::container::vector<int>{0, 1}));
+
+    GatedNearestSolver nearest;
+    nearest.solve(pred, centres, 0.f, assignment);
+    EXPECT_EQ(assignment, (boost::container::vector<int>{1, 0}));
+}
+
+TEST(Assignment, PairsBeyondTheGateAreNeverMatched)
+{
+    const PointVector pred = points({{0.f, 0.f}, {10.f, 0.f}});
+    const PointVector centres = points({{0.5f, 0.f}, {5.f, 0.f}});
+    for (AssignmentMethod method : {AssignmentMethod::HUNGARIAN, AssignmentMethod::GATED_NEAREST})
+    {
+        boost::container::vector<int> assignment;
+        make_assignment_solver(method)->solve(pred, centres, 1.f, assignment);
+        EXPECT_EQ(assignment, (boost::container::vector<int>{0, -1}));
+        // without a gate every prediction finds a centre
+        make_assignment_solver(method)->solve(pred, centres, 0.f, assignment);
+        EXPECT_EQ(assignment, (boost::container::vector<int>{0, 1}));
+    }
+}
+
+TEST(Assignment, HungarianMatchesBruteForce)
+{
+    std::mt19937 rng(1);
+    HungarianSolver solver; // reused, as by the trackers
+    boost::container::vector<int> assignment;
+    for (int trial = 0; trial < 300; trial++)
+    {
+        const PointVector pred = random_points(rng, 1 + trial % 6, 3.f);
+        const PointVector centres = random_points(rng, 1 + (trial / 6) % 6, 3.f);
+        const float gate = 0.5f + (trial % 4) * 0.5f;
+        solver.solve(pred, centres, gate, assignment);
+        ASSERT_EQ(assignment.size(), pred.size());
+        expect_one_to_one(assignment, centres.size());
+        for (size_t i = 0; i < pred.size(); i++)
+            if (assignment[i] != -1)
+            {
+                EXPECT_LE(planar_dst(pred[i], centres[assignment[i]]), gate);
+            }
+        std::vector<bool> used(centres.size(), false);
+        EXPECT_NEAR(cost(pred, centres, gate, assignment), brute_force(pred, centres, gate, 0, used), 1e-4) << "trial " << trial;
+    }
+}
+
+TEST(Assignment, GatedNearestMatchesGreedyReference)
+{
+    std::mt19937 rng(2);
+    GatedNearestSolver solver;
+    boost::container::vector<int> assignment;
+    for (int trial = 0; trial < 300; trial++)
+    {
+        // spread over many grid cells, with negative coordinates as well
+        PointVector pred = random_points(rng, 1 + trial % 20, 10.f), centres = random_points(rng, 1 + (trial / 3) % 20, 10.f);
+        for (pcl::PointXYZ &p : pred)
+            p.x -= 5.f;
+        for (pcl::PointXYZ &p : centres)
+            p.x -= 5.f;
+        const float gate = trial % 5 == 0 ? 0.f : 0.25f * (trial % 5);
+        solver.solve(pred, centres, gate, assignment);
+        expect_one_to_one(assignment, centres.size());
+        EXPECT_EQ(assignment, greedy(pred, centres, gate)) << "trial " << trial;
+    }
+}
@@ -0,0 +1,254 @@
+/* Copyright 2021 Kovács Gergely Attila
+*
+*   Licensed under the Apache License,
+*   Version 2.0(the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License.
+*
+*/
+
+#include <f1tenth_sensor_fusion/clustering.hpp>
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <random>
+#include <set>
+#include <vector>
+
+using namespace f1tenth_sensor_fusion;
+
+namespace
+{
+    typedef pcl::PointCloud<pcl::PointXYZ> Cloud;
+    typedef std::set<std::vector<int>> ClusterSet;
+
+    /// A 360 degree scan of a room of the given radius, with the beams in [begin, end) hitting an object at range 1.
+    Cloud::Ptr scan(size_t beams, float radius, const std::vector<std::pair<size_t, size_t>> &objects)
+    {
+        Cloud::Ptr cloud(new Cloud);
+        for (size_t i = 0; i < beams; i++)
+        {
+            float range = radius;
+            for (const auto &o : objects)
+                if (i >= o.first && i < o.second)
+                    range = 1.f;
+            const float angle = 2.f * static_cast<float>(M_PI) * i / beams;
+            cloud->push_back(pcl::PointXYZ(range * std::cos(angle), range * std::sin(angle), 0.f));
+        }
+        return cloud;
+    }
+
+    std::vector<int> range(int begin, int end)
+    {
+        std::vector<int> out(end - begin);
+        std::iota(out.begin(), out.end(), begin);
+        return out;
+    }
+
+    /// The clusters with their points sorted, to compare them regardless of order.
+    ClusterSet as_set(const std::vector<pcl::PointIndices> &clusters)
+    {
+        ClusterSet out;
+        for (const pcl::PointIndices &c : clusters)
+        {
+            std::vector<int> indices = c.indices;
+            std::sort(indices.begin(), indices.end());
+            out.insert(indices);
+        }
+        return out;
+    }
+
+    /// Euclidean clusters by brute force: connected components of the points closer than the tolerance.
+    ClusterSet components(const Cloud &cloud, float tolerance, size_t min_size, size_t max_size)
+    {
+        std::vector<int> label(cloud.size(), -1);
+        ClusterSet out;
+        for (size_t s = 0; s < cloud.size(); s++)
+        {
+            if (label[s] != -1)
+                continue;
+            std::vector<int> members{static_cast<int>(s)}, stack{static_cast<int>(s)};
+            label[s] = static_cast<int>(s);
+            while (!stack.empty())
+            {
+                const int i = stack.back();
+                stack.pop_back();
+                for (size_t j = 0; j < cloud.size(); j++)
+                    if (label[j] == -1 && (cloud[i].getVector3fMap() - cloud[j].getVector3fMap()).norm() <= tolerance)
+                    {
+                        label[j] = static_cast<int>(s);
+                        members.push_back(static_cast<int>(j));
+                        stack.push_back(static_cast<int>(j));
+                    }
+            }
+            std::sort(members.begin(), members.end());
+            if (members.size() >= min_size && members.size() <= max_size)
+                out.insert(members);
+        }
+        return out;
+    }
+
+    /// Blobs of points around the given centres, each point within a quarter of the spacing of the next one.
+    Cloud::Ptr blobs(std::mt19937 &rng, const std::vector<pcl::PointXYZ> &centres, size_t points_per_blob)
+    {
+        std::normal_distribution<float> offset(0.f, 0.1f);
+        Cloud::Ptr cloud(new Cloud);
+        for (size_t k = 0; k < points_per_blob; k++)
+            for (const pcl::PointXYZ &c : centres)
+                cloud->push_back(pcl::PointXYZ(c.x + offset(rng), c.y + offset(rng), c.z + 0.5f * offset(rng)));
+        return cloud;
+    }
+
+    void expect_sorted_by_size(const std::vector<pcl::PointIndices> &clusters)
+    {
+        for (size_t k = 1; k < clusters.size(); k++)
+            EXPECT_GE(clusters[k - 1].indices.size(), clusters[k].indices.size());
+    }
+}
+
+TEST(Clustering, ParsesMethodNames)
+{
+    ClusteringMethod method = ClusteringMethod::EUCLIDEAN;
+    EXPECT_TRUE(parse_clustering_method("scanline", method));
+    EXPECT_EQ(method, ClusteringMethod::SCANLINE);
+    EXPECT_TRUE(parse_clustering_method("seeded", method));
+    EXPECT_EQ(method, ClusteringMethod::SEEDED);
+    EXPECT_TRUE(parse_clustering_method("euclidean", method));
+    EXPECT_EQ(method, ClusteringMethod::EUCLIDEAN);
+    EXPECT_FALSE(parse_clustering_method("dbscan", method));
+    EXPECT_EQ(method, ClusteringMethod::EUCLIDEAN);
+}
+
+TEST(ScanlineClustering, SplitsAtRangeJumps)
+{
+    // beams 0.5 degrees apart: 0.9 cm at 1 m, 4.4 cm in the room at 5 m
+    ScanlineClustering clustering(0.04, 10, 300);
+    std::vector<pcl::PointIndices> clusters;
+    clustering.extract(scan(720, 5.f, {{100, 140}, {300, 320}}), clusters);
+    ASSERT_EQ(clusters.size(), 2u);
+    EXPECT_EQ(clusters[0].indices, range(100, 140));
+    EXPECT_EQ(clusters[1].indices, range(300, 320));
+}
+
+TEST(ScanlineClustering, AppliesAndChangesTheSizeLimits)
+{
+    ScanlineClustering clustering(0.04, 25, 300);
+    std::vector<pcl::PointIndices> clusters;
+    const Cloud::Ptr cloud = scan(720, 5.f, {{100, 140}, {300, 320}, {500, 505}});
+    clustering.extract(cloud, clusters);
+    ASSERT_EQ(clusters.size(), 1u);
+    EXPECT_EQ(clusters[0].indices.size(), 40u);
+
+    clustering.set_size_limits(2, 30); // the beams of the room are single point segments
+    clustering.extract(cloud, clusters);
+    ASSERT_EQ(clusters.size(), 2u);
+    EXPECT_EQ(clusters[0].indices, range(300, 320));
+    EXPECT_EQ(clusters[1].indices, range(500, 505));
+}
+
+TEST(ScanlineClustering, SkipsInvalidBeams)
+{
+    ScanlineClustering clustering(0.04, 10, 300);
+    Cloud::Ptr cloud = scan(720, 5.f, {{100, 140}});
+    const float nan = std::numeric_limits<float>::quiet_NaN();
+    for (int i : {110, 111, 200})
+        (*cloud)[i] = pcl::PointXYZ(nan, nan, nan);
+    std::vector<pcl::PointIndices> clusters;
+    clustering.extract(cloud, clusters);
+    ASSERT_EQ(clusters.size(), 1u);
+    std::vector<int> expected = range(100, 110);
+    const std::vector<int> rest = range(112, 140);
+    expected.insert(expected.end(), rest.begin(), rest.end());
+    EXPECT_EQ(clusters[0].indices, expected);
+}
+
+TEST(ScanlineClustering, JoinsTheEndsOfAFullScan)
+{
+    ScanlineClustering clustering(0.04, 10, 300);
+    std::vector<pcl::PointIndices> clusters;
+    clustering.extract(scan(720, 5.f, {{0, 15}, {700, 720}, {300, 320}}), clusters);
+    ASSERT_EQ(clusters.size(), 2u);
+    std::vector<int> wrapped = range(700, 720);
+    const std::vector<int> start = range(0, 15);
+    wrapped.insert(wrapped.end(), start.begin(), start.end());
+    EXPECT_EQ(clusters[0].indices, wrapped);
+    EXPECT_EQ(clusters[1].indices, range(300, 320));
+}
+
+TEST(ScanlineClustering, ReusedOutputHoldsOnlyTheLastScan)
+{
+    ScanlineClustering clustering(0.04, 10, 300);
+    std::vector<pcl::PointIndices> clusters;
+    clustering.extract(scan(720, 5.f, {{100, 140}, {200, 250}, {300, 320}}), clusters);
+    ASSERT_EQ(clusters.size(), 3u);
+    expect_sorted_by_size(clusters);
+    clustering.extract(scan(720, 5.f, {{400, 420}}), clusters);
+    ASSERT_EQ(clusters.size(), 1u);
+    EXPECT_EQ(clusters[0].indices, range(400, 420));
+}
+
+TEST(SeededClustering, WithoutSeedsFindsTheEuclideanClusters)
+{
+    std::mt19937 rng(3);
+    SeededClustering clustering(0.2, 5, 1000, 0.5, 10);
+    std::vector<pcl::PointIndices> clusters;
+    for (int trial = 0; trial < 5; trial++)
+    {
+        const Cloud::Ptr cloud = blobs(rng, {pcl::PointXYZ(0.f, 0.f, 0.f), pcl::PointXYZ(2.f, 0.f, 0.f), pcl::PointXYZ(-1.f, 3.f, 0.5f),
+                                             pcl::PointXYZ(0.3f, 0.3f, 2.f), pcl::PointXYZ(-4.f, -4.f, 0.f)},
+                                       20 + 15 * trial);
+        clustering.extract(cloud, clusters);
+        expect_sorted_by_size(clusters);
+        EXPECT_EQ(as_set(clusters), components(*cloud, 0.2f, 5, 1000)) << "trial " << trial;
+    }
+}
+
+TEST(SeededClustering, GrowsTheSeededClustersBetweenFullClusterings)
+{
+    std::mt19937 rng(4);
+    const Cloud::Ptr cloud = blobs(rng, {pcl::PointXYZ(0.f, 0.f, 0.f), pcl::PointXYZ(3.f, 0.f, 0.f), pcl::PointXYZ(0.f, 3.f, 0.f)}, 50);
+    const ClusterSet all = components(*cloud, 0.2f, 5, 1000);
+    ClusterSet seeded;
+    for (const std::vector<int> &c : all)
+        if (std::find(c.begin(), c.end(), 0) != c.end()) // the first point belongs to the blob at the origin
+            seeded.insert(c);
+    ASSERT_EQ(seeded.size(), 1u);
+
+    SeededClustering clustering(0.2, 5, 1000, 0.5, 3);
+    // the second seed is too far from any point to grow a cluster
+    clustering.set_seeds(boost::container::vector<pcl::PointXYZ>{pcl::PointXYZ(0.2f, 0.1f, 0.f), pcl::PointXYZ(10.f, 10.f, 0.f)});
+    std::vector<pcl::PointIndices> clusters;
+    for (int frame = 1; frame <= 6; frame++)
+    {
+        clustering.extract(cloud, clusters);
+        // the whole cloud is clusterized every third frame
+        EXPECT_EQ(as_set(clusters), frame % 3 == 0 ? all : seeded) << "frame " << frame;
+    }
+
+    // without seeds every frame is a full clustering
+    clustering.set_seeds(boost::container::vector<pcl::PointXYZ>());
+    clustering.extract(cloud, clusters);
+    EXPECT_EQ(as_set(clusters), all);
+}
+
+TEST(SeededClustering, SeedsOfOneObjectGrowItOnce)
+{
+    std::mt19937 rng(5);
+    const Cloud::Ptr cloud = blobs(rng, {pcl::PointXYZ(0.f, 0.f, 0.f), pcl::PointXYZ(3.f, 0.f, 0.f)}, 40);
+    SeededClustering clustering(0.2, 1, 1000, 0.5, 100);
+    clustering.set_seeds(boost::container::vector<pcl::PointXYZ>{pcl::PointXYZ(0.f, 0.f, 0.f), pcl::PointXYZ(0.1f, 0.f, 0.f),
+                                                                 pcl::PointXYZ(3.f, 0.f, 0.f)});
+    std::vector<pcl::PointIndices> clusters;
+    clustering.extract(cloud, clusters);
+    EXPECT_EQ(as_set(clusters), components(*cloud, 0.2f, 1, 1000));
+}
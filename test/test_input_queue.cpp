@@ -0,0 +1,199 @@
+/* Copyright 2021 Kovács Gergely Attila
+*
+*   Licensed under the Apache License,
+*   Version 2.0(the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License.
+*
+*/
+
+#include <f1tenth_sensor_fusion/input_queue.hpp>
+#include <sensor_msgs/PointCloud2.h>
+#include <gtest/gtest.h>
+#include <thread>
+#include <vector>
+
+using namespace f1tenth_sensor_fusion;
+
+namespace
+{
+    typedef InputQueue<sensor_msgs::PointCloud2> CloudQueue;
+
+    const ros::Time NOW(1000.0);
+
+    CloudQueue::ConstPtr frame(uint32_t seq, double age = 0.0)
+    {
+        sensor_msgs::PointCloud2::Ptr msg(new sensor_msgs::PointCloud2);
+        msg->header.seq = seq;
+        msg->header.stamp = NOW - ros::Duration(age);
+        return msg;
+    }
+
+    class InputQueueTest : public ::testing::Test
+    {
+    protected:
+        void SetUp() override { ros::Time::setNow(NOW); }
+
+        /// Sequence numbers of the frames left to pop.
+        std::vector<uint32_t> drain(CloudQueue &queue)
+        {
+            std::vector<uint32_t> out;
+            CloudQueue::ConstPtr msg;
+            while (queue.pop(msg))
+                out.push_back(msg->header.seq);
+            EXPECT_FALSE(msg);
+            return out;
+        }
+    };
+}
+
+TEST(QueuePolicy, ParsesPolicyNames)
+{
+    QueuePolicy policy = QueuePolicy::FIFO;
+    EXPECT_TRUE(parse_queue_policy("latest", policy));
+    EXPECT_EQ(policy, QueuePolicy::LATEST);
+    EXPECT_TRUE(parse_queue_policy("deadline", policy));
+    EXPECT_EQ(policy, QueuePolicy::DEADLINE);
+    EXPECT_TRUE(parse_queue_policy("fifo", policy));
+    EXPECT_EQ(policy, QueuePolicy::FIFO);
+    EXPECT_FALSE(parse_queue_policy("lifo", policy));
+    EXPECT_EQ(policy, QueuePolicy::FIFO);
+}
+
+TEST_F(InputQueueTest, LatestKeepsOnlyTheNewestFrame)
+{
+    CloudQueue queue;
+    queue.configure(QueuePolicy::LATEST, 10, 0.0);
+    EXPECT_EQ(queue.subscriber_queue_size(), 1u);
+    for (uint32_t seq = 1; seq <= 3; seq++)
+        queue.push(frame(seq));
+    EXPECT_EQ(drain(queue), std::vector<uint32_t>{3});
+}
+
+TEST_F(InputQueueTest, FifoDropsTheOldestFrames)
+{
+    CloudQueue queue;
+    queue.configure(QueuePolicy::FIFO, 3, 0.0);
+    EXPECT_EQ(queue.subscriber_queue_size(), 3u);
+    for (uint32_t seq = 1; seq <= 5; seq++)
+        queue.push(frame(seq));
+    EXPECT_EQ(drain(queue), (std::vector<uint32_t>{3, 4, 5}));
+
+    // frames are taken in arrival order as they come
+    queue.push(frame(6));
+    queue.push(frame(7));
+    CloudQueue::ConstPtr msg;
+    ASSERT_TRUE(queue.pop(msg));
+    EXPECT_EQ(msg->header.seq, 6u);
+    queue.push(frame(8));
+    EXPECT_EQ(drain(queue), (std::vector<uint32_t>{7, 8}));
+}
+
+TEST_F(InputQueueTest, DeadlineDropsExpiredFramesWhenTaken)
+{
+    CloudQueue queue;
+    queue.configure(QueuePolicy::DEADLINE, 5, 0.1);
+    queue.push(frame(1, 0.5));
+    queue.push(frame(2, 0.05));
+    queue.push(frame(3, 0.2));
+    queue.push(frame(4, 0.0));
+    EXPECT_EQ(drain(queue), (std::vector<uint32_t>{2, 4}));
+
+    // the age is measured when the frame is taken, not when it arrives
+    queue.push(frame(5, 0.0));
+    ros::Time::setNow(NOW + ros::Duration(0.5));
+    EXPECT_TRUE(drain(queue).empty());
+}
+
+TEST_F(InputQueueTest, FifoKeepsOldFrames)
+{
+    CloudQueue queue;
+    queue.configure(QueuePolicy::FIFO, 2, 0.1);
+    queue.push(frame(1, 5.0));
+    EXPECT_EQ(drain(queue), std::vector<uint32_t>{1});
+}
+
+TEST_F(InputQueueTest, ClearAndReconfigure)
+{
+    CloudQueue queue;
+    queue.configure(QueuePolicy::FIFO, 0, 0.0); // at least one slot
+    EXPECT_EQ(queue.subscriber_queue_size(), 1u);
+    EXPECT_TRUE(queue.empty());
+    queue.push(frame(1));
+    queue.push(frame(2));
+    EXPECT_FALSE(queue.empty());
+    queue.clear();
+    EXPECT_TRUE(queue.empty());
+    EXPECT_TRUE(drain(queue).empty());
+
+    queue.configure(QueuePolicy::FIFO, 4, 0.0);
+    for (uint32_t seq = 1; seq <= 4; seq++)
+        queue.push(frame(seq));
+    EXPECT_EQ(drain(queue), (std::vector<uint32_t>{1, 2, 3, 4}));
+}
+
+TEST_F(InputQueueTest, NumbersTheFramesTaken)
+{
+    CloudQueue queue;
+    queue.configure(QueuePolicy::DEADLINE, 5, 0.1);
+    queue.push(frame(1));
+    queue.push(frame(2, 0.5));
+    queue.push(frame(3));
+    CloudQueue::ConstPtr msg;
+    uint64_t seq = 7;
+    ASSERT_TRUE(queue.pop(msg, seq));
+    EXPECT_EQ(seq, 0u);
+    // the expired frame gets no number
+    ASSERT_TRUE(queue.pop(msg, seq));
+    EXPECT_EQ(msg->header.seq, 3u);
+    EXPECT_EQ(seq, 1u);
+    EXPECT_FALSE(queue.pop(msg, seq));
+    EXPECT_EQ(seq, 1u);
+}
+
+TEST_F(InputQueueTest, ConcurrentPopsNumberTheFramesInOrder)
+{
+    const uint32_t frames = 20000;
+    CloudQueue queue;
+    queue.configure(QueuePolicy::FIFO, frames, 0.0);
+    for (uint32_t seq = 0; seq < frames; seq++)
+        queue.push(frame(seq));
+
+    // every thread checks that the number of each frame it takes is the position of the frame in the queue
+    std::vector<std::thread> threads;
+    std::vector<size_t> taken(4, 0), misnumbered(4, 0);
+    for (size_t t = 0; t < taken.size(); t++)
+        threads.emplace_back([&queue, &taken, &misnumbered, t]() {
+            CloudQueue::ConstPtr msg;
+            uint64_t seq;
+            while (queue.pop(msg, seq))
+            {
+                taken[t]++;
+                misnumbered[t] += seq != msg->header.seq;
+            }
+        });
+    for (std::thread &thread : threads)
+        thread.join();
+    size_t total = 0;
+    for (size_t t = 0; t < taken.size(); t++)
+    {
+        total += taken[t];
+        EXPECT_EQ(misnumbered[t], 0u) << "thread " << t;
+    }
+    EXPECT_EQ(total, frames);
+}
+
+int main(int argc, char **argv)
+{
+    testing::InitGoogleTest(&argc, argv);
+    ros::Time::init();
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,162 @@
+/* Copyright 2021 Kovács Gergely Attila
+*
+*   Licensed under the Apache License,
+*   Version 2.0(the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License.
+*
+*/
+
+#include <f1tenth_sensor_fusion/kalman_filter_bank.hpp>
+#include <gtest/gtest.h>
+#include <cmath>
+#include <vector>
+
+using namespace f1tenth_sensor_fusion;
+
+namespace
+{
+    typedef KalmanFilterBank<4, 2> Bank;
+
+    /// Textbook Kalman filter with dense matrices, the reference of the bank.
+    struct DenseFilter
+    {
+        Eigen::Vector4f x;
+        Eigen::Matrix4f P;
+
+        void predict(const Eigen::Matrix4f &F, const Eigen::Matrix4f &Q)
+        {
+            x = F * x;
+            P = F * P * F.transpose() + Q;
+        }
+
+        void correct(const Eigen::Vector2f &z, const Eigen::Matrix2f &R)
+        {
+            Eigen::Matrix<float, 2, 4> H = Eigen::Matrix<float, 2, 4>::Zero();
+            H(0, 0) = H(1, 1) = 1.f;
+            const Eigen::Matrix2f S = H * P * H.transpose() + R;
+            const Eigen::Matrix<float, 4, 2> K = P * H.transpose() * S.inverse();
+            x += K * (z - H * x);
+            P = (Eigen::Matrix4f::Identity() - K * H) * P;
+        }
+    };
+}
+
+TEST(KalmanFilterBank, ReusesReleasedSlots)
+{
+    Bank bank;
+    const size_t a = bank.allocate(Bank::MeasVector(1.f, 2.f));
+    const size_t b = bank.allocate(Bank::MeasVector(3.f, 4.f));
+    const size_t c = bank.allocate(Bank::MeasVector(5.f, 6.f));
+    EXPECT_NE(a, b);
+    EXPECT_NE(b, c);
+    EXPECT_EQ(bank.size(), 3u);
+    const size_t capacity = bank.capacity();
+
+    bank.release(b);
+    EXPECT_FALSE(bank.active(b));
+    EXPECT_EQ(bank.size(), 2u);
+    EXPECT_EQ(bank.allocate(Bank::MeasVector(7.f, 8.f)), b);
+    EXPECT_EQ(bank.capacity(), capacity);
+    EXPECT_FLOAT_EQ(bank.state(b, 0), 7.f);
+    EXPECT_FLOAT_EQ(bank.state(b, 2), 0.f); // the unobserved velocity starts at zero
+
+    // growing the buffers keeps the filters already allocated
+    while (bank.size() <= capacity)
+        bank.allocate(Bank::MeasVector(0.f, 0.f));
+    EXPECT_GT(bank.capacity(), capacity);
+    EXPECT_FLOAT_EQ(bank.state(a, 0), 1.f);
+    EXPECT_FLOAT_EQ(bank.state(c, 1), 6.f);
+}
+
+TEST(KalmanFilterBank, RunsUpToTheHighestActiveSlot)
+{
+    Bank::StateMatrix F = Bank::StateMatrix::Identity();
+    F(0, 2) = F(1, 3) = 0.05f;
+    Bank bank;
+    bank.set_model(F, Bank::StateMatrix::Identity() * 1e-3f, Bank::MeasMatrix::Identity() * 0.01f, Bank::StateMatrix::Identity());
+    std::vector<size_t> slots;
+    for (int i = 0; i < 5; i++)
+        slots.push_back(bank.allocate(Bank::MeasVector(static_cast<float>(i), 0.f)));
+    EXPECT_EQ(bank.live_end(), 5u);
+
+    // the two highest filters are released and a lower one, only the first two are left in the range
+    bank.release(slots[4]);
+    bank.release(slots[2]);
+    EXPECT_EQ(bank.live_end(), 4u);
+    bank.release(slots[3]);
+    EXPECT_EQ(bank.live_end(), 2u);
+    const float released = bank.covariance(slots[3], 0, 0);
+    for (int k = 0; k < 1000; k++)
+    {
+        bank.predict();
+        bank.correct();
+    }
+    // the covariance of a free slot no longer grows, the active filters are still run
+    EXPECT_FLOAT_EQ(bank.covariance(slots[3], 0, 0), released);
+    EXPECT_GT(bank.covariance(slots[1], 0, 0), 1.f);
+
+    // the lowest free slot is handed out first, so the range grows by one
+    EXPECT_EQ(bank.allocate(Bank::MeasVector(0.f, 0.f)), slots[2]);
+    EXPECT_EQ(bank.live_end(), 3u);
+    bank.release(slots[0]);
+    bank.release(slots[1]);
+    bank.release(slots[2]);
+    EXPECT_EQ(bank.live_end(), 0u);
+}
+
+TEST(KalmanFilterBank, MatchesDenseFilters)
+{
+    // constant velocity model, 20 Hz
+    const float dt = 0.05f;
+    Bank::StateMatrix F = Bank::StateMatrix::Identity(), Q = Bank::StateMatrix::Identity() * 1e-3f;
+    F(0, 2) = F(1, 3) = dt;
+    Bank::StateMatrix P0 = Bank::StateMatrix::Identity();
+    P0(2, 2) = P0(3, 3) = 10.f;
+    const Bank::MeasMatrix R = Bank::MeasMatrix::Identity() * 0.01f;
+
+    Bank bank;
+    bank.set_model(F, Q, R, P0);
+    std::vector<size_t> slots;
+    std::vector<DenseFilter> reference(3);
+    for (size_t i = 0; i < reference.size(); i++)
+    {
+        const Eigen::Vector2f z(static_cast<float>(i), -static_cast<float>(i));
+        slots.push_back(bank.allocate(z));
+        reference[i].x << z, 0.f, 0.f;
+        reference[i].P = P0;
+    }
+
+    for (int k = 1; k <= 30; k++)
+    {
+        bank.predict();
+        for (DenseFilter &f : reference)
+            f.predict(F, Q);
+        for (size_t i = 0; i < reference.size(); i++)
+        {
+            // the second filter misses every third frame, and is only predicted then
+            if (i == 1 && k % 3 == 0)
+                continue;
+            const Eigen::Vector2f z(i + 0.5f * k * dt, -static_cast<float>(i) + 0.2f * std::sin(0.3f * k));
+            bank.set_measurement(slots[i], z);
+            reference[i].correct(z, R);
+        }
+        bank.correct();
+
+        for (size_t i = 0; i < reference.size(); i++)
+            for (int a = 0; a < 4; a++)
+            {
+                ASSERT_NEAR(bank.state(slots[i], a), reference[i].x(a), 1e-4f) << "filter " << i << ", frame " << k;
+                for (int b = 0; b < 4; b++)
+                    ASSERT_NEAR(bank.covariance(slots[i], a, b), reference[i].P(a, b), 1e-4f) << "filter " << i << ", frame " << k;
+            }
+    }
+}
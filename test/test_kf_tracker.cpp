@@ -0,0 +1,262 @@
+/* Copyright 2021 Kovács Gergely Attila
+*
+*   Licensed under the Apache License,
+*   Version 2.0(the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License.
+*
+*/
+
+#include <f1tenth_sensor_fusion/KFTracker.hpp>
+#include <gtest/gtest.h>
+#include <vector>
+
+using namespace f1tenth_sensor_fusion;
+
+namespace
+{
+    const double PERIOD = 0.05;
+
+    class KFTrackerTest : public ::testing::Test
+    {
+    protected:
+        void SetUp() override
+        {
+            tracker_.set_assignment(AssignmentMethod::HUNGARIAN, 0.5f);
+            tracker_.set_max_missed(2);
+        }
+
+        /// Track a frame of clusters at the given positions, stamped the given number of periods after the previous one.
+        FrameStatus track(const PointVector &centres, int periods = 1)
+        {
+            stamp_ += periods * PERIOD;
+            const FrameStatus status = tracker_.track(centres, stamp_, ids_);
+            tracker_.tracks(tracks_);
+            return status;
+        }
+
+        /// Track the same clusters until the object of the handle is dropped, returns false if it never is.
+        bool track_until_dropped(const PointVector &centres, const TrackHandle &handle)
+        {
+            for (int k = 0; k < 100; k++)
+            {
+                track(centres);
+                if (tracker_.index(handle) == -1)
+                    return true;
+            }
+            return false;
+        }
+
+        /// The ID of the object matched to a cluster, -1 if none is.
+        int id_of(int cluster) const
+        {
+            for (size_t i = 0; i < ids_.size(); i++)
+                if (ids_[i] == cluster)
+                    return static_cast<int>(tracks_[i].id);
+            return -1;
+        }
+
+        KFTracker tracker_;
+        boost::container::vector<int> ids_;
+        boost::container::vector<TrackState> tracks_;
+        double stamp_ = 100.0;
+    };
+
+    PointVector centres(std::initializer_list<std::pair<float, float>> xy)
+    {
+        PointVector out;
+        for (const auto &p : xy)
+            out.push_back(pcl::PointXYZ(p.first, p.second, 0.f));
+        return out;
+    }
+
+    typedef boost::container::vector<int> Ids;
+}
+
+TEST_F(KFTrackerTest, FirstFrameStartsATrackPerCluster)
+{
+    ids_.push_back(5);
+    EXPECT_EQ(track(centres({{0.f, 0.f}, {2.f, 0.f}, {0.f, 2.f}})), FrameStatus::INITIALIZED);
+    EXPECT_TRUE(ids_.empty());
+    ASSERT_EQ(tracks_.size(), 3u);
+    for (size_t i = 0; i < tracks_.size(); i++)
+    {
+        EXPECT_EQ(tracks_[i].id, i);
+        EXPECT_EQ(tracker_.index(tracks_[i].handle), static_cast<int>(i));
+    }
+    EXPECT_EQ(track(centres({{0.f, 0.f}, {2.f, 0.f}, {0.f, 2.f}})), FrameStatus::TRACKED);
+    EXPECT_EQ(ids_, (Ids{0, 1, 2}));
+}
+
+TEST_F(KFTrackerTest, ObjectsFollowReorderedClusters)
+{
+    track(centres({{0.f, 0.f}, {2.f, 0.f}}));
+    // both objects move by 5 cm per frame, the clusters come in either order
+    for (int k = 1; k <= 10; k++)
+    {
+        const float d = 0.05f * k;
+        const bool swapped = k % 2;
+        EXPECT_EQ(track(swapped ? centres({{2.f - d, 0.f}, {0.f, d}}) : centres({{0.f, d}, {2.f - d, 0.f}})), FrameStatus::TRACKED);
+        EXPECT_EQ(ids_, swapped ? (Ids{1, 0}) : (Ids{0, 1})) << "frame " << k;
+        EXPECT_EQ(id_of(swapped ? 1 : 0), 0) << "frame " << k;
+        EXPECT_EQ(id_of(swapped ? 0 : 1), 1) << "frame " << k;
+    }
+    ASSERT_EQ(tracks_.size(), 2u);
+    EXPECT_EQ(tracks_[0].age, 11u);
+    EXPECT_EQ(tracks_[0].missed, 0u);
+}
+
+TEST_F(KFTrackerTest, MissedTracksSurviveMaxMissedFrames)
+{
+    track(centres({{0.f, 0.f}, {2.f, 0.f}}));
+    track(centres({{0.f, 0.f}, {2.f, 0.f}}));
+    const TrackHandle lost = tracks_[1].handle;
+
+    // the second object is missed twice and kept, without a cluster
+    for (uint32_t missed = 1; missed <= 2; missed++)
+    {
+        track(centres({{0.f, 0.f}}));
+        ASSERT_EQ(tracks_.size(), 2u);
+        EXPECT_EQ(ids_[1], -1);
+        EXPECT_EQ(tracks_[1].missed, missed);
+        EXPECT_EQ(tracker_.index(lost), 1);
+    }
+    // and dropped on the third frame
+    track(centres({{0.f, 0.f}}));
+    ASSERT_EQ(tracks_.size(), 1u);
+    EXPECT_EQ(tracks_[0].id, 0u);
+    EXPECT_EQ(tracker_.index(lost), -1);
+}
+
+TEST_F(KFTrackerTest, ReusedSlotsGetANewGeneration)
+{
+    track(centres({{0.f, 0.f}, {2.f, 0.f}}));
+    track(centres({{0.f, 0.f}, {2.f, 0.f}}));
+    const TrackHandle old = tracks_[1].handle;
+    ASSERT_TRUE(track_until_dropped(centres({{0.f, 0.f}}), old));
+    ASSERT_EQ(tracks_.size(), 1u);
+    EXPECT_EQ(tracks_[0].id, 0u);
+
+    // a new object takes the released slot under a new ID, the handle of the dropped one stays invalid
+    track(centres({{0.f, 0.f}, {5.f, 5.f}}));
+    ASSERT_EQ(tracks_.size(), 2u);
+    const TrackState &fresh = tracks_[1];
+    EXPECT_EQ(fresh.id, 2u);
+    EXPECT_EQ(fresh.handle.slot, old.slot);
+    EXPECT_NE(fresh.handle.generation, old.generation);
+    EXPECT_EQ(tracker_.index(old), -1);
+    EXPECT_EQ(tracker_.index(fresh.handle), 1);
+    EXPECT_EQ(id_of(1), 2);
+}
+
+TEST_F(KFTrackerTest, IndexFollowsTheCompaction)
+{
+    track(centres({{0.f, 0.f}, {2.f, 0.f}, {4.f, 0.f}}));
+    track(centres({{0.f, 0.f}, {2.f, 0.f}, {4.f, 0.f}}));
+    const TrackHandle middle = tracks_[1].handle, last = tracks_[2].handle;
+    ASSERT_TRUE(track_until_dropped(centres({{0.f, 0.f}, {4.f, 0.f}}), middle));
+    ASSERT_EQ(tracks_.size(), 2u);
+    EXPECT_EQ(tracks_[1].id, 2u);
+    EXPECT_EQ(tracker_.index(last), 1);
+    EXPECT_EQ(tracker_.index(TrackHandle{1000, 0}), -1);
+}
+
+TEST_F(KFTrackerTest, PredictsByTheElapsedTime)
+{
+    tracker_.set_assignment(AssignmentMethod::HUNGARIAN, 0.3f);
+    // 4 m/s, 20 cm per period, entering an empty scene off the axes: clusters on them are ignored
+    float x = 0.5f;
+    track(PointVector());
+    track(centres({{x, 1.f}}));
+    for (int k = 0; k < 20; k++)
+    {
+        x += 0.2f;
+        track(centres({{x, 1.f}}));
+    }
+    ASSERT_EQ(ids_, Ids{0});
+
+    // two dropped frames: a prediction by one period would be 40 cm short, outside of the gate
+    x += 0.6f;
+    EXPECT_EQ(track(centres({{x, 1.f}}), 3), FrameStatus::TRACKED);
+    EXPECT_EQ(ids_, Ids{0});
+
+    // bunched frames, a quarter of a period apart
+    stamp_ -= 0.75 * PERIOD;
+    x += 0.05f;
+    EXPECT_EQ(track(centres({{x, 1.f}})), FrameStatus::TRACKED);
+    EXPECT_EQ(ids_, Ids{0});
+}
+
+TEST_F(KFTrackerTest, DropsOutOfOrderFrames)
+{
+    track(centres({{0.f, 0.f}}));
+    track(centres({{0.f, 0.f}}));
+    Ids ids{7};
+    EXPECT_EQ(tracker_.track(centres({{0.f, 0.f}, {3.f, 3.f}}), stamp_ - 0.5 * PERIOD, ids), FrameStatus::OUT_OF_ORDER);
+    EXPECT_EQ(ids, Ids{7});
+    // the dropped frame added no object
+    EXPECT_EQ(track(centres({{0.f, 0.f}})), FrameStatus::TRACKED);
+    EXPECT_EQ(ids_, Ids{0});
+}
+
+TEST_F(KFTrackerTest, RestartsAfterAGapOrAReset)
+{
+    track(centres({{0.f, 0.f}, {2.f, 0.f}}));
+    track(centres({{0.f, 0.f}, {2.f, 0.f}}));
+    const TrackHandle before = tracks_[0].handle;
+
+    // a frame far in the past is a restarted replay, far in the future an interrupted input
+    stamp_ -= 10.0;
+    EXPECT_EQ(track(centres({{0.f, 0.f}})), FrameStatus::INITIALIZED);
+    EXPECT_TRUE(ids_.empty());
+    ASSERT_EQ(tracks_.size(), 1u);
+    EXPECT_EQ(tracks_[0].id, 2u); // IDs are never reused
+    EXPECT_EQ(tracker_.index(before), -1);
+    EXPECT_EQ(track(centres({{0.f, 0.f}})), FrameStatus::TRACKED);
+    EXPECT_EQ(ids_, Ids{0});
+
+    stamp_ += 10.0;
+    EXPECT_EQ(track(centres({{0.f, 0.f}})), FrameStatus::INITIALIZED);
+    EXPECT_EQ(tracks_[0].id, 3u);
+
+    tracker_.reset();
+    EXPECT_EQ(track(centres({{1.f, 1.f}})), FrameStatus::INITIALIZED);
+    EXPECT_EQ(tracks_[0].id, 4u);
+    EXPECT_EQ(track(centres({{1.f, 1.f}})), FrameStatus::TRACKED);
+    EXPECT_EQ(ids_, Ids{0});
+}
+
+TEST_F(KFTrackerTest, RestartsWithAnotherMotionModel)
+{
+    track(centres({{0.f, 0.f}, {2.f, 0.f}}));
+    track(centres({{0.f, 0.f}, {2.f, 0.f}}));
+
+    MotionModelConfig config;
+    config.model = MotionModel::CA;
+    tracker_.set_motion_model(config);
+    tracker_.tracks(tracks_);
+    EXPECT_TRUE(tracks_.empty());
+    // the first frame after the switch starts the objects again, tracked by filters of the new model
+    EXPECT_EQ(track(centres({{0.f, 0.f}})), FrameStatus::INITIALIZED);
+    ASSERT_EQ(tracks_.size(), 1u);
+    EXPECT_EQ(tracks_[0].id, 2u);
+    EXPECT_EQ(tracker_.index(tracks_[0].handle), 0);
+    EXPECT_EQ(track(centres({{0.f, 0.f}})), FrameStatus::TRACKED);
+    EXPECT_EQ(ids_, Ids{0});
+}
+
+TEST_F(KFTrackerTest, ClustersOutsideTheGateStartNewObjects)
+{
+    track(centres({{0.f, 0.f}}));
+    track(centres({{1.f, 0.f}}));
+    EXPECT_EQ(ids_, (Ids{-1, 0}));
+    EXPECT_EQ(id_of(0), 1);
+}
@@ -0,0 +1,114 @@
+/* Copyright 2021 Kovács Gergely Attila
+*
+*   Licensed under the Apache License,
+*   Version 2.0(the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License.
+*
+*/
+
+#include <f1tenth_sensor_fusion/latency_controller.hpp>
+#include <gtest/gtest.h>
+#include <cmath>
+
+using namespace f1tenth_sensor_fusion;
+
+namespace
+{
+    /// Feed frames of a constant duration, returns how many changed the value.
+    int run(LatencyController &controller, double duration, int frames)
+    {
+        int changes = 0;
+        for (int i = 0; i < frames; i++)
+            changes += controller.update(duration);
+        return changes;
+    }
+}
+
+TEST(LatencyController, DisabledWithoutATarget)
+{
+    LatencyController controller;
+    controller.configure(0.0, 0.01, 0.04);
+    EXPECT_FALSE(controller.enabled());
+    EXPECT_EQ(run(controller, 1.0, 10), 0);
+    EXPECT_DOUBLE_EQ(controller.value(), 0.01);
+}
+
+TEST(LatencyController, StartsAtTheFinestValue)
+{
+    LatencyController controller;
+    controller.configure(0.02, 0.01, 0.04);
+    EXPECT_TRUE(controller.enabled());
+    EXPECT_DOUBLE_EQ(controller.value(), 0.01);
+    EXPECT_FLOAT_EQ(controller.level(), 0.f);
+}
+
+TEST(LatencyController, HoldsWithinTheDeadBand)
+{
+    LatencyController controller;
+    controller.configure(0.02, 0.01, 0.04);
+    EXPECT_EQ(run(controller, 0.021, 50), 0);
+    EXPECT_EQ(run(controller, 0.019, 50), 0);
+    EXPECT_FLOAT_EQ(controller.level(), 0.f);
+}
+
+TEST(LatencyController, CoarsensSlowFramesAndRefinesFastOnes)
+{
+    LatencyController controller;
+    controller.configure(0.02, 0.01, 0.04);
+    EXPECT_GT(run(controller, 0.04, 5), 0);
+    const float raised = controller.level();
+    EXPECT_GT(raised, 0.f);
+    EXPECT_GT(controller.value(), 0.01);
+
+    // saturates at the coarsest value
+    run(controller, 1.0, 100);
+    EXPECT_FLOAT_EQ(controller.level(), 1.f);
+    EXPECT_NEAR(controller.value(), 0.04, 1e-9);
+    EXPECT_FALSE(controller.update(1.0));
+
+    // quality is regained slower than it is given up
+    LatencyController falling;
+    falling.configure(0.02, 0.01, 0.04);
+    run(falling, 1.0, 100);
+    // the moving average has to come down below the dead band first
+    int frames = 0;
+    while (falling.level() == 1.f && frames++ < 100)
+        falling.update(0.0);
+    ASSERT_LT(falling.level(), 1.f);
+    run(falling, 0.0, 4);
+    EXPECT_LT(1.f - falling.level(), raised);
+    run(falling, 0.0, 1000);
+    EXPECT_FLOAT_EQ(falling.level(), 0.f);
+    EXPECT_NEAR(falling.value(), 0.01, 1e-9);
+}
+
+TEST(LatencyController, InterpolatesGeometrically)
+{
+    LatencyController controller;
+    controller.configure(0.02, 0.01, 0.04);
+    while (controller.level() < 0.5f)
+        controller.update(0.04);
+    EXPECT_NEAR(controller.value(), 0.01 * std::pow(4.0, controller.level()), 1e-9);
+}
+
+TEST(LatencyController, ConfigureRestarts)
+{
+    LatencyController controller;
+    controller.configure(0.02, 0.01, 0.04);
+    run(controller, 1.0, 20);
+    controller.configure(0.02, 100.0, 1000.0);
+    EXPECT_FLOAT_EQ(controller.level(), 0.f);
+    EXPECT_DOUBLE_EQ(controller.value(), 100.0);
+    // the smoothed time starts over as well, a frame on target is not averaged with the slow ones
+    EXPECT_FALSE(controller.update(0.02));
+    EXPECT_FLOAT_EQ(controller.level(), 0.f);
+}
@@ -0,0 +1,171 @@
+/* Copyright 2021 Kovács Gergely Attila
+*
+*   Licensed under the Apache License,
+*   Version 2.0(the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License.
+*
+*/
+
+#include <f1tenth_sensor_fusion/motion_models.hpp>
+#include <f1tenth_sensor_fusion/track_filters.hpp>
+#include <gtest/gtest.h>
+#include <cmath>
+#include <memory>
+
+using namespace f1tenth_sensor_fusion;
+
+namespace
+{
+    /// Feed a filter the positions of an object moving at a constant velocity, returns its slot.
+    size_t track_straight_line(TrackFilters &filters, const PlanarVector &velocity, int frames, float dt)
+    {
+        const PlanarVector start(1.f, -2.f);
+        const size_t slot = filters.allocate(start);
+        for (int k = 1; k <= frames; k++)
+        {
+            filters.predict(dt);
+            filters.set_measurement(slot, start + velocity * (k * dt));
+            filters.correct();
+        }
+        return slot;
+    }
+}
+
+TEST(MotionModels, ParsesModelNames)
+{
+    MotionModel model = MotionModel::CV;
+    EXPECT_TRUE(parse_motion_model("ca", model));
+    EXPECT_EQ(model, MotionModel::CA);
+    EXPECT_TRUE(parse_motion_model("ctrv", model));
+    EXPECT_EQ(model, MotionModel::CTRV);
+    EXPECT_TRUE(parse_motion_model("imm", model));
+    EXPECT_EQ(model, MotionModel::IMM);
+    EXPECT_TRUE(parse_motion_model("cv", model));
+    EXPECT_EQ(model, MotionModel::CV);
+    EXPECT_FALSE(parse_motion_model("bicycle", model));
+    EXPECT_EQ(model, MotionModel::CV);
+}
+
+TEST(MotionModels, LinearModelsIntegrateTheirDerivatives)
+{
+    ConstantVelocity::State cv;
+    ConstantVelocity::StateMatrix F_cv;
+    cv << 1.f, 2.f, 3.f, -4.f;
+    ConstantVelocity::predict(cv, 0.5f, F_cv);
+    EXPECT_FLOAT_EQ(cv(0), 2.5f);
+    EXPECT_FLOAT_EQ(cv(1), 0.f);
+    EXPECT_FLOAT_EQ(cv(2), 3.f);
+
+    ConstantAcceleration::State ca;
+    ConstantAcceleration::StateMatrix F_ca;
+    ca << 0.f, 0.f, 1.f, 0.f, 2.f, -2.f;
+    ConstantAcceleration::predict(ca, 1.f, F_ca);
+    EXPECT_FLOAT_EQ(ca(0), 2.f); // 1 * 1 + 0.5 * 2 * 1^2
+    EXPECT_FLOAT_EQ(ca(1), -1.f);
+    EXPECT_FLOAT_EQ(ca(2), 3.f);
+    EXPECT_FLOAT_EQ(ca(3), -2.f);
+}
+
+TEST(MotionModels, TurnRateJacobianMatchesFiniteDifferences)
+{
+    const float dt = 0.1f, h = 1e-2f; // smaller steps drown in float rounding
+    for (float yaw_rate : {0.f, 0.8f, -2.f})
+    {
+        ConstantTurnRate::State x0;
+        x0 << 1.f, 2.f, 3.f, 0.4f, yaw_rate;
+        ConstantTurnRate::State x = x0;
+        ConstantTurnRate::StateMatrix F, unused;
+        ConstantTurnRate::predict(x, dt, F);
+        for (int j = 0; j < ConstantTurnRate::StateDim; j++)
+        {
+            ConstantTurnRate::State plus = x0, minus = x0;
+            plus(j) += h;
+            minus(j) -= h;
+            ConstantTurnRate::predict(plus, dt, unused);
+            ConstantTurnRate::predict(minus, dt, unused);
+            ConstantTurnRate::State diff = plus - minus;
+            ConstantTurnRate::normalize(diff);
+            for (int i = 0; i < ConstantTurnRate::StateDim; i++)
+                EXPECT_NEAR(F(i, j), diff(i) / (2.f * h), 2e-2f) << "yaw rate " << yaw_rate << ", F(" << i << ", " << j << ")";
+        }
+    }
+}
+
+TEST(MotionModels, TurnRateModelsWrapTheYaw)
+{
+    ConstantTurnRate::State x;
+    ConstantTurnRate::StateMatrix F;
+    x << 0.f, 0.f, 1.f, 3.f, 2.f;
+    ConstantTurnRate::predict(x, 0.5f, F);
+    EXPECT_NEAR(x(3), 4.f - 2.f * M_PI, 1e-5);
+
+    // the straight mode of the IMM keeps its heading and drops the yaw rate
+    StraightMotion::State s;
+    s << 0.f, 0.f, 2.f, 0.5f * static_cast<float>(M_PI), 1.f;
+    StraightMotion::predict(s, 1.f, F);
+    EXPECT_NEAR(s(0), 0.f, 1e-5);
+    EXPECT_NEAR(s(1), 2.f, 1e-5);
+    EXPECT_FLOAT_EQ(s(3), 0.5f * static_cast<float>(M_PI));
+    EXPECT_FLOAT_EQ(s(4), 0.f);
+}
+
+TEST(TrackFilters, EveryModelConvergesToAStraightLine)
+{
+    const PlanarVector velocity(0.6f, 1.6f);
+    for (MotionModel model : {MotionModel::CV, MotionModel::CA, MotionModel::CTRV, MotionModel::IMM})
+    {
+        MotionModelConfig config;
+        config.model = model;
+        std::unique_ptr<TrackFilters> filters = make_track_filters(config);
+        const StateVariance initial = filters->variance(filters->allocate(PlanarVector(0.f, 0.f)));
+        const size_t slot = track_straight_line(*filters, velocity, 80, 0.05f);
+        const PlanarVector last = PlanarVector(1.f, -2.f) + velocity * (80 * 0.05f);
+        EXPECT_LT((filters->position(slot) - last).norm(), 0.05f) << "model " << static_cast<int>(model);
+        EXPECT_LT((filters->velocity(slot) - velocity).norm(), 0.2f) << "model " << static_cast<int>(model);
+        EXPECT_LT(filters->variance(slot)(2), initial(2)) << "model " << static_cast<int>(model);
+    }
+}
+
+TEST(TrackFilters, FiltersWithoutMeasurementsOnlyPredict)
+{
+    for (MotionModel model : {MotionModel::CV, MotionModel::CTRV})
+    {
+        MotionModelConfig config;
+        config.model = model;
+        std::unique_ptr<TrackFilters> filters = make_track_filters(config);
+        const size_t moving = track_straight_line(*filters, PlanarVector(1.f, 0.f), 40, 0.05f);
+        const size_t still = filters->allocate(PlanarVector(5.f, 5.f));
+        const StateVariance before = filters->variance(still);
+        const PlanarVector position = filters->position(moving);
+        filters->predict(0.05f);
+        filters->correct();
+        EXPECT_NEAR(filters->position(moving).x(), position.x() + 0.05f * filters->velocity(moving).x(), 1e-3f);
+        EXPECT_FLOAT_EQ(filters->position(still).x(), 5.f);
+        EXPECT_GT(filters->variance(still)(0), before(0)); // uncertainty only grows
+    }
+}
+
+TEST(TrackFilters, ReusesReleasedSlots)
+{
+    for (MotionModel model : {MotionModel::CV, MotionModel::CA, MotionModel::CTRV, MotionModel::IMM})
+    {
+        MotionModelConfig config;
+        config.model = model;
+        std::unique_ptr<TrackFilters> filters = make_track_filters(config);
+        filters->allocate(PlanarVector(0.f, 0.f));
+        const size_t slot = filters->allocate(PlanarVector(1.f, 1.f));
+        filters->release(slot);
+        EXPECT_EQ(filters->allocate(PlanarVector(2.f, 3.f)), slot);
+        EXPECT_FLOAT_EQ(filters->position(slot).y(), 3.f);
+        EXPECT_FLOAT_EQ(filters->velocity(slot).norm(), 0.f);
+    }
+}